@@ -102,6 +102,9 @@ static void NS8390_trigger_send(struct device *dev, unsigned int length,
 #ifdef HAVE_MULTICAST
 static void set_multicast_list(struct device *dev, int num_addrs, void *addrs);
 #endif
+#ifdef HAVE_MULTICAST_FILTER
+static void set_multicast_filter(struct device *dev, unsigned char *filter);
+#endif
 
 
 /* Open/initialize the board.  This routine goes all-out, setting everything
@@ -590,6 +593,28 @@ static void set_multicast_list(struct device *dev, int num_addrs, void *addrs)
 }
 #endif
 
+#ifdef HAVE_MULTICAST_FILTER
+/* Load the multicast hash filter.  NS8390_init() leaves it accepting
+   everything; once the upper layers hand us the real bits only our
+   groups (and whatever shares their hash bits) get past the chip.
+   The registers are on page 1, so keep the interrupt handler out while
+   we are switched over there. */
+static void set_multicast_filter(struct device *dev, unsigned char *filter)
+{
+    int e8390_base = dev->base_addr;
+    unsigned long flags;
+    int i;
+
+    save_flags(flags);
+    cli();
+    outb_p(E8390_NODMA + E8390_PAGE1, e8390_base + E8390_CMD);
+    for(i = 0; i < 8; i++)
+		outb_p(filter[i], e8390_base + EN1_MULT + i);
+    outb_p(E8390_NODMA + E8390_PAGE0, e8390_base + E8390_CMD);
+    restore_flags(flags);
+}
+#endif
+
 /* Initialize the rest of the 8390 device structure. */
 int ethdev_init(struct device *dev)
 {
@@ -616,6 +641,9 @@ int ethdev_init(struct device *dev)
 #ifdef HAVE_MULTICAST
     dev->set_multicast_list = &set_multicast_list;
 #endif
+#ifdef HAVE_MULTICAST_FILTER
+    dev->set_multicast_filter = &set_multicast_filter;
+#endif
 
     ether_setup(dev);
         
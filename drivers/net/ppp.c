@@ -91,6 +91,15 @@
 
 #define bset(p,b)	((p)[(b) >> 5] |= (1 << ((b) & 0x1f)))
 
+/* word-at-a-time byte tests on a 32 bit word; a hit only means "look
+   closer", the exact byte is then found with in_xmap/in_rmap */
+#define W_ONES		0x01010101U
+#define W_HIGHS		0x80808080U
+#define w_has_zero(w)	(((w) - W_ONES) & ~(w) & W_HIGHS)
+#define w_has_byte(w,b)	w_has_zero((w) ^ (W_ONES * (b)))
+#define w_has_ctl(w)	(((w) - W_ONES * 0x20) & ~(w) & W_HIGHS)
+#define w_aligned(p)	((((unsigned long) (p)) & 3) == 0)
+
 int ppp_debug = 2;
 int ppp_debug_netpackets = 0;
 
@@ -138,6 +147,10 @@ static int ppp_lock(struct ppp *);
 static void ppp_unlock(struct ppp *);
 static void ppp_add_fcs(struct ppp *);
 static int ppp_check_fcs(struct ppp *);
+static void ppp_init_fcstab(void);
+static unsigned short ppp_fcs_block(unsigned short, unsigned char *, int);
+static void ppp_xmap_changed(struct ppp *);
+static void ppp_stuff_block(struct ppp *, unsigned char *, int);
 static void ppp_print_buffer(const char *,char *,int,int);
 
 static int ppp_read(struct tty_struct *, struct file *, unsigned char *,
@@ -197,6 +210,11 @@ static unsigned short fcstab[256] = {
   0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
   };
 
+/* fcstab_n[k][c] is the FCS contribution of byte C followed by K+1 zero
+   bytes.  Built from fcstab at init time; lets ppp_fcs_block() fold in
+   four bytes per step with independent table lookups (slice-by-4). */
+static unsigned short fcstab_n[3][256];
+
 struct tty_ldisc ppp_ldisc;
 
 static struct ppp ppp_ctrl[PPP_NRUNIT];
@@ -236,6 +254,8 @@ ppp_init(struct device *dev)
 	   "TCP compression code copyright 1989 Regents of the "
 	   "University of California\n");
 
+    ppp_init_fcstab();
+
     (void) memset(&ppp_ldisc, 0, sizeof(ppp_ldisc));
     ppp_ldisc.open    = ppp_open;
     ppp_ldisc.close   = ppp_close;
@@ -320,6 +340,7 @@ ppp_init_ctrl_blk(struct ppp *ppp)
   ppp->xmit_async_map[0] = 0xffffffff;
   ppp->xmit_async_map[3] = 0x60000000;
   ppp->recv_async_map	 = 0x00000000;
+  ppp_xmap_changed (ppp);
 
   ppp->slcomp		= NULL;
   ppp->rbuff		= NULL;
@@ -789,6 +810,26 @@ static unsigned paritytab[8] = {
     0x96696996, 0x69969669, 0x69969669, 0x96696996,
     0x69969669, 0x96696996, 0x96696996, 0x69969669
 };
+
+#define SC_RCV_BITS	(SC_RCV_B7_1 | SC_RCV_B7_0 | SC_RCV_ODDP | SC_RCV_EVNP)
+
+/* note bit 7 and parity of N received characters; once every kind
+   has been seen there is nothing left to learn, so skip the scan */
+static inline void
+ppp_check_chars(struct ppp *ppp, unsigned char *c, int n)
+{
+  for (; n > 0 && (ppp->flags & SC_RCV_BITS) != SC_RCV_BITS; n--, c++) {
+    if (*c & 0x80)
+	ppp->flags |= SC_RCV_B7_1;
+    else
+	ppp->flags |= SC_RCV_B7_0;
+
+    if (paritytab[*c >> 5] & (1 << (*c & 0x1F)))
+	ppp->flags |= SC_RCV_ODDP;
+    else
+	ppp->flags |= SC_RCV_EVNP;
+  }
+}
 #endif
 
 #ifndef NEW_TTY_DRIVERS
@@ -915,6 +956,71 @@ ppp_unesc(struct ppp *ppp, unsigned char *c, int n)
 }
 
 #else
+/* length of the leading run of characters in CP that need no receive
+   processing: not PPP_ESC or PPP_FLAG, not dropped by the receive map
+   and not flagged in error by the tty driver */
+static int
+ppp_rcv_run(struct ppp *ppp, unsigned char *cp, char *fp, int count)
+{
+  unsigned char *p = cp;
+  unsigned int w;
+  int n = count, i;
+
+  while (n > 0 && !w_aligned (p)) {
+    if (*p == PPP_ESC || *p == PPP_FLAG || in_rmap (ppp, *p))
+      break;
+    p++;
+    n--;
+  }
+  if (w_aligned (p)) {
+    while (n >= 4) {
+      w = *(unsigned int *) p;
+      if (w_has_byte (w, PPP_ESC) || w_has_byte (w, PPP_FLAG) ||
+	  (ppp->recv_async_map && w_has_ctl (w)))
+	break;
+      p += 4;
+      n -= 4;
+    }
+  }
+  while (n > 0 && *p != PPP_ESC && *p != PPP_FLAG && !in_rmap (ppp, *p)) {
+    p++;
+    n--;
+  }
+
+  n = p - cp;
+  if (fp)
+    for (i = 0; i < n; i++)
+      if (fp[i])
+	return i;
+  return n;
+}
+
+/* stuff a run of N plain characters into the receive buffer */
+static inline void
+ppp_enqueue_block(struct ppp *ppp, unsigned char *cp, int n)
+{
+  unsigned long flags;
+  int room;
+
+#ifdef CHECK_CHARACTERS
+  ppp_check_chars (ppp, cp, n);
+#endif
+
+  save_flags(flags);
+  cli();
+  room = ppp->rend - ppp->rhead;
+  if (n > room) {
+    ppp->stats.roverrun += n - room;
+    n = room;
+  }
+  if (n > 0) {
+    memcpy (ppp->rhead, cp, n);
+    ppp->rhead  += n;
+    ppp->rcount += n;
+  }
+  restore_flags(flags);
+}
+
 static int ppp_receive_room(struct tty_struct *tty)
 {
 	return 65536;  /* We can handle an infinite amount of data. :-) */
@@ -926,6 +1032,7 @@ static void ppp_receive_buf(struct tty_struct *tty, unsigned char *cp,
 {
   register struct ppp *ppp = ppp_find (tty);
   unsigned char c;
+  int n;
  
 /*  PRINTK( ("PPP: handler called.\n") ); */
 
@@ -943,8 +1050,22 @@ static void ppp_receive_buf(struct tty_struct *tty, unsigned char *cp,
 
   ppp->stats.rbytes += count;
  
-  while (count-- > 0) {
+  while (count > 0) {
+    /* copy a run of plain characters straight into the frame */
+    if (ppp->escape == 0 && ppp->toss == 0) {
+      n = ppp_rcv_run (ppp, cp, fp, count);
+      if (n > 0) {
+	ppp_enqueue_block (ppp, cp, n);
+	cp    += n;
+	count -= n;
+	if (fp)
+	  fp += n;
+	continue;
+      }
+    }
+
     c = *cp++;
+    count--;
 
     if (fp) {
       if (*fp && ppp->toss == 0)
@@ -953,15 +1074,7 @@ static void ppp_receive_buf(struct tty_struct *tty, unsigned char *cp,
     }
 
 #ifdef CHECK_CHARACTERS
-    if (c & 0x80)
-	ppp->flags |= SC_RCV_B7_1;
-    else
-	ppp->flags |= SC_RCV_B7_0;
-
-    if (paritytab[c >> 5] & (1 << (c & 0x1F)))
-	ppp->flags |= SC_RCV_ODDP;
-    else
-	ppp->flags |= SC_RCV_EVNP;
+    ppp_check_chars (ppp, &c, 1);
 #endif
 
     switch (c) {
@@ -1339,6 +1452,54 @@ ppp_stuff_char(struct ppp *ppp, unsigned char c)
   ppp->fcs = (ppp->fcs >> 8) ^ fcstab[(ppp->fcs ^ c) & 0xff];
 }
 
+/* stuff N characters from P into the transmit buffer.  The FCS is
+   folded in over the whole block, then runs of characters that need no
+   escaping are copied in one go; the run scan looks at a word at a time
+   when the map only escapes control characters, PPP_ESC and PPP_FLAG */
+static void
+ppp_stuff_block(struct ppp *ppp, unsigned char *p, int n)
+{
+  unsigned char *start;
+  unsigned int w;
+
+  ppp->fcs = ppp_fcs_block (ppp->fcs, p, n);
+
+  while (n > 0) {
+    start = p;
+    if (ppp->xmap_fast) {
+      while (n > 0 && !w_aligned (p) && !in_xmap (ppp, *p)) {
+	p++;
+	n--;
+      }
+      if (w_aligned (p)) {
+	while (n >= 4) {
+	  w = *(unsigned int *) p;
+	  if (w_has_ctl (w) || w_has_byte (w, PPP_ESC) ||
+	      w_has_byte (w, PPP_FLAG))
+	    break;
+	  p += 4;
+	  n -= 4;
+	}
+      }
+    }
+    while (n > 0 && !in_xmap (ppp, *p)) {
+      p++;
+      n--;
+    }
+
+    if (p != start) {
+      memcpy (ppp->xhead, start, p - start);
+      ppp->xhead += p - start;
+    }
+
+    if (n > 0) {
+      *ppp->xhead++ = PPP_ESC;
+      *ppp->xhead++ = *p++ ^ PPP_TRANS;
+      n--;
+    }
+  }
+}
+
 /* write a frame with NR chars from BUF to TTY
    we have to put the FCS field on ourselves
 */
@@ -1347,7 +1508,8 @@ static int
 ppp_write(struct tty_struct *tty, struct file *file, unsigned char *buf, unsigned int nr)
 {
   struct ppp *ppp = ppp_find(tty);
-  int i;
+  unsigned char chunk[128];
+  int i, n;
 
   if (!ppp || ppp->magic != PPP_MAGIC) {
     PRINTKN (1,(KERN_ERR "ppp_write: cannot find ppp unit\n"));
@@ -1403,9 +1565,11 @@ ppp_write(struct tty_struct *tty, struct file *file, unsigned char *buf, unsigne
 #endif
 
   ppp->fcs = PPP_FCS_INIT;
-  i = nr;
-  while (i-- > 0)
-    ppp_stuff_char(ppp,get_fs_byte(buf++));
+  for (i = nr; i > 0; i -= n, buf += n) {
+    n = i < sizeof (chunk) ? i : sizeof (chunk);
+    memcpy_fromfs (chunk, buf, n);
+    ppp_stuff_block (ppp, chunk, n);
+  }
 
   ppp_add_fcs(ppp);		/* concatenate FCS at end */
 
@@ -1496,6 +1660,7 @@ ppp_ioctl(struct tty_struct *tty, struct file *file, unsigned int i,
       ppp->xmit_async_map[0] = get_fs_long (l);
       bset (ppp->xmit_async_map, PPP_FLAG);
       bset (ppp->xmit_async_map, PPP_ESC);
+      ppp_xmap_changed (ppp);
       PRINTKN (3,(KERN_INFO "ppp_ioctl: set xmit asyncmap %lx\n",
 		  ppp->xmit_async_map[0]));
     }
@@ -1601,6 +1766,7 @@ ppp_ioctl(struct tty_struct *tty, struct file *file, unsigned int i,
 	error = -EINVAL;
       else {
 	memcpy (ppp->xmit_async_map, temp_tbl, sizeof (ppp->xmit_async_map));
+	ppp_xmap_changed (ppp);
 	PRINTKN (3,(KERN_INFO "ppp_ioctl: set xasyncmap\n"));
       }
     }
@@ -1732,7 +1898,7 @@ ppp_xmit(struct sk_buff *skb, struct device *dev)
   /* Get pointers to the various components */
   ppp   = &ppp_ctrl[dev->base_addr];
   tty   = ppp->tty;
-  p     = (unsigned char *) (skb + 1);
+  p     = skb->data;
   len   = skb->len;
   proto = PROTO_IP;
 
@@ -1804,7 +1970,7 @@ ppp_xmit(struct sk_buff *skb, struct device *dev)
     ++ppp->stats.suncomp;
       
   if (ppp_debug_netpackets) {
-    struct iphdr *iph = (struct iphdr *) (skb + 1);
+    struct iphdr *iph = (struct iphdr *) skb->data;
     PRINTK ((KERN_DEBUG "%s ==> proto %x len %d src %x dst %x proto %d\n",
 	    dev->name, (int) proto, (int) len, (int) iph->saddr,
 	    (int) iph->daddr, (int) iph->protocol))
@@ -1830,8 +1996,7 @@ ppp_xmit(struct sk_buff *skb, struct device *dev)
   ppp_stuff_char(ppp, proto&0xff);
 
   /* data part */
-  while (len-- > 0)
-    ppp_stuff_char(ppp, *p++);
+  ppp_stuff_block(ppp, p, len);
 
   /* fcs and flag */
   ppp_add_fcs(ppp);
@@ -1987,6 +2152,52 @@ ppp_unlock(struct ppp *ppp)
 
 /* FCS support functions */
 
+static void
+ppp_init_fcstab(void)
+{
+  int i, k;
+  unsigned short fcs;
+
+  for (i = 0; i < 256; i++) {
+    fcs = fcstab[i];
+    for (k = 0; k < 3; k++) {
+      fcs = (fcs >> 8) ^ fcstab[fcs & 0xff];
+      fcstab_n[k][i] = fcs;
+    }
+  }
+}
+
+/* run the FCS over N bytes at P; four bytes per step, byte loads only,
+   so it does not care about alignment or byte order */
+static unsigned short
+ppp_fcs_block(unsigned short fcs, unsigned char *p, int n)
+{
+  while (n >= 4) {
+    fcs = fcstab_n[2][(fcs ^ p[0]) & 0xff] ^
+	  fcstab_n[1][((fcs >> 8) ^ p[1]) & 0xff] ^
+	  fcstab_n[0][p[2]] ^
+	  fcstab[p[3]];
+    p += 4;
+    n -= 4;
+  }
+  while (n-- > 0)
+    fcs = (fcs >> 8) ^ fcstab[(fcs ^ *p++) & 0xff];
+  return fcs;
+}
+
+/* the transmit map changed; note whether the word-at-a-time scan in
+   ppp_stuff_block() can be used to skip over plain characters */
+static void
+ppp_xmap_changed(struct ppp *ppp)
+{
+  int i;
+
+  ppp->xmap_fast = (ppp->xmit_async_map[3] & ~0x60000000) == 0;
+  for (i = 1; i < 8; i++)
+    if (i != 3 && ppp->xmit_async_map[i] != 0)
+      ppp->xmap_fast = 0;
+}
+
 static void
 ppp_add_fcs(struct ppp *ppp)
 {
@@ -2003,12 +2214,14 @@ ppp_add_fcs(struct ppp *ppp)
 static int
 ppp_check_fcs(struct ppp *ppp)
 {
-  unsigned short fcs = PPP_FCS_INIT, msgfcs;
+  unsigned short fcs, msgfcs;
   unsigned char *c = ppp->rbuff;
-  int i;
 
-  for (i = 0; i < ppp->rcount - 2; i++, c++)
-    fcs = (fcs >> 8) ^ fcstab[(fcs ^ *c) & 0xff];
+  if (ppp->rcount < 2)
+    return 0;
+
+  fcs = ppp_fcs_block (PPP_FCS_INIT, c, ppp->rcount - 2);
+  c += ppp->rcount - 2;
 
   fcs ^= 0xffff;
   msgfcs = (c[1] << 8) + c[0];
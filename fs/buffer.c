@@ -39,8 +39,37 @@ static int grow_buffers(int pri, int size);
 static int shrink_specific_buffers(unsigned int priority, int size);
 static int maybe_shrink_lav_buffers(int);
 
-static int nr_hash = 0;  /* Size of hash table */
+static int nr_hash = 0;  /* Size of hash table, a power of two */
+static int hash_shift = 0;
 static struct buffer_head ** hash_table;
+static int hash_resizing = 0;
+#define MAX_HASH_SHIFT 16
+
+/*
+ * Re-referenced clean buffers move from BUF_CLEAN to BUF_HOT, and
+ * refill_freelist() leaves BUF_HOT alone while there is anything else to
+ * take.  A block has to be used again at least HOT_DELAY after it was
+ * last released to count as re-referenced, so that several reads of the
+ * same block in a row during a sequential scan don't promote it.
+ * BUF_HOT may hold at most HOT_RATIO/4 of the clean buffers; beyond
+ * that its oldest buffers go back to BUF_CLEAN.
+ */
+#define HOT_DELAY (HZ/2)
+#define HOT_RATIO 3
+
+/*
+ * Per-device getblk() hit and miss counts, for /proc/bufferinfo.
+ * Devices that don't fit in the table are counted in the last slot.
+ */
+#define NR_DEV_STATS 32
+
+static struct buffer_dev_stats {
+	dev_t dev;
+	unsigned long hits, misses;
+	unsigned long written, writes;	/* buffers, and contiguous runs */
+} dev_stats[NR_DEV_STATS+1];
+/* Write-back statistics */
+static unsigned long wb_batches = 0, wb_clustered = 0, wb_throttled = 0;
 struct buffer_head ** buffer_pages;
 static struct buffer_head * lru_list[NR_LIST] = {NULL, };
 static struct buffer_head * free_list[NR_SIZES] = {NULL, };
@@ -60,8 +89,10 @@ extern int *blksize_size[];
 
 /* Here is the parameter block for the bdflush process. */
 static void wakeup_bdflush(int);
+static int bdflush_running = 0;
+static struct task_struct * bdflush_tsk = NULL;
 
-#define N_PARAM 9
+#define N_PARAM 10
 #define LAV
 
 static union bdflush_param{
@@ -85,9 +116,11 @@ static union bdflush_param{
 		int lav_ratio;  /* Used to determine how low a lav for a
 				   particular size can go before we start to
 				   trim back the buffers */
+		int nfract_sync; /* Percentage of buffer cache dirty at which
+				    processes getting buffers wait for bdflush */
 	} b_un;
 	unsigned int data[N_PARAM];
-} bdf_prm = {{25, 500, 64, 256, 15, 3000, 500, 1884, 2}};
+} bdf_prm = {{25, 500, 64, 256, 15, 3000, 500, 1884, 2, 60}};
 
 /* The lav constant is set for 1 minute, as long as the update process runs
    every 5 seconds.  If you change the frequency of update, the time
@@ -95,8 +128,8 @@ static union bdflush_param{
 
 
 /* These are the min and max parameter values that we will allow to be assigned */
-static int bdflush_min[N_PARAM] = {  0,  10,    5,   25,  0,   100,   100, 1, 1};
-static int bdflush_max[N_PARAM] = {100,5000, 2000, 2000,100, 60000, 60000, 2047, 5};
+static int bdflush_min[N_PARAM] = {  0,  10,    5,   25,  0,   100,   100, 1, 1,   0};
+static int bdflush_max[N_PARAM] = {100,5000, 2000, 2000,100, 60000, 60000, 2047, 5, 100};
 
 /*
  * Rewrote the wait-routines to use the "new" wait-queue functionality,
@@ -273,7 +306,16 @@ void invalidate_buffers(dev_t dev)
 	}
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%nr_hash)
+/*
+ * Multiplicative (Fibonacci) hashing: the device goes into the high
+ * half so that the same block number on different devices doesn't
+ * collide, and the top bits of the 32-bit product are used as the
+ * index.  The arithmetic is done in __u32 so that a 64-bit long
+ * doesn't keep bits above the table size.
+ */
+#define _hashfn(dev,block) \
+	(((__u32) (((__u32) (dev) << 16) ^ (__u32) (block)) * 0x9e370001U) \
+	 >> (32 - hash_shift))
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
 static inline void remove_from_hash_queue(struct buffer_head * bh)
@@ -426,6 +468,93 @@ static struct buffer_head * find_buffer(dev_t dev, int block, int size)
 	return NULL;
 }
 
+/*
+ * Double the hash table once there are more than two buffers per chain
+ * on average.  vmalloc() may sleep, so the buffers are rehashed only
+ * once the new table is there; interrupts never look at the hash
+ * queues, so nothing else needs to be held off while we do it.
+ */
+static void grow_hash_table(void)
+{
+	struct buffer_head ** old_table, * bh, * next;
+	struct buffer_head ** new_table;
+	int old_nr, i;
+
+	if (hash_resizing || hash_shift >= MAX_HASH_SHIFT)
+		return;
+	hash_resizing = 1;
+	new_table = (struct buffer_head **)
+		vmalloc((nr_hash << 1) * sizeof(struct buffer_head *));
+	if (!new_table) {
+		hash_resizing = 0;
+		return;
+	}
+	memset(new_table, 0, (nr_hash << 1) * sizeof(struct buffer_head *));
+
+	old_table = hash_table;
+	old_nr = nr_hash;
+	hash_table = new_table;
+	nr_hash <<= 1;
+	hash_shift++;
+	for (i = 0 ; i < old_nr ; i++) {
+		for (bh = old_table[i] ; bh ; bh = next) {
+			next = bh->b_next;
+			bh->b_prev = NULL;
+			bh->b_next = hash(bh->b_dev,bh->b_blocknr);
+			if (bh->b_next)
+				bh->b_next->b_prev = bh;
+			hash(bh->b_dev,bh->b_blocknr) = bh;
+		}
+	}
+	vfree(old_table);
+	hash_resizing = 0;
+}
+
+static struct buffer_dev_stats * find_dev_stats(dev_t dev)
+{
+	int i, n;
+
+	i = ((dev * 0x9e370001UL) >> 27) & (NR_DEV_STATS-1);
+	for (n = 0 ; n < NR_DEV_STATS ; n++, i = (i+1) & (NR_DEV_STATS-1)) {
+		if (dev_stats[i].dev == dev)
+			return dev_stats + i;
+		if (!dev_stats[i].dev) {
+			dev_stats[i].dev = dev;
+			return dev_stats + i;
+		}
+	}
+	return dev_stats + NR_DEV_STATS;
+}
+
+/*
+ * A clean buffer has been looked up again: promote it to BUF_HOT if
+ * it's been a while since it was last used, otherwise just move it to
+ * the end of its list.
+ */
+static void touch_buffer(struct buffer_head * bh)
+{
+	int hot_max;
+
+	if (bh->b_list != BUF_CLEAN || bh->b_lock ||
+	    jiffies - bh->b_lru_time < HOT_DELAY) {
+		put_last_lru(bh);
+		return;
+	}
+	remove_from_queues(bh);
+	bh->b_list = BUF_HOT;
+	insert_into_queues(bh);
+	bh->b_lru_time = jiffies;
+
+	hot_max = (nr_buffers_type[BUF_CLEAN] + nr_buffers_type[BUF_HOT])
+		* HOT_RATIO / 4;
+	while (nr_buffers_type[BUF_HOT] > hot_max) {
+		struct buffer_head * old = lru_list[BUF_HOT];
+		remove_from_queues(old);
+		old->b_list = BUF_CLEAN;
+		insert_into_queues(old);
+	}
+}
+
 /*
  * Why like this, I hear you say... The reason is race-conditions.
  * As we don't lock buffers (unless we are reading them, that is),
@@ -591,12 +720,15 @@ repeat0:
 	
 	winner = best_time = UINT_MAX;	
 	for(i=0; i<NR_LIST; i++){
-		if(!candidate[i]) continue;
+		if(!candidate[i] || i == BUF_HOT) continue;
 		if(candidate[i]->b_lru_time < best_time){
 			best_time = candidate[i]->b_lru_time;
 			winner = i;
 		}
 	}
+	/* Only take re-referenced buffers when there is nothing else */
+	if(winner == UINT_MAX && candidate[BUF_HOT])
+		winner = BUF_HOT;
 	
 	/* If we have a winner, use it, and then get a new candidate from that list */
 	if(winner != UINT_MAX) {
@@ -701,8 +833,9 @@ struct buffer_head * getblk(dev_t dev, int block, int size)
 repeat:
 	bh = get_hash_table(dev, block, size);
 	if (bh) {
+		find_dev_stats(dev)->hits++;
 		if (bh->b_uptodate && !bh->b_dirt)
-			 put_last_lru(bh);
+			 touch_buffer(bh);
 		if(!bh->b_dirt) bh->b_flushtime = 0;
 		return bh;
 	}
@@ -712,6 +845,15 @@ repeat:
 	if (find_buffer(dev,block,size))
 		 goto repeat;
 
+	if (nr_buffers > (nr_hash << 1)) {
+		grow_hash_table();
+		if (find_buffer(dev,block,size))
+			goto repeat;
+		if (!free_list[isize])
+			goto repeat;
+	}
+	find_dev_stats(dev)->misses++;
+
 	bh = free_list[isize];
 	remove_from_free_list(bh);
 
@@ -756,9 +898,11 @@ void refile_buffer(struct buffer_head * buf){
 		dispose = BUF_LOCKED;
 	else if (buf->b_list == BUF_SHARED)
 		dispose = BUF_UNSHARED;
+	else if (buf->b_list == BUF_HOT)
+		dispose = BUF_HOT;
 	else
 		dispose = BUF_CLEAN;
-	if(dispose == BUF_CLEAN) buf->b_lru_time = jiffies;
+	if(dispose == BUF_CLEAN || dispose == BUF_HOT) buf->b_lru_time = jiffies;
 	if(dispose != buf->b_list)  {
 		if(dispose == BUF_DIRTY || dispose == BUF_UNSHARED)
 			 buf->b_lru_time = jiffies;
@@ -775,6 +919,22 @@ void refile_buffer(struct buffer_head * buf){
 	}
 }
 
+/*
+ * Called by mark_buffer_dirty() when a buffer goes onto the dirty list.
+ * Once more than nfract_sync percent of the cache is dirty, the writer
+ * waits for a bdflush round, so that it can't dirty buffers faster than
+ * they are written back.  Readers never get here.
+ */
+void balance_dirty(void)
+{
+	if (bdflush_running && current != bdflush_tsk && !intr_count &&
+	    nr_buffers_type[BUF_DIRTY] > (nr_buffers - nr_buffers_type[BUF_SHARED]) *
+	    bdf_prm.b_un.nfract_sync/100) {
+		wb_throttled++;
+		wakeup_bdflush(1);
+	}
+}
+
 void brelse(struct buffer_head * buf)
 {
 	if (!buf)
@@ -878,6 +1038,70 @@ struct buffer_head * breada(dev_t dev, int block, int bufsize,
 	return NULL;
 }
 
+/*
+ * Read-ahead for regular file reads.  Every open file keeps a window
+ * that follows the reader:
+ *  - f_ra_next is where a read continuing the last one would start,
+ *  - f_ra_end is the end of what has been read ahead so far,
+ *  - f_ra_window is how far ahead of the reader to keep reading.
+ * A read that continues where the last one stopped (or inside its last,
+ * partially read block) doubles the window, starting from the device's
+ * read_ahead[] setting and up to RA_MAX blocks.  Any other read closes
+ * the window, and whatever was read ahead and not used is counted as
+ * wasted.
+ *
+ * The filesystem passes the first block and the number of blocks the
+ * read needs, and the file size in blocks.  It gets back the number of
+ * blocks to look up, starting at "block"; the extra ones are requested
+ * together with the ones needed and are simply released again.
+ */
+#define RA_MAX NBUF
+
+static unsigned long ra_blocks = 0;	/* blocks read ahead */
+static unsigned long ra_hits = 0;	/* ... that were used */
+static unsigned long ra_wasted = 0;	/* ... that were skipped over */
+static unsigned long ra_sequential = 0, ra_random = 0;
+
+int file_readahead(struct file * filp, unsigned long block, int blocks,
+	unsigned long size, int initial)
+{
+	unsigned long end = block + blocks;
+	unsigned long ra_end;
+	int window = filp->f_ra_window;
+
+	if (window < 0 || window > RA_MAX)
+		window = 0;
+	if (filp->f_ra_end < filp->f_ra_next)
+		filp->f_ra_end = filp->f_ra_next;
+	if (block == filp->f_ra_next || block + 1 == filp->f_ra_next) {
+		ra_sequential++;
+		ra_hits += (end < filp->f_ra_end ? end : filp->f_ra_end) -
+			filp->f_ra_next;
+		if (initial < 1)
+			initial = 1;
+		window = window ? window << 1 : initial;
+		if (window > RA_MAX)
+			window = RA_MAX;
+		ra_end = filp->f_ra_end;
+	} else {
+		ra_random++;
+		ra_wasted += filp->f_ra_end - filp->f_ra_next;
+		window = 0;
+		ra_end = end;
+	}
+	if (ra_end < end)
+		ra_end = end;
+
+	filp->f_ra_window = window;
+	filp->f_ra_next = end;
+	if (end + window > size)
+		window = size > end ? size - end : 0;
+	filp->f_ra_end = end + window;
+	if (filp->f_ra_end > ra_end)
+		ra_blocks += filp->f_ra_end - ra_end;
+	return filp->f_ra_end - block;
+}
+
 /*
  * See fs/inode.c for the weird use of volatile..
  */
@@ -1423,7 +1647,7 @@ void show_buffers(void)
 	printk("Buffer[%d] mem: %d buffers, %d used (last=%d), %d locked, %d dirty %d shrd\n",
 		nlist, found, used, lastused, locked, dirty, shared);
 	};
-	printk("Size    [LAV]     Free  Clean  Unshar     Lck    Lck1   Dirty  Shared\n");
+	printk("Size    [LAV]     Free  Clean  Unshar     Lck    Lck1   Dirty  Shared     Hot\n");
 	for(isize = 0; isize<NR_SIZES; isize++){
 		printk("%5d [%5d]: %7d ", bufferindex_size[isize],
 		       buffers_lav[isize], nr_free[isize]);
@@ -1434,6 +1658,43 @@ void show_buffers(void)
 }
 
 
+/*
+ * /proc/bufferinfo: hash table size, buffers per list and the getblk()
+ * hit/miss counts per device.
+ */
+int get_bufferinfo(char * buffer)
+{
+	static const char * list_name[NR_LIST] = {
+		"clean", "unshared", "locked", "locked1", "dirty", "shared", "hot"
+	};
+	int len, i;
+
+	len = sprintf(buffer, "hash: %d chains, %d buffers\n", nr_hash, nr_buffers);
+	for (i = 0 ; i < NR_LIST ; i++)
+		len += sprintf(buffer+len, "%-9s %7d\n", list_name[i], nr_buffers_type[i]);
+	len += sprintf(buffer+len, "\nreadahead: %lu sequential, %lu random reads, "
+		"%lu blocks read ahead, %lu used, %lu wasted\n",
+		ra_sequential, ra_random, ra_blocks, ra_hits, ra_wasted);
+	len += sprintf(buffer+len, "writeback: %lu batches, %lu buffers clustered, "
+		"%lu writers throttled\n", wb_batches, wb_clustered, wb_throttled);
+	len += sprintf(buffer+len, "\ndevice        hits     misses    written     writes\n");
+	for (i = 0 ; i <= NR_DEV_STATS ; i++) {
+		if (!dev_stats[i].hits && !dev_stats[i].misses &&
+		    !dev_stats[i].written)
+			continue;
+		if (i == NR_DEV_STATS)
+			len += sprintf(buffer+len, "other  ");
+		else
+			len += sprintf(buffer+len, "%3d/%-3d", MAJOR(dev_stats[i].dev),
+				MINOR(dev_stats[i].dev));
+		len += sprintf(buffer+len, " %10lu %10lu %10lu %10lu\n",
+			dev_stats[i].hits, dev_stats[i].misses,
+			dev_stats[i].written, dev_stats[i].writes);
+	}
+	return len;
+}
+
+
 /* ====================== Cluster patches for ext2 ==================== */
 
 /*
@@ -1618,14 +1879,16 @@ void buffer_init(void)
 	int i;
         int isize = BUFSIZE_INDEX(BLOCK_SIZE);
 
+	/* A starting size only: getblk() grows it as the cache grows */
 	if (high_memory >= 4*1024*1024) {
 		if(high_memory >= 16*1024*1024)
-			 nr_hash = 16381;
+			 hash_shift = 14;
 		else
-			 nr_hash = 4093;
+			 hash_shift = 12;
 	} else {
-		nr_hash = 997;
+		hash_shift = 10;
 	};
+	nr_hash = 1 << hash_shift;
 	
 	hash_table = (struct buffer_head **) vmalloc(nr_hash * 
 						     sizeof(struct buffer_head *));
@@ -1658,8 +1921,6 @@ void buffer_init(void)
 struct wait_queue * bdflush_wait = NULL;
 struct wait_queue * bdflush_done = NULL;
 
-static int bdflush_running = 0;
-
 static void wakeup_bdflush(int wait)
 {
 	if(!bdflush_running){
@@ -1673,6 +1934,133 @@ static void wakeup_bdflush(int wait)
 
 
 
+/*
+ * Write-back of dirty buffers.  Rather than handing the buffers to the
+ * driver one at a time in LRU order, up to WB_BATCH of them are gathered
+ * off the dirty list, sorted by device and block number and passed down
+ * in one ll_rw_block() call per device.  The device stays plugged while
+ * the requests are queued, so the elevator sees them in disk order and
+ * merges neighbours into large requests.  Each buffer picked also pulls
+ * in the dirty buffers right after it on disk, old enough or not, so
+ * that a file written in pieces goes out in one sweep.
+ */
+#define WB_BATCH	64
+#define WB_CLUSTER	16
+
+static inline int in_batch(struct buffer_head ** batch, int n,
+	struct buffer_head * bh)
+{
+	while (n-- > 0)
+		if (batch[n] == bh)
+			return 1;
+	return 0;
+}
+
+/*
+ * Pick up to "max" dirty buffers, oldest first.  "old" restricts the
+ * choice to buffers whose flush time has come (their neighbours go
+ * along anyway).  The buffers are returned with their counts raised.
+ *
+ * The scan carries on from *pos, with *left buffers of the list still
+ * to look at, so that a pass over the list costs no more than one scan
+ * however many batches it takes.  We may have slept since the last
+ * batch: if *pos has left the dirty list, start again at its head.
+ */
+static int gather_dirty(struct buffer_head ** batch, int max, int old,
+	struct buffer_head ** pos, int * left)
+{
+	struct buffer_head * bh, * next, * nbh;
+	int k, n = 0;
+
+	bh = *pos;
+	if (!bh || bh->b_list != BUF_DIRTY)
+		bh = lru_list[BUF_DIRTY];
+	for ( ; bh && *left > 0 && n < max; bh = next) {
+		if (bh->b_list != BUF_DIRTY)
+			break;
+		next = bh->b_next_free;
+		(*left)--;
+
+		/* Clean buffer on dirty list?  Refile it */
+		if (!bh->b_dirt && !bh->b_lock) {
+			refile_buffer(bh);
+			continue;
+		}
+		if (bh->b_lock || !bh->b_dirt)
+			continue;
+		if (old && bh->b_flushtime > jiffies)
+			continue;
+		if (in_batch(batch, n, bh))
+			continue;
+		bh->b_count++;
+		batch[n++] = bh;
+		for (k = 1; k < WB_CLUSTER && n < max; k++) {
+			nbh = find_buffer(bh->b_dev, bh->b_blocknr + k, bh->b_size);
+			if (!nbh || nbh->b_list != BUF_DIRTY || nbh->b_lock ||
+			    !nbh->b_dirt || in_batch(batch, n, nbh))
+				break;
+			nbh->b_count++;
+			batch[n++] = nbh;
+			wb_clustered++;
+		}
+	}
+	*pos = bh;
+	return n;
+}
+
+static void write_batch(struct buffer_head ** batch, int n)
+{
+	struct buffer_head * bh;
+	struct buffer_dev_stats * stats;
+	int i, j;
+
+	/* Few enough for an insertion sort */
+	for (i = 1; i < n; i++) {
+		bh = batch[i];
+		for (j = i; j > 0 && (batch[j-1]->b_dev > bh->b_dev ||
+		     (batch[j-1]->b_dev == bh->b_dev &&
+		      batch[j-1]->b_blocknr > bh->b_blocknr)); j--)
+			batch[j] = batch[j-1];
+		batch[j] = bh;
+	}
+	for (i = 0; i < n; i++)
+		batch[i]->b_flushtime = 0;
+	for (i = 0; i < n; i = j) {
+		stats = find_dev_stats(batch[i]->b_dev);
+		stats->writes++;
+		for (j = i + 1; j < n && batch[j]->b_dev == batch[i]->b_dev &&
+		     batch[j]->b_size == batch[i]->b_size; j++)
+			if (batch[j]->b_blocknr != batch[j-1]->b_blocknr + 1)
+				stats->writes++;
+		stats->written += j - i;
+		ll_rw_block(WRITE, j - i, batch + i);
+	}
+	for (i = 0; i < n; i++)
+		batch[i]->b_count--;
+	wb_batches++;
+}
+
+/*
+ * Write back at most "nr" dirty buffers, only those due if "old" is set.
+ * Returns the number written.
+ */
+static int write_dirty_buffers(int nr, int old)
+{
+	struct buffer_head * batch[WB_BATCH], * pos = NULL;
+	int n, left, written = 0;
+
+	left = nr_buffers_type[BUF_DIRTY];
+	while (written < nr) {
+		n = gather_dirty(batch, nr - written < WB_BATCH ?
+				 nr - written : WB_BATCH, old, &pos, &left);
+		if (!n)
+			break;
+		write_batch(batch, n);
+		written += n;
+	}
+	return written;
+}
+
 /* 
  * Here we attempt to write back old buffers.  We also try and flush inodes 
  * and supers as well, since this function is essentially "update", and 
@@ -1683,62 +2071,13 @@ static void wakeup_bdflush(int wait)
 
 asmlinkage int sync_old_buffers(void)
 {
-	int i, isize;
-	int ndirty, nwritten;
-	int nlist;
-	int ncount;
-	struct buffer_head * bh, *next;
+	int isize;
 
 	sync_supers(0);
 	sync_inodes(0);
 
-	ncount = 0;
-#ifdef DEBUG
-	for(nlist = 0; nlist < NR_LIST; nlist++)
-#else
-	for(nlist = BUF_DIRTY; nlist <= BUF_DIRTY; nlist++)
-#endif
-	{
-		ndirty = 0;
-		nwritten = 0;
-	repeat:
-		bh = lru_list[nlist];
-		if(bh) 
-			 for (i = nr_buffers_type[nlist]; i-- > 0; bh = next) {
-				 /* We may have stalled while waiting for I/O to complete. */
-				 if(bh->b_list != nlist) goto repeat;
-				 next = bh->b_next_free;
-				 if(!lru_list[nlist]) {
-					 printk("Dirty list empty %d\n", i);
-					 break;
-				 }
-				 
-				 /* Clean buffer on dirty list?  Refile it */
-				 if (nlist == BUF_DIRTY && !bh->b_dirt && !bh->b_lock)
-				  {
-					  refile_buffer(bh);
-					  continue;
-				  }
-				 
-				 if (bh->b_lock || !bh->b_dirt)
-					  continue;
-				 ndirty++;
-				 if(bh->b_flushtime > jiffies) continue;
-				 nwritten++;
-				 bh->b_count++;
-				 bh->b_flushtime = 0;
-#ifdef DEBUG
-				 if(nlist != BUF_DIRTY) ncount++;
-#endif
-				 ll_rw_block(WRITE, 1, &bh);
-				 bh->b_count--;
-			 }
-	}
-#ifdef DEBUG
-	if (ncount) printk("sync_old_buffers: %d dirty buffers not on dirty list\n", ncount);
-	printk("Wrote %d/%d buffers\n", nwritten, ndirty);
-#endif
-	
+	write_dirty_buffers(nr_buffers, 1);
+
 	/* We assume that we only come through here on a regular
 	   schedule, like every 5 seconds.  Now update load averages.  
 	   Shift usage counts to prevent overflow. */
@@ -1760,9 +2099,6 @@ asmlinkage int sys_bdflush(int func, long data)
 {
 	int i, error;
 	int ndirty;
-	int nlist;
-	int ncount;
-	struct buffer_head * bh, *next;
 
 	if (!suser())
 		return -EPERM;
@@ -1791,6 +2127,7 @@ asmlinkage int sys_bdflush(int func, long data)
 	if (bdflush_running)
 		return -EBUSY; /* Only one copy of this running at one time */
 	bdflush_running++;
+	bdflush_tsk = current;
 	
 	/* OK, from here on is the daemon */
 	
@@ -1799,61 +2136,21 @@ asmlinkage int sys_bdflush(int func, long data)
 		printk("bdflush() activated...");
 #endif
 		
-		ncount = 0;
-#ifdef DEBUG
-		for(nlist = 0; nlist < NR_LIST; nlist++)
-#else
-		for(nlist = BUF_DIRTY; nlist <= BUF_DIRTY; nlist++)
-#endif
-		 {
-			 ndirty = 0;
-		 repeat:
-			 bh = lru_list[nlist];
-			 if(bh) 
-				  for (i = nr_buffers_type[nlist]; i-- > 0 && ndirty < bdf_prm.b_un.ndirty; 
-				       bh = next) {
-					  /* We may have stalled while waiting for I/O to complete. */
-					  if(bh->b_list != nlist) goto repeat;
-					  next = bh->b_next_free;
-					  if(!lru_list[nlist]) {
-						  printk("Dirty list empty %d\n", i);
-						  break;
-					  }
-					  
-					  /* Clean buffer on dirty list?  Refile it */
-					  if (nlist == BUF_DIRTY && !bh->b_dirt && !bh->b_lock)
-					   {
-						   refile_buffer(bh);
-						   continue;
-					   }
-					  
-					  if (bh->b_lock || !bh->b_dirt)
-						   continue;
-					  /* Should we write back buffers that are shared or not??
-					     currently dirty buffers are not shared, so it does not matter */
-					  bh->b_count++;
-					  ndirty++;
-					  bh->b_flushtime = 0;
-					  ll_rw_block(WRITE, 1, &bh);
-#ifdef DEBUG
-					  if(nlist != BUF_DIRTY) ncount++;
-#endif
-					  bh->b_count--;
-				  }
-		 }
+		ndirty = write_dirty_buffers(bdf_prm.b_un.ndirty, 0);
 #ifdef DEBUG
-		if (ncount) printk("sys_bdflush: %d dirty buffers not on dirty list\n", ncount);
-		printk("sleeping again.\n");
+		printk("wrote %d buffers, sleeping again.\n", ndirty);
 #endif
 		wake_up(&bdflush_done);
 		
 		/* If there are still a lot of dirty buffers around, skip the sleep
-		   and flush some more */
+		   and flush some more - unless they are all under I/O already */
 		
-		if(nr_buffers_type[BUF_DIRTY] <= (nr_buffers - nr_buffers_type[BUF_SHARED]) * 
+		if(!ndirty ||
+		   nr_buffers_type[BUF_DIRTY] <= (nr_buffers - nr_buffers_type[BUF_SHARED]) * 
 		   bdf_prm.b_un.nfract/100) {
 		   	if (current->signal & (1 << (SIGKILL-1))) {
 				bdflush_running--;
+				bdflush_tsk = NULL;
 		   		return 0;
 			}
 		   	current->signal = 0;
@@ -15,131 +15,166 @@
  *
  * There is a global hash-table over both caches that hashes the entries
  * based on the directory inode number and device as well as on a
- * string-hash computed over the name. 
+ * string-hash computed over the name.
+ *
+ * Entries are allocated as needed, up to dcache_max of them (set from
+ * the memory size, or with "dcache=" at boot), and given back when
+ * memory gets tight.  The second level gets at most half of them.  An
+ * entry with a zero inode number records that the name doesn't exist.
  */
 
 #include <stddef.h>
 
 #include <linux/fs.h>
 #include <linux/string.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/malloc.h>
+#include <linux/slab.h>
 
 /*
- * Don't bother caching long names.. They just take up space in the cache, and
- * for a name cache you just want to cache the "normal" names anyway which tend
- * to be short.
+ * Names up to DCACHE_INLINE_LEN chars are kept in the entry itself,
+ * longer ones get a buffer of their own.
  */
-#define DCACHE_NAME_LEN	15
-#define DCACHE_SIZE 128
+#define DCACHE_NAME_LEN	NAME_MAX
+#define DCACHE_INLINE_LEN 20
 
-struct hash_list {
-	struct dir_cache_entry * next;
-	struct dir_cache_entry * prev;
-};
+#define DCACHE_MIN	256
+#define MAX_HASH_SHIFT	14
 
-/*
- * The dir_cache_entry must be in this order: we do ugly things with the pointers
- */
 struct dir_cache_entry {
-	struct hash_list h;
+	struct dir_cache_entry * next_lru, * prev_lru;
+	struct dir_cache_entry * next_hash, * prev_hash;
 	unsigned long dev;
 	unsigned long dir;
 	unsigned long version;
 	unsigned long ino;
+	unsigned long hash;
 	unsigned char name_len;
-	char name[DCACHE_NAME_LEN];
-	struct dir_cache_entry ** lru_head;
-	struct dir_cache_entry * next_lru,  * prev_lru;
+	unsigned char level;
+	char * name;
+	char iname[DCACHE_INLINE_LEN];
 };
 
-#define COPYDATA(de, newde) \
-memcpy((void *) &newde->dev, (void *) &de->dev, \
-4*sizeof(unsigned long) + 1 + DCACHE_NAME_LEN)
-
-static struct dir_cache_entry level1_cache[DCACHE_SIZE];
-static struct dir_cache_entry level2_cache[DCACHE_SIZE];
+static kmem_cache_t * dentry_cache = NULL;
 
 /*
- * The LRU-lists are doubly-linked circular lists, and do not change in size
- * so these pointers always have something to point to (after _init)
+ * The LRU-lists are doubly-linked circular lists, with the head itself
+ * on the list.  The heads are entries of their own that are never
+ * hashed, so only the list pointers of them are used.
  */
-static struct dir_cache_entry * level1_head;
-static struct dir_cache_entry * level2_head;
+static struct dir_cache_entry lru_level[2];
+static int nr_level[2] = { 0, 0 };
+static int nr_entries = 0;
+static int dcache_max = 0;
+
+#define lru_head(level) (lru_level + (level))
 
 /*
- * The hash-queues are also doubly-linked circular lists, but the head is
- * itself on the doubly-linked list, not just a pointer to the first entry.
+ * The hash-queues are NULL-terminated, the first entry having a NULL
+ * prev_hash.
  */
-#define DCACHE_HASH_QUEUES 19
-#define hash_fn(dev,dir,namehash) (((dev) ^ (dir) ^ (namehash)) % DCACHE_HASH_QUEUES)
+static struct dir_cache_entry ** hash_table = NULL;
+static int nr_hash = 0;
+static int hash_shift = 0;
 
-static struct hash_list hash_table[DCACHE_HASH_QUEUES];
+#define hash_fn(dev,dir,namehash) \
+	(((__u32) ((__u32) (dev) << 16 ^ (__u32) (dir) ^ (__u32) (namehash)) \
+	  * 0x9e370001U) >> (32 - hash_shift))
+#define hash(dev,dir,namehash) hash_table[hash_fn(dev,dir,namehash)]
+
+/* statistics */
+static unsigned long dcache_lookups = 0;
+static unsigned long dcache_hits = 0;
+static unsigned long dcache_neg_hits = 0;
+static unsigned long dcache_adds = 0;
+static unsigned long dcache_long = 0;
+static unsigned long dcache_recycled = 0;
+static unsigned long dcache_reclaimed = 0;
 
 static inline void remove_lru(struct dir_cache_entry * de)
 {
 	de->next_lru->prev_lru = de->prev_lru;
 	de->prev_lru->next_lru = de->next_lru;
+	nr_level[de->level]--;
 }
 
-static inline void add_lru(struct dir_cache_entry * de, struct dir_cache_entry *head)
+/*
+ * Adds "de" at the tail (the most recently used end) of a level
+ */
+static inline void add_lru(struct dir_cache_entry * de, int level)
 {
+	struct dir_cache_entry * head = lru_head(level);
+
 	de->next_lru = head;
 	de->prev_lru = head->prev_lru;
 	de->prev_lru->next_lru = de;
 	head->prev_lru = de;
+	de->level = level;
+	nr_level[level]++;
 }
 
 static inline void update_lru(struct dir_cache_entry * de)
 {
-	if (de == *de->lru_head)
-		*de->lru_head = de->next_lru;
-	else {
-		remove_lru(de);
-		add_lru(de,*de->lru_head);
-	}
+	int level = de->level;
+
+	remove_lru(de);
+	add_lru(de, level);
 }
 
-/*
- * Stupid name"hash" algorithm. Write something better if you want to,
- * but I doubt it matters that much
- */
 static inline unsigned long namehash(const char * name, int len)
 {
-	return len * *(unsigned char *) name;
+	unsigned long hash = 0;
+	unsigned char c;
+
+	while (len--) {
+		c = *name++;
+		hash = (hash + (c << 4) + (c >> 4)) * 11;
+	}
+	return hash;
 }
 
 /*
- * Hash queue manipulation. Look out for the casts..
+ * Hash queue manipulation.
  */
 static inline void remove_hash(struct dir_cache_entry * de)
 {
-	if (de->h.next) {
-		de->h.next->h.prev = de->h.prev;
-		de->h.prev->h.next = de->h.next;
-		de->h.next = NULL;
-	}
+	if (de->next_hash)
+		de->next_hash->prev_hash = de->prev_hash;
+	if (de->prev_hash)
+		de->prev_hash->next_hash = de->next_hash;
+	else
+		hash(de->dev, de->dir, de->hash) = de->next_hash;
+	de->next_hash = de->prev_hash = NULL;
 }
 
-static inline void add_hash(struct dir_cache_entry * de, struct hash_list * hash)
+static inline void add_hash(struct dir_cache_entry * de)
 {
-	de->h.next = hash->next;
-	de->h.prev = (struct dir_cache_entry *) hash;
-	hash->next->h.prev = de;
-	hash->next = de;
+	struct dir_cache_entry ** head = &hash(de->dev, de->dir, de->hash);
+
+	de->prev_hash = NULL;
+	de->next_hash = *head;
+	if (de->next_hash)
+		de->next_hash->prev_hash = de;
+	*head = de;
 }
 
 /*
  * Find a directory cache entry given all the necessary info.
  */
-static struct dir_cache_entry * find_entry(struct inode * dir, const char * name, int len, struct hash_list * hash)
+static struct dir_cache_entry * find_entry(struct inode * dir, const char * name,
+	int len, unsigned long namehash, unsigned long version)
 {
-	struct dir_cache_entry * de = hash->next;
+	struct dir_cache_entry * de;
 
-	for (de = hash->next ; de != (struct dir_cache_entry *) hash ; de = de->h.next) {
+	for (de = hash(dir->i_dev, dir->i_ino, namehash) ; de ; de = de->next_hash) {
+		if (de->hash != namehash)
+			continue;
 		if (de->dev != dir->i_dev)
 			continue;
 		if (de->dir != dir->i_ino)
 			continue;
-		if (de->version != dir->i_version)
+		if (de->version != version)
 			continue;
 		if (de->name_len != len)
 			continue;
@@ -150,104 +185,190 @@ static struct dir_cache_entry * find_entry(struct inode * dir, const char * name
 	return NULL;
 }
 
+static void free_entry(struct dir_cache_entry * de)
+{
+	remove_hash(de);
+	remove_lru(de);
+	nr_entries--;
+	if (de->name != de->iname)
+		kfree_s(de->name, de->name_len);
+	kmem_cache_free(dentry_cache, de);
+}
+
+/*
+ * The least recently used entry, from level1 if it has any
+ */
+static inline struct dir_cache_entry * lru_entry(void)
+{
+	if (nr_level[0])
+		return lru_head(0)->next_lru;
+	if (nr_level[1])
+		return lru_head(1)->next_lru;
+	return NULL;
+}
+
 /*
  * Move a successfully used entry to level2. If already at level2,
- * move it to the end of the LRU queue..
+ * move it to the end of the LRU queue..  A full level2 hands its
+ * least recently used entry back to level1.
  */
-static inline void move_to_level2(struct dir_cache_entry * old_de, struct hash_list * hash)
+static inline void move_to_level2(struct dir_cache_entry * de)
 {
-	struct dir_cache_entry * de;
+	struct dir_cache_entry * old_de;
 
-	if (old_de->lru_head == &level2_head) {
-		update_lru(old_de);
+	if (de->level) {
+		update_lru(de);
 		return;
-	}	
-	de = level2_head;
-	level2_head = de->next_lru;
-	remove_hash(de);
-	COPYDATA(old_de, de);
-	add_hash(de, hash);
+	}
+	remove_lru(de);
+	if (nr_level[1] >= dcache_max / 2) {
+		old_de = lru_head(1)->next_lru;
+		remove_lru(old_de);
+		add_lru(old_de, 0);
+	}
+	add_lru(de, 1);
 }
 
 int dcache_lookup(struct inode * dir, const char * name, int len, unsigned long * ino)
 {
-	struct hash_list * hash;
 	struct dir_cache_entry *de;
 
-	if (len > DCACHE_NAME_LEN)
+	if (len > DCACHE_NAME_LEN || !hash_table)
 		return 0;
-	hash = hash_table + hash_fn(dir->i_dev, dir->i_ino, namehash(name,len));
-	de = find_entry(dir, name, len, hash);
+	dcache_lookups++;
+	de = find_entry(dir, name, len, namehash(name,len), dir->i_version);
 	if (!de)
 		return 0;
 	*ino = de->ino;
-	move_to_level2(de, hash);
+	if (de->ino)
+		dcache_hits++;
+	else
+		dcache_neg_hits++;
+	move_to_level2(de);
 	return 1;
 }
 
+/*
+ * Note that dcache_add() is called from readdir() with pointers into
+ * buffers held, so it must not sleep: memory is only taken when it can
+ * be had without freeing any, and otherwise the least recently used
+ * entry is recycled.
+ */
 void dcache_add(struct inode * dir, const char * name, int len, unsigned long ino)
 {
-	struct hash_list * hash;
 	struct dir_cache_entry *de;
+	unsigned long hash;
+	char * long_name = NULL;
 
-	if (len > DCACHE_NAME_LEN)
+	if (len > DCACHE_NAME_LEN || !hash_table)
 		return;
-	hash = hash_table + hash_fn(dir->i_dev, dir->i_ino, namehash(name,len));
-	if ((de = find_entry(dir, name, len, hash)) != NULL) {
+	hash = namehash(name,len);
+	if ((de = find_entry(dir, name, len, hash, dir->i_version)) != NULL) {
 		de->ino = ino;
 		update_lru(de);
 		return;
 	}
-	de = level1_head;
-	level1_head = de->next_lru;
-	remove_hash(de);
+	if (len > DCACHE_INLINE_LEN) {
+		long_name = kmalloc(len, GFP_BUFFER);
+		if (!long_name)
+			return;
+		dcache_long++;
+	}
+	de = NULL;
+	if (nr_entries < dcache_max)
+		de = kmem_cache_alloc(dentry_cache, GFP_BUFFER);
+	if (de)
+		nr_entries++;
+	else {
+		de = lru_entry();
+		if (!de) {
+			if (long_name)
+				kfree_s(long_name, len);
+			return;
+		}
+		remove_hash(de);
+		remove_lru(de);
+		if (de->name != de->iname)
+			kfree_s(de->name, de->name_len);
+		dcache_recycled++;
+	}
+	dcache_adds++;
 	de->dev = dir->i_dev;
 	de->dir = dir->i_ino;
 	de->version = dir->i_version;
 	de->ino = ino;
+	de->hash = hash;
 	de->name_len = len;
+	de->name = long_name ? long_name : de->iname;
 	memcpy(de->name, name, len);
-	add_hash(de, hash);
+	add_hash(de);
+	add_lru(de, 0);
+}
+
+/*
+ * Give back entries when memory is short: 1/2^priority of them, least
+ * recently used first.  The pages come free through kmem_cache_reap().
+ */
+int shrink_dcache(int priority)
+{
+	struct dir_cache_entry * de;
+	int count, freed = 0;
+
+	count = (nr_entries >> priority) + 1;
+	while (count-- && (de = lru_entry()) != NULL) {
+		free_entry(de);
+		freed++;
+	}
+	dcache_reclaimed += freed;
+	return freed;
 }
 
-unsigned long name_cache_init(unsigned long mem_start, unsigned long mem_end)
+void dcache_setup(char *str, int *ints)
+{
+	if (ints[0] > 0 && ints[1] >= 0)
+		dcache_max = ints[1];
+}
+
+int get_dcacheinfo(char * buffer)
+{
+	return sprintf(buffer,
+		"entries: %d (%d new, %d used), max %d, %d hash chains\n"
+		"lookups: %lu, hits: %lu, negative hits: %lu\n"
+		"added: %lu (%lu long names), recycled: %lu, reclaimed: %lu\n",
+		nr_entries, nr_level[0], nr_level[1], dcache_max, nr_hash,
+		dcache_lookups, dcache_hits, dcache_neg_hits,
+		dcache_adds, dcache_long, dcache_recycled, dcache_reclaimed);
+}
+
+void name_cache_init(void)
 {
 	int i;
-	struct dir_cache_entry * p;
 
 	/*
-	 * Init level1 LRU lists..
+	 * Init the LRU lists..
 	 */
-	p = level1_cache;
-	do {
-		p[1].prev_lru = p;
-		p[0].next_lru = p+1;
-		p[0].lru_head = &level1_head;
-	} while (++p < level1_cache + DCACHE_SIZE-1);
-	level1_cache[0].prev_lru = p;
-	p[0].next_lru = &level1_cache[0];
-	p[0].lru_head = &level1_head;
-	level1_head = level1_cache;
+	for (i = 0 ; i < 2 ; i++)
+		lru_level[i].next_lru = lru_level[i].prev_lru = lru_head(i);
 
 	/*
-	 * Init level2 LRU lists..
+	 * One entry per page of memory unless told otherwise, with a
+	 * hash chain for every two entries.
 	 */
-	p = level2_cache;
-	do {
-		p[1].prev_lru = p;
-		p[0].next_lru = p+1;
-		p[0].lru_head = &level2_head;
-	} while (++p < level2_cache + DCACHE_SIZE-1);
-	level2_cache[0].prev_lru = p;
-	p[0].next_lru = &level2_cache[0];
-	p[0].lru_head = &level2_head;
-	level2_head = level2_cache;
+	if (!dcache_max)
+		dcache_max = MAP_NR(high_memory);
+	if (dcache_max < DCACHE_MIN)
+		dcache_max = DCACHE_MIN;
+	for (hash_shift = 8 ; hash_shift < MAX_HASH_SHIFT ; hash_shift++)
+		if ((2 << hash_shift) >= dcache_max)
+			break;
+	nr_hash = 1 << hash_shift;
 
-	/*
-	 * Empty hash queues..
-	 */
-	for (i = 0 ; i < DCACHE_HASH_QUEUES ; i++)
-		hash_table[i].next = hash_table[i].next =
-			(struct dir_cache_entry *) &hash_table[i];
-	return mem_start;
+	dentry_cache = kmem_cache_create("dentry_cache",
+		sizeof(struct dir_cache_entry), SLAB_HWCACHE_ALIGN, NULL);
+	hash_table = (struct dir_cache_entry **)
+		vmalloc(nr_hash * sizeof(struct dir_cache_entry *));
+	if (!dentry_cache || !hash_table)
+		panic("VFS: Unable to allocate the directory cache");
+	for (i = 0 ; i < nr_hash ; i++)
+		hash_table[i] = NULL;
 }
@@ -205,6 +205,8 @@ static int aout_core_dump(long signr, struct pt_regs * regs)
 	file.f_inode = inode;
 	file.f_pos = 0;
 	file.f_reada = 0;
+	file.f_ra_next = file.f_ra_end = 0;
+	file.f_ra_window = 0;
 	file.f_op = inode->i_op->default_file_ops;
 	if (file.f_op->open)
 		if (file.f_op->open(inode,&file))
@@ -473,6 +475,8 @@ int read_exec(struct inode *inode, unsigned long offset,
 	file.f_inode = inode;
 	file.f_pos = 0;
 	file.f_reada = 0;
+	file.f_ra_next = file.f_ra_end = 0;
+	file.f_ra_window = 0;
 	file.f_op = inode->i_op->default_file_ops;
 	if (file.f_op->open)
 		if (file.f_op->open(inode,&file))
@@ -123,12 +123,8 @@ static int ext_file_read(struct inode * inode, struct file * filp, char * buf, i
 	blocks = (left + offset + BLOCK_SIZE - 1) >> BLOCK_SIZE_BITS;
 	bhb = bhe = buflist;
 	// 预读
-	if (filp->f_reada) {
-	        if(blocks < read_ahead[MAJOR(inode->i_dev)] / (BLOCK_SIZE >> 9))
-		  blocks = read_ahead[MAJOR(inode->i_dev)] / (BLOCK_SIZE >> 9);
-		if (block + blocks > size)
-			blocks = size - block;
-	}
+	blocks = file_readahead(filp, block, blocks, size,
+		read_ahead[MAJOR(inode->i_dev)] / (BLOCK_SIZE >> 9));
 
 	/* We do this in a two stage process.  We first try and request
 	   as many blocks as we can, then we wait for the first one to
@@ -248,10 +248,16 @@ void ext2_free_blocks (struct super_block * sb, unsigned long block,
  * is allocated.  Otherwise a forward search is made for a free block; within 
  * each block group the search first looks for an entire free byte in the block
  * bitmap, and then for any free bit if that fails.
+ *
+ * If prealloc_block is given, up to prealloc_want - 1 blocks following the
+ * one allocated are reserved as well.  A caller wanting more than the
+ * minimum skips the search near the goal, which would mostly find short
+ * holes, and goes straight for a free byte.
  */
 int ext2_new_block (struct super_block * sb, unsigned long goal,
 		    u32 * prealloc_count,
-		    u32 * prealloc_block)
+		    u32 * prealloc_block,
+		    int prealloc_want)
 {
 	struct buffer_head * bh;
 	struct buffer_head * bh2;
@@ -307,7 +313,8 @@ repeat:
 #endif
 			goto got_block;
 		}
-		if (j) {
+		if (j && (!prealloc_block ||
+			  prealloc_want <= EXT2_PREALLOC_MIN)) {
 			/*
 			 * The goal was occupied; search forward for a free 
 			 * block within the next 32 blocks
@@ -426,8 +433,15 @@ got_block:
 	if (prealloc_block) {
 		*prealloc_count = 0;
 		*prealloc_block = tmp + 1;
+		/*
+		 * Don't tie up what's left of a nearly full filesystem
+		 */
+		if (prealloc_want > EXT2_PREALLOC_MIN &&
+		    prealloc_want > (es->s_free_blocks_count >> 6))
+			prealloc_want = EXT2_PREALLOC_MIN;
 		for (k = 1;
-		     k < 8 && (j + k) < EXT2_BLOCKS_PER_GROUP(sb); k++) {
+		     k < prealloc_want && (j + k) < EXT2_BLOCKS_PER_GROUP(sb);
+		     k++) {
 			if (set_bit (j + k, bh->b_data))
 				break;
 			(*prealloc_count)++;
@@ -117,12 +117,8 @@ static int ext2_file_read (struct inode * inode, struct file * filp,
 	size = (size + sb->s_blocksize - 1) >> EXT2_BLOCK_SIZE_BITS(sb);
 	blocks = (left + offset + sb->s_blocksize - 1) >> EXT2_BLOCK_SIZE_BITS(sb);
 	bhb = bhe = buflist;
-	if (filp->f_reada) {
-	        if (blocks < read_ahead[MAJOR(inode->i_dev)] >> (EXT2_BLOCK_SIZE_BITS(sb) - 9))
-	            blocks = read_ahead[MAJOR(inode->i_dev)] >> (EXT2_BLOCK_SIZE_BITS(sb) - 9);
-		if (block + blocks > size)
-			blocks = size - block;
-	}
+	blocks = file_readahead(filp, block, blocks, size,
+		read_ahead[MAJOR(inode->i_dev)] >> (EXT2_BLOCK_SIZE_BITS(sb) - 9));
 
 	/*
 	 * We do this in a two stage process.  We first try and request
@@ -272,6 +268,15 @@ static int ext2_file_write (struct inode * inode, struct file * filp,
 	 */
 	if (filp->f_flags & O_SYNC)
 		inode->u.ext2_i.i_osync++;
+#ifdef EXT2_PREALLOCATE
+	/*
+	 * Let the allocator reserve the blocks of a large write in one
+	 * go rather than a small window at a time
+	 */
+	i = (count + sb->s_blocksize - 1) >> EXT2_BLOCK_SIZE_BITS(sb);
+	inode->u.ext2_i.i_prealloc_want = i < EXT2_PREALLOC_MAX ?
+					  i : EXT2_PREALLOC_MAX;
+#endif
 	written = 0;
 	while (written < count) {
 		if (pos > two_gb) {
@@ -336,6 +341,9 @@ static int ext2_file_write (struct inode * inode, struct file * filp,
 		inode->i_size = pos;
 	if (filp->f_flags & O_SYNC)
 		inode->u.ext2_i.i_osync--;
+#ifdef EXT2_PREALLOCATE
+	inode->u.ext2_i.i_prealloc_want = 0;
+#endif
 	up(&inode->i_sem);
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
 	filp->f_pos = pos;
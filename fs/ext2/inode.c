@@ -79,6 +79,9 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 #endif
 	unsigned long result;
 	struct buffer_head * bh;
+#ifdef EXT2_PREALLOCATE
+	int window;
+#endif
 
 	wait_on_super (inode->i_sb);
 
@@ -106,6 +109,25 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 		mark_buffer_dirty(bh, 1);
 		brelse (bh);
 	} else {
+		/*
+		 * A writer that used up its whole window and carries on
+		 * right after it gets a window twice as big, anybody else
+		 * starts again from the smallest one.  A large write in
+		 * progress asks for its size straight away.
+		 */
+		window = inode->u.ext2_i.i_prealloc_window;
+		if (!inode->u.ext2_i.i_prealloc_count &&
+		    goal == inode->u.ext2_i.i_prealloc_block)
+			window <<= 1;
+		else
+			window = 0;
+		if (window < EXT2_PREALLOC_MIN)
+			window = EXT2_PREALLOC_MIN;
+		if (window > EXT2_PREALLOC_MAX)
+			window = EXT2_PREALLOC_MAX;
+		inode->u.ext2_i.i_prealloc_window = window;
+		if (window < inode->u.ext2_i.i_prealloc_want)
+			window = inode->u.ext2_i.i_prealloc_want;
 		ext2_discard_prealloc (inode);
 		ext2_debug ("preallocation miss (%lu/%lu).\n",
 			    alloc_hits, ++alloc_attempts);
@@ -113,12 +135,13 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 			result = ext2_new_block
 				(inode->i_sb, goal,
 				 &inode->u.ext2_i.i_prealloc_count,
-				 &inode->u.ext2_i.i_prealloc_block);
+				 &inode->u.ext2_i.i_prealloc_block,
+				 window);
 		else
-			result = ext2_new_block (inode->i_sb, goal, 0, 0);
+			result = ext2_new_block (inode->i_sb, goal, 0, 0, 0);
 	}
 #else
-	result = ext2_new_block (inode->i_sb, goal, 0, 0);
+	result = ext2_new_block (inode->i_sb, goal, 0, 0, 0);
 #endif
 
 	return result;
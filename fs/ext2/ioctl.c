@@ -45,6 +45,11 @@ int ext2_ioctl (struct inode * inode, struct file * filp, unsigned int cmd,
 				return -EPERM;
 		if (IS_RDONLY(inode))
 			return -EROFS;
+		/*
+		 * The directory index can be dropped (the blocks stay
+		 * readable as a plain directory), but not turned on
+		 */
+		flags &= ~EXT2_INDEX_FL | inode->u.ext2_i.i_flags;
 		inode->u.ext2_i.i_flags = flags;
 		if (flags & EXT2_APPEND_FL)
 			inode->i_flags |= S_APPEND;
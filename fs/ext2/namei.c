@@ -23,6 +23,7 @@
 #include <linux/stat.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/malloc.h>
 
 /*
  * comment out this line if you want names > EXT2_NAME_LEN chars to be
@@ -57,6 +58,286 @@ static int ext2_match (int len, const char * const name,
 	return !memcmp(name, de->name, len);
 }
 
+/*
+ * Hashed directory index.
+ *
+ * A large directory can carry an index mapping name hashes to the
+ * directory blocks ("leaves") that hold those names, so a lookup only
+ * reads a couple of blocks instead of scanning the whole directory.
+ * The index is kept inside ordinary directory blocks, hidden in space
+ * that the plain directory code skips over:
+ *
+ *  - the root sits in block 0 behind the name of "..", whose entry is
+ *    stretched to cover the rest of the block;
+ *  - interior nodes are blocks holding one unused entry spanning the
+ *    whole block, with the index entries behind its header.
+ *
+ * An indexed directory thus still reads as a plain one, and the linear
+ * code is used whenever the index doesn't look sane.  Leaves are plain
+ * directory blocks, unsorted.  An index entry gives the lowest hash
+ * going to its block; the first entry of a node has no hash, its slot
+ * holds the count and limit of the node instead.  Name hashes are even:
+ * an odd hash in the index means that the block continues the hash of
+ * the block before it, which happens when a leaf full of one hash value
+ * had to be split.
+ *
+ * The index has at most two levels (the root and one level of nodes),
+ * and is created when a directory outgrows its first block on a
+ * filesystem mounted with "index".
+ */
+#define DX_HASH_VERSION		0
+#define DX_MAX_LEVELS		2
+#define DX_ROOT_INFO		24	/* "." and ".." entries */
+#define DX_ROOT_OFFSET		32	/* ... and the root info */
+#define DX_NODE_OFFSET		8	/* an empty entry header */
+
+struct dx_root_info {
+	__u32	reserved_zero;
+	__u8	hash_version;
+	__u8	info_length;		/* sizeof (struct dx_root_info) */
+	__u8	indirect_levels;
+	__u8	unused_flags;
+};
+
+struct dx_entry {
+	__u32	hash;
+	__u32	block;
+};
+
+struct dx_countlimit {
+	__u16	limit;
+	__u16	count;
+};
+
+/*
+ * One level of the path from the root down to a leaf
+ */
+struct dx_frame {
+	struct buffer_head * bh;
+	struct dx_entry * entries;
+	struct dx_entry * at;
+};
+
+/*
+ * Live entries of a leaf being split
+ */
+struct dx_map_entry {
+	__u32	hash;
+	__u16	offs;
+	__u16	size;
+};
+
+#define is_dx(dir)	((dir)->u.ext2_i.i_flags & EXT2_INDEX_FL)
+#define dx_info(data)	((struct dx_root_info *) ((data) + DX_ROOT_INFO))
+#define dx_count(e)	(((struct dx_countlimit *) (e))->count)
+#define dx_limit(e)	(((struct dx_countlimit *) (e))->limit)
+#define dx_root_limit(sb) \
+	(((sb)->s_blocksize - DX_ROOT_OFFSET) / sizeof (struct dx_entry))
+#define dx_node_limit(sb) \
+	(((sb)->s_blocksize - DX_NODE_OFFSET) / sizeof (struct dx_entry))
+
+/*
+ * "." and ".." live in block 0, which isn't a leaf
+ */
+#define dx_dot_name(name, len) \
+	(!(len) || ((name)[0] == '.' && \
+		    ((len) == 1 || ((len) == 2 && (name)[1] == '.'))))
+
+static __u32 dx_hash (const char * name, int len)
+{
+	__u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+	while (len--) {
+		hash = hash1 + (hash0 ^ (*(unsigned char *) name++ * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static struct buffer_head * dx_bread (struct inode * dir, __u32 block)
+{
+	int err;
+
+	if (!block || block >= dir->i_size >> EXT2_BLOCK_SIZE_BITS(dir->i_sb)) {
+		ext2_warning (dir->i_sb, "dx_bread",
+			      "bad block %lu in index of directory #%lu",
+			      (unsigned long) block, dir->i_ino);
+		return NULL;
+	}
+	return ext2_bread (dir, block, 0, &err);
+}
+
+static void dx_release (struct dx_frame * frames)
+{
+	brelse (frames[0].bh);
+	brelse (frames[1].bh);
+}
+
+/*
+ * Walk the index down to the leaf that "hash" belongs to.  Returns the
+ * frame of the lowest index level, its "at" pointing to the leaf, or
+ * NULL if the index can't be read or doesn't look sane.
+ */
+static struct dx_frame * dx_probe (struct inode * dir, __u32 hash,
+				   struct dx_frame * frames)
+{
+	struct super_block * sb = dir->i_sb;
+	struct dx_frame * frame = frames;
+	struct buffer_head * bh;
+	struct dx_root_info * info;
+	struct dx_entry * entries, * p, * q, * m;
+	unsigned int count, levels;
+	int err;
+
+	frames[0].bh = frames[1].bh = NULL;
+	if (!(bh = ext2_bread (dir, 0, 0, &err)))
+		return NULL;
+	frame->bh = bh;
+	info = dx_info (bh->b_data);
+	entries = (struct dx_entry *) (bh->b_data + DX_ROOT_OFFSET);
+	levels = info->indirect_levels;
+	if (info->reserved_zero || info->hash_version != DX_HASH_VERSION ||
+	    info->info_length != sizeof (struct dx_root_info) ||
+	    levels >= DX_MAX_LEVELS || dx_limit (entries) != dx_root_limit (sb))
+		goto bad;
+	while (1) {
+		count = dx_count (entries);
+		if (!count || count > dx_limit (entries))
+			goto bad;
+		p = entries + 1;
+		q = entries + count - 1;
+		while (p <= q) {
+			m = p + (q - p) / 2;
+			if (m->hash > hash)
+				q = m - 1;
+			else
+				p = m + 1;
+		}
+		frame->entries = entries;
+		frame->at = p - 1;
+		if (!levels--)
+			return frame;
+		if (!(bh = dx_bread (dir, frame->at->block)))
+			goto fail;
+		frame++;
+		frame->bh = bh;
+		entries = (struct dx_entry *) (bh->b_data + DX_NODE_OFFSET);
+		if (dx_limit (entries) != dx_node_limit (sb))
+			goto bad;
+	}
+bad:
+	ext2_warning (sb, "dx_probe", "bad index in directory #%lu",
+		      dir->i_ino);
+fail:
+	dx_release (frames);
+	return NULL;
+}
+
+/*
+ * Step "frame" to the next leaf, if that leaf continues "hash".
+ */
+static int dx_next_block (struct inode * dir, __u32 hash,
+			  struct dx_frame * frames, struct dx_frame * frame)
+{
+	struct dx_frame * p = frame;
+	struct buffer_head * bh;
+
+	while (++p->at >= p->entries + dx_count (p->entries)) {
+		if (p == frames)
+			return 0;
+		p--;
+	}
+	if (p->at->hash != (hash | 1))
+		return 0;
+	while (p < frame) {
+		if (!(bh = dx_bread (dir, p->at->block)))
+			return 0;
+		p++;
+		brelse (p->bh);
+		p->bh = bh;
+		p->entries = p->at = (struct dx_entry *)
+			(bh->b_data + DX_NODE_OFFSET);
+		if (dx_limit (p->entries) != dx_node_limit (dir->i_sb) ||
+		    !dx_count (p->entries))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Look for "name" in one directory block.  Returns 1 if found, 0 if not
+ * and -1 if the block is corrupted.
+ */
+static int search_dirblock (struct inode * dir, struct buffer_head * bh,
+			    const char * const name, int namelen,
+			    unsigned long offset,
+			    struct ext2_dir_entry ** res_dir)
+{
+	struct ext2_dir_entry * de;
+	char * dlimit;
+
+	de = (struct ext2_dir_entry *) bh->b_data;
+	dlimit = bh->b_data + dir->i_sb->s_blocksize;
+	while ((char *) de < dlimit) {
+		if (!ext2_check_dir_entry ("ext2_find_entry", dir,
+					   de, bh, offset))
+			return -1;
+		if (de->inode != 0 && ext2_match (namelen, name, de)) {
+			*res_dir = de;
+			return 1;
+		}
+		offset += de->rec_len;
+		de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+	}
+	return 0;
+}
+
+/*
+ * Find "name" through the index.  On failure *err is 0 if the name
+ * isn't there, non-zero if the index couldn't be used.
+ */
+static struct buffer_head * dx_find_entry (struct inode * dir,
+					   const char * const name, int namelen,
+					   struct ext2_dir_entry ** res_dir,
+					   int * err)
+{
+	struct dx_frame frames[DX_MAX_LEVELS], * frame;
+	struct buffer_head * bh;
+	unsigned long block;
+	__u32 hash;
+	int ret;
+
+	*err = -EIO;
+	hash = dx_hash (name, namelen);
+	if (!(frame = dx_probe (dir, hash, frames)))
+		return NULL;
+	while (1) {
+		block = frame->at->block;
+		if (!(bh = dx_bread (dir, block)))
+			break;
+		ret = search_dirblock (dir, bh, name, namelen,
+				       block << EXT2_BLOCK_SIZE_BITS(dir->i_sb),
+				       res_dir);
+		if (ret > 0) {
+			dx_release (frames);
+			*err = 0;
+			return bh;
+		}
+		brelse (bh);
+		if (ret < 0)
+			break;
+		if (!dx_next_block (dir, hash, frames, frame)) {
+			*err = 0;
+			break;
+		}
+	}
+	dx_release (frames);
+	return NULL;
+}
+
 /*
  *	ext2_find_entry()
  *
@@ -73,7 +354,7 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 	struct buffer_head * bh_use[NAMEI_RA_SIZE];
 	struct buffer_head * bh_read[NAMEI_RA_SIZE];
 	unsigned long offset;
-	int block, toread, i, err;
+	int block, toread, i, found, err;
 
 	*res_dir = NULL;
 	if (!dir)
@@ -88,6 +369,15 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 		namelen = EXT2_NAME_LEN;
 #endif
 
+	if (is_dx (dir) && !dx_dot_name (name, namelen)) {
+		struct buffer_head * bh;
+
+		bh = dx_find_entry (dir, name, namelen, res_dir, &err);
+		if (bh || !err)
+			return bh;
+		/* the index is unusable: fall back on a linear search */
+	}
+
 	memset (bh_use, 0, sizeof (bh_use));
 	toread = 0;
 	for (block = 0; block < NAMEI_RA_SIZE; ++block) {
@@ -105,8 +395,6 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 	offset = 0;
 	while (offset < dir->i_size) {
 		struct buffer_head * bh;
-		struct ext2_dir_entry * de;
-		char * dlimit;
 
 		if ((block % NAMEI_RA_BLOCKS) == 0 && toread) {
 			ll_rw_block (READ, toread, bh_read);
@@ -124,24 +412,17 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 			break;
 		}
 
-		de = (struct ext2_dir_entry *) bh->b_data;
-		dlimit = bh->b_data + sb->s_blocksize;
-		while ((char *) de < dlimit) {
-			if (!ext2_check_dir_entry ("ext2_find_entry", dir,
-						   de, bh, offset))
-				goto failure;
-			if (de->inode != 0 && ext2_match (namelen, name, de)) {
-				for (i = 0; i < NAMEI_RA_SIZE; ++i) {
-					if (bh_use[i] != bh)
-						brelse (bh_use[i]);
-				}
-				*res_dir = de;
-				return bh;
+		found = search_dirblock (dir, bh, name, namelen, offset, res_dir);
+		if (found < 0)
+			goto failure;
+		if (found) {
+			for (i = 0; i < NAMEI_RA_SIZE; ++i) {
+				if (bh_use[i] != bh)
+					brelse (bh_use[i]);
 			}
-			offset += de->rec_len;
-			de = (struct ext2_dir_entry *)
-				((char *) de + de->rec_len);
+			return bh;
 		}
+		offset += sb->s_blocksize;
 
 		brelse (bh);
 		if (((block + NAMEI_RA_SIZE) << EXT2_BLOCK_SIZE_BITS (sb)) >=
@@ -205,96 +486,37 @@ int ext2_lookup (struct inode * dir, const char * name, int len,
 }
 
 /*
- *	ext2_add_entry()
- *
- * adds a file entry to the specified directory, using the same
- * semantics as ext2_find_entry(). It returns NULL if it failed.
+ * Put a new entry for "name" into one directory block, if there is room
+ * for it.  Returns the entry, or NULL with *err set: -ENOSPC when the
+ * block is full.
  *
- * NOTE!! The inode part of 'de' is left at 0 - which means you
- * may not sleep between calling this and putting something into
- * the entry, as someone else might have used it while you slept.
+ * NOTE!! The inode part of the entry is left at 0, see ext2_add_entry.
  */
-static struct buffer_head * ext2_add_entry (struct inode * dir,
-					    const char * name, int namelen,
-					    struct ext2_dir_entry ** res_dir,
-					    int *err)
+static struct ext2_dir_entry * ext2_add_to_block (struct inode * dir,
+						  struct buffer_head * bh,
+						  unsigned long offset,
+						  const char * name,
+						  int namelen, int * err)
 {
-	unsigned long offset;
 	unsigned short rec_len;
-	struct buffer_head * bh;
 	struct ext2_dir_entry * de, * de1;
-	struct super_block * sb;
+	char * dlimit;
 
-	*err = -EINVAL;
-	*res_dir = NULL;
-	if (!dir)
-		return NULL;
-	sb = dir->i_sb;
-#ifdef NO_TRUNCATE
-	if (namelen > EXT2_NAME_LEN)
-		return NULL;
-#else
-	if (namelen > EXT2_NAME_LEN)
-		namelen = EXT2_NAME_LEN;
-#endif
-	if (!namelen)
-		return NULL;
-	/*
-	 * Is this a busy deleted directory?  Can't create new files if so
-	 */
-	if (dir->i_size == 0)
-	{
-		*err = -ENOENT;
-		return NULL;
-	}
-	bh = ext2_bread (dir, 0, 0, err);
-	if (!bh)
-		return NULL;
 	rec_len = EXT2_DIR_REC_LEN(namelen);
-	offset = 0;
 	de = (struct ext2_dir_entry *) bh->b_data;
-	*err = -ENOSPC;
-	while (1) {
-		if ((char *)de >= sb->s_blocksize + bh->b_data) {
-			brelse (bh);
-			bh = NULL;
-			bh = ext2_bread (dir, offset >> EXT2_BLOCK_SIZE_BITS(sb), 1, err);
-			if (!bh)
-				return NULL;
-			if (dir->i_size <= offset) {
-				if (dir->i_size == 0) {
-					*err = -ENOENT;
-					return NULL;
-				}
-
-				ext2_debug ("creating next block\n");
-
-				de = (struct ext2_dir_entry *) bh->b_data;
-				de->inode = 0;
-				de->rec_len = sb->s_blocksize;
-				dir->i_size = offset + sb->s_blocksize;
-				dir->i_dirt = 1;
-			} else {
-
-				ext2_debug ("skipping to next block\n");
-
-				de = (struct ext2_dir_entry *) bh->b_data;
-			}
-		}
+	dlimit = bh->b_data + dir->i_sb->s_blocksize;
+	while ((char *) de < dlimit) {
 		if (!ext2_check_dir_entry ("ext2_add_entry", dir, de, bh,
 					   offset)) {
 			*err = -ENOENT;
-			brelse (bh);
 			return NULL;
 		}
 		if (de->inode != 0 && ext2_match (namelen, name, de)) {
-				*err = -EEXIST;
-				brelse (bh);
-				return NULL;
+			*err = -EEXIST;
+			return NULL;
 		}
 		if ((de->inode == 0 && de->rec_len >= rec_len) ||
 		    (de->rec_len >= EXT2_DIR_REC_LEN(de->name_len) + rec_len)) {
-			offset += de->rec_len;
 			if (de->inode) {
 				de1 = (struct ext2_dir_entry *) ((char *) de +
 					EXT2_DIR_REC_LEN(de->name_len));
@@ -321,17 +543,513 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 			dir->i_dirt = 1;
 			dir->i_version = ++event;
 			mark_buffer_dirty(bh, 1);
-			*res_dir = de;
 			*err = 0;
-			return bh;
+			return de;
 		}
 		offset += de->rec_len;
 		de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
 	}
-	brelse (bh);
+	*err = -ENOSPC;
 	return NULL;
 }
 
+/*
+ * Add a block at the end of an indexed directory.  The caller fills it.
+ */
+static struct buffer_head * dx_append_block (struct inode * dir,
+					     unsigned long * block, int * err)
+{
+	struct buffer_head * bh;
+
+	*block = dir->i_size >> EXT2_BLOCK_SIZE_BITS(dir->i_sb);
+	if (!(bh = ext2_bread (dir, *block, 1, err)))
+		return NULL;
+	memset (bh->b_data, 0, dir->i_sb->s_blocksize);
+	((struct ext2_dir_entry *) bh->b_data)->rec_len =
+		dir->i_sb->s_blocksize;
+	mark_buffer_dirty(bh, 1);
+	dir->i_size += dir->i_sb->s_blocksize;
+	dir->i_dirt = 1;
+	return bh;
+}
+
+/*
+ * Insert an index entry for "block" right after frame->at
+ */
+static void dx_insert_block (struct dx_frame * frame, __u32 hash,
+			     unsigned long block)
+{
+	struct dx_entry * entries = frame->entries;
+	struct dx_entry * new = frame->at + 1;
+	int count = dx_count (entries);
+
+	memmove (new + 1, new, (char *) (entries + count) - (char *) new);
+	new->hash = hash;
+	new->block = block;
+	dx_count (entries) = count + 1;
+	mark_buffer_dirty(frame->bh, 1);
+}
+
+/*
+ * Make room for one more entry in the index node of "frame", by adding
+ * a level of nodes under the root or by splitting a node.  Returns the
+ * frame to insert into, which may have changed.
+ */
+static struct dx_frame * dx_make_room (struct inode * dir,
+				       struct dx_frame * frames,
+				       struct dx_frame * frame, int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh;
+	struct dx_entry * entries;
+	unsigned long block;
+	int count, count1;
+
+	if (dx_count (frame->entries) < dx_limit (frame->entries))
+		return frame;
+	if (frame != frames &&
+	    dx_count (frames->entries) >= dx_limit (frames->entries)) {
+		ext2_warning (sb, "dx_make_room",
+			      "index of directory #%lu is full", dir->i_ino);
+		*err = -ENOSPC;
+		return NULL;
+	}
+	if (!(bh = dx_append_block (dir, &block, err)))
+		return NULL;
+	entries = (struct dx_entry *) (bh->b_data + DX_NODE_OFFSET);
+	count = dx_count (frame->entries);
+	if (frame == frames) {
+		/*
+		 * The root is full: move all of it into a new node
+		 */
+		memcpy (entries, frame->entries,
+			count * sizeof (struct dx_entry));
+		dx_limit (entries) = dx_node_limit (sb);
+		frames[1].bh = bh;
+		frames[1].entries = entries;
+		frames[1].at = entries + (frame->at - frame->entries);
+		dx_count (frame->entries) = 1;
+		frame->entries[0].block = block;
+		frame->at = frame->entries;
+		dx_info (frame->bh->b_data)->indirect_levels = 1;
+		mark_buffer_dirty(frame->bh, 1);
+		return frames + 1;
+	}
+	/*
+	 * Move the upper half of the node into the new one.  The first
+	 * entry moved has its hash in the root instead.
+	 */
+	count1 = count / 2;
+	memcpy (entries, frame->entries + count1,
+		(count - count1) * sizeof (struct dx_entry));
+	dx_insert_block (frames, frame->entries[count1].hash, block);
+	dx_limit (entries) = dx_node_limit (sb);
+	dx_count (entries) = count - count1;
+	dx_count (frame->entries) = count1;
+	mark_buffer_dirty(frame->bh, 1);
+	if (frame->at >= frame->entries + count1) {
+		frame->at = entries + (frame->at - (frame->entries + count1));
+		frame->entries = entries;
+		brelse (frame->bh);
+		frame->bh = bh;
+		frames->at++;
+	} else
+		brelse (bh);
+	return frame;
+}
+
+/*
+ * Copy the mapped entries of a leaf from "from" into bh, packed
+ */
+static void dx_pack (struct buffer_head * bh, char * from,
+		     struct dx_map_entry * map, int count, int size)
+{
+	struct ext2_dir_entry * de = NULL;
+	char * to = bh->b_data;
+
+	memset (to, 0, size);
+	while (count--) {
+		de = (struct ext2_dir_entry *) to;
+		memcpy (to, from + map->offs, map->size);
+		de->rec_len = map->size;
+		to += map->size;
+		map++;
+	}
+	de->rec_len += bh->b_data + size - to;
+}
+
+/*
+ * Delete the mapped entries from a leaf the way ext2_delete_entry()
+ * does: each one is merged into the entry before it, or only cleared
+ * if it is the first in the block.  The entries that stay don't move.
+ */
+static void dx_delete_mapped (struct buffer_head * bh,
+			      struct dx_map_entry * map, int count, int size)
+{
+	struct ext2_dir_entry * de, * pde = NULL;
+	char * p;
+
+	while (count--)
+		((struct ext2_dir_entry *) (bh->b_data + map[count].offs))->inode = 0;
+	for (p = bh->b_data; p < bh->b_data + size; p += de->rec_len) {
+		de = (struct ext2_dir_entry *) p;
+		if (de->inode == 0 && pde != NULL)
+			pde->rec_len += de->rec_len;
+		else
+			pde = de;
+	}
+}
+
+/*
+ * Split a full leaf, moving the upper half of its hashes into a new
+ * block.  Returns whichever of the two blocks "hash" now belongs to,
+ * with its number in *block.
+ *
+ * A live entry is never moved within the leaf: the ones that go to the
+ * new block are copied there and deleted from the old one, so to
+ * ext2_unlink() or ext2_rename() holding a pointer to one of them it
+ * looks like a concurrent unlink, and their inode recheck catches it.
+ */
+static struct buffer_head * dx_split_leaf (struct inode * dir,
+					   struct dx_frame * frame,
+					   struct buffer_head * bh,
+					   __u32 hash, unsigned long * block,
+					   int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh2 = NULL;
+	struct ext2_dir_entry * de;
+	struct dx_map_entry * map, tmp;
+	unsigned long offset, block2;
+	int count, split, i, j;
+	__u32 hash2;
+
+	*err = -ENOMEM;
+	map = kmalloc (sb->s_blocksize / EXT2_DIR_REC_LEN(1) *
+		       sizeof (struct dx_map_entry), GFP_KERNEL);
+	if (!map)
+		goto out;
+	if (!(bh2 = dx_append_block (dir, &block2, err)))
+		goto out;
+
+	/*
+	 * Nothing below sleeps until both leaves are rewritten, so the
+	 * leaf can't change under us
+	 */
+	count = 0;
+	offset = *block << EXT2_BLOCK_SIZE_BITS(sb);
+	de = (struct ext2_dir_entry *) bh->b_data;
+	while ((char *) de < bh->b_data + sb->s_blocksize) {
+		if (!ext2_check_dir_entry ("dx_split_leaf", dir, de, bh,
+					   offset)) {
+			*err = -ENOENT;
+			goto out;
+		}
+		if (de->inode) {
+			map[count].hash = dx_hash (de->name, de->name_len);
+			map[count].offs = (char *) de - bh->b_data;
+			map[count].size = EXT2_DIR_REC_LEN(de->name_len);
+			count++;
+		}
+		offset += de->rec_len;
+		de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+	}
+	if (count < 2) {
+		*err = -ENOSPC;
+		goto out;
+	}
+	for (i = 1; i < count; i++) {
+		tmp = map[i];
+		for (j = i; j > 0 && map[j - 1].hash > tmp.hash; j--)
+			map[j] = map[j - 1];
+		map[j] = tmp;
+	}
+
+	/*
+	 * Split in the middle, but keep equal hashes together unless the
+	 * leaf holds nothing else
+	 */
+	for (split = count / 2; split < count; split++)
+		if (map[split].hash != map[split - 1].hash)
+			break;
+	if (split == count)
+		for (split = count / 2; split > 0; split--)
+			if (map[split].hash != map[split - 1].hash)
+				break;
+	if (split == 0)
+		hash2 = map[split = count / 2].hash | 1;
+	else
+		hash2 = map[split].hash;
+
+	dx_pack (bh2, bh->b_data, map + split, count - split, sb->s_blocksize);
+	dx_delete_mapped (bh, map + split, count - split, sb->s_blocksize);
+	dx_insert_block (frame, hash2, block2);
+	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty(bh2, 1);
+	*err = 0;
+	if (hash >= (hash2 & ~1)) {
+		brelse (bh);
+		bh = bh2;
+		*block = block2;
+		bh2 = NULL;
+	}
+out:
+	if (map)
+		kfree_s (map, sb->s_blocksize / EXT2_DIR_REC_LEN(1) *
+			 sizeof (struct dx_map_entry));
+	brelse (bh2);
+	if (*err) {
+		brelse (bh);
+		return NULL;
+	}
+	return bh;
+}
+
+/*
+ * Add "name" to an indexed directory.  If the index is unusable it is
+ * dropped and the caller goes on with a plain directory.
+ */
+static struct buffer_head * dx_add_entry (struct inode * dir,
+					  const char * name, int namelen,
+					  struct ext2_dir_entry ** res_dir,
+					  int * err)
+{
+	struct dx_frame frames[DX_MAX_LEVELS], * frame;
+	struct buffer_head * bh;
+	struct ext2_dir_entry * de;
+	unsigned long block;
+	__u32 hash;
+
+	if ((bh = dx_find_entry (dir, name, namelen, &de, err))) {
+		brelse (bh);
+		*err = -EEXIST;
+		return NULL;
+	}
+	hash = dx_hash (name, namelen);
+	if (*err || !(frame = dx_probe (dir, hash, frames)))
+		goto drop;
+	block = frame->at->block;
+	if (!(bh = dx_bread (dir, block))) {
+		dx_release (frames);
+		goto drop;
+	}
+	de = ext2_add_to_block (dir, bh, block << EXT2_BLOCK_SIZE_BITS(dir->i_sb),
+				name, namelen, err);
+	if (!de && *err == -ENOSPC) {
+		/*
+		 * The leaf is full: split it
+		 */
+		if ((frame = dx_make_room (dir, frames, frame, err)))
+			bh = dx_split_leaf (dir, frame, bh, hash, &block, err);
+		else {
+			brelse (bh);
+			bh = NULL;
+		}
+		if (bh)
+			de = ext2_add_to_block (dir, bh, block <<
+						EXT2_BLOCK_SIZE_BITS(dir->i_sb),
+						name, namelen, err);
+	}
+	dx_release (frames);
+	if (!de) {
+		brelse (bh);
+		return NULL;
+	}
+	*res_dir = de;
+	return bh;
+
+drop:
+	ext2_warning (dir->i_sb, "dx_add_entry",
+		      "dropping the index of directory #%lu", dir->i_ino);
+	dir->u.ext2_i.i_flags &= ~EXT2_INDEX_FL;
+	dir->i_dirt = 1;
+	*err = -EIO;
+	return NULL;
+}
+
+/*
+ * The one-block directory "dir" is full: move its entries into a new
+ * leaf, and turn block 0 into the root of an index.
+ */
+static struct buffer_head * dx_make_indexed_dir (struct inode * dir,
+						 const char * name,
+						 int namelen,
+						 struct ext2_dir_entry ** res_dir,
+						 int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh, * bh2;
+	struct ext2_dir_entry * de, * de2;
+	struct dx_root_info * info;
+	struct dx_entry * entries;
+	unsigned long block;
+	char * top;
+	int len;
+
+	if (!(bh = ext2_bread (dir, 0, 0, err)))
+		return NULL;
+	if (!(bh2 = dx_append_block (dir, &block, err))) {
+		brelse (bh);
+		return NULL;
+	}
+	de = (struct ext2_dir_entry *) bh->b_data;
+	de2 = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+	top = bh->b_data + sb->s_blocksize;
+	if (block != 1 || de->rec_len != EXT2_DIR_REC_LEN(1) ||
+	    de->name_len != 1 || de->name[0] != '.' ||
+	    de2->name_len != 2 || de2->name[0] != '.' || de2->name[1] != '.' ||
+	    !ext2_check_dir_entry ("dx_make_indexed_dir", dir, de2, bh,
+				   EXT2_DIR_REC_LEN(1)))
+		goto plain;
+
+	/*
+	 * Everything after ".." moves to the new leaf, the last entry
+	 * growing to the end of the block
+	 */
+	de = (struct ext2_dir_entry *) ((char *) de2 + de2->rec_len);
+	len = top - (char *) de;
+	if (len) {
+		memcpy (bh2->b_data, de, len);
+		de = (struct ext2_dir_entry *) bh2->b_data;
+		while (1) {
+			if (!ext2_check_dir_entry ("dx_make_indexed_dir", dir,
+						   de, bh2, (char *) de -
+						   bh2->b_data + sb->s_blocksize) ||
+			    (char *) de + de->rec_len > bh2->b_data + len) {
+				memset (bh2->b_data, 0, sb->s_blocksize);
+				de = (struct ext2_dir_entry *) bh2->b_data;
+				de->rec_len = sb->s_blocksize;
+				goto plain;
+			}
+			if ((char *) de + de->rec_len == bh2->b_data + len)
+				break;
+			de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+		}
+		de->rec_len += sb->s_blocksize - len;
+	}
+
+	de2->rec_len = top - (char *) de2;
+	info = dx_info (bh->b_data);
+	memset (info, 0, sizeof (struct dx_root_info));
+	info->hash_version = DX_HASH_VERSION;
+	info->info_length = sizeof (struct dx_root_info);
+	entries = (struct dx_entry *) (bh->b_data + DX_ROOT_OFFSET);
+	dx_limit (entries) = dx_root_limit (sb);
+	dx_count (entries) = 1;
+	entries[0].block = block;
+	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty(bh2, 1);
+	brelse (bh);
+	brelse (bh2);
+	dir->u.ext2_i.i_flags |= EXT2_INDEX_FL;
+	dir->i_dirt = 1;
+	return dx_add_entry (dir, name, namelen, res_dir, err);
+
+plain:
+	/*
+	 * Can't index this one: just use the new block
+	 */
+	brelse (bh);
+	if (!(*res_dir = ext2_add_to_block (dir, bh2, block <<
+					    EXT2_BLOCK_SIZE_BITS(sb),
+					    name, namelen, err))) {
+		brelse (bh2);
+		return NULL;
+	}
+	return bh2;
+}
+
+/*
+ *	ext2_add_entry()
+ *
+ * adds a file entry to the specified directory, using the same
+ * semantics as ext2_find_entry(). It returns NULL if it failed.
+ *
+ * NOTE!! The inode part of 'de' is left at 0 - which means you
+ * may not sleep between calling this and putting something into
+ * the entry, as someone else might have used it while you slept.
+ */
+static struct buffer_head * ext2_add_entry (struct inode * dir,
+					    const char * name, int namelen,
+					    struct ext2_dir_entry ** res_dir,
+					    int *err)
+{
+	unsigned long offset;
+	struct buffer_head * bh;
+	struct ext2_dir_entry * de;
+	struct super_block * sb;
+
+	*err = -EINVAL;
+	*res_dir = NULL;
+	if (!dir)
+		return NULL;
+	sb = dir->i_sb;
+#ifdef NO_TRUNCATE
+	if (namelen > EXT2_NAME_LEN)
+		return NULL;
+#else
+	if (namelen > EXT2_NAME_LEN)
+		namelen = EXT2_NAME_LEN;
+#endif
+	if (!namelen)
+		return NULL;
+	/*
+	 * Is this a busy deleted directory?  Can't create new files if so
+	 */
+	if (dir->i_size == 0)
+	{
+		*err = -ENOENT;
+		return NULL;
+	}
+	if (is_dx (dir)) {
+		bh = dx_add_entry (dir, name, namelen, res_dir, err);
+		if (bh || is_dx (dir))
+			return bh;
+	}
+	for (offset = 0; offset < dir->i_size; offset += sb->s_blocksize) {
+		bh = ext2_bread (dir, offset >> EXT2_BLOCK_SIZE_BITS(sb), 1, err);
+		if (!bh)
+			return NULL;
+		de = ext2_add_to_block (dir, bh, offset, name, namelen, err);
+		if (de) {
+			*res_dir = de;
+			return bh;
+		}
+		brelse (bh);
+		if (*err != -ENOSPC)
+			return NULL;
+	}
+
+	/*
+	 * All blocks are full: a directory outgrowing its first block
+	 * gets indexed, others just grow by one block
+	 */
+	if (dir->i_size == sb->s_blocksize && test_opt (sb, INDEX))
+		return dx_make_indexed_dir (dir, name, namelen, res_dir, err);
+
+	ext2_debug ("creating next block\n");
+
+	bh = ext2_bread (dir, offset >> EXT2_BLOCK_SIZE_BITS(sb), 1, err);
+	if (!bh)
+		return NULL;
+	if (dir->i_size == 0) {
+		brelse (bh);
+		*err = -ENOENT;
+		return NULL;
+	}
+	de = (struct ext2_dir_entry *) bh->b_data;
+	de->inode = 0;
+	de->rec_len = sb->s_blocksize;
+	dir->i_size = offset + sb->s_blocksize;
+	dir->i_dirt = 1;
+	if (!(*res_dir = ext2_add_to_block (dir, bh, offset, name, namelen,
+					    err))) {
+		brelse (bh);
+		return NULL;
+	}
+	return bh;
+}
+
 /*
  * ext2_delete_entry deletes a directory entry by merging it with the
  * previous entry
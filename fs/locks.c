@@ -35,6 +35,7 @@
 #include <asm/segment.h>
 
 #include <linux/malloc.h>
+#include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/errno.h>
@@ -54,6 +55,15 @@ int locks_deadlocked(int my_pid,int blocked_pid);
 #endif
 
 static struct file_lock *file_lock_table = NULL;
+static kmem_cache_t *file_lock_cache;
+
+void locks_init(void)
+{
+	file_lock_cache = kmem_cache_create("file_lock",
+		sizeof(struct file_lock), 0, NULL);
+	if (!file_lock_cache)
+		panic("cannot create file_lock cache");
+}
 
 int fcntl_getlk(unsigned int fd, struct flock *l)
 {
@@ -454,7 +464,7 @@ static struct file_lock *alloc_lock(struct file_lock **pos,
 	struct file_lock *tmp;
 
 	/* Okay, let's make a new file_lock structure... */
-	tmp = (struct file_lock *)kmalloc(sizeof(struct file_lock), GFP_KERNEL);
+	tmp = (struct file_lock *)kmem_cache_alloc(file_lock_cache, GFP_KERNEL);
 	if (!tmp)
 		return tmp;
 	tmp->fl_nextlink = file_lock_table;
@@ -498,7 +508,7 @@ static void free_lock(struct file_lock **fl_p)
 
 	wake_up(&fl->fl_wait);
 
-	kfree(fl);
+	kmem_cache_free(file_lock_cache, fl);
 
 	return;
 }
@@ -36,13 +36,18 @@ static int pipe_read(struct inode * inode, struct file * filp, char * buf, int c
 			else
 				return 0;
 	} else while (PIPE_EMPTY(*inode) || PIPE_LOCK(*inode)) {
+		/* readers sleep exclusively: pass on a wake up we don't use */
 		if (PIPE_EMPTY(*inode)) {
-			if (!PIPE_WRITERS(*inode))
+			if (!PIPE_WRITERS(*inode)) {
+				wake_up_interruptible(&PIPE_WAIT(*inode));
 				return 0;
+			}
 		}
-		if (current->signal & ~current->blocked)
+		if (current->signal & ~current->blocked) {
+			wake_up_interruptible(&PIPE_WAIT(*inode));
 			return -ERESTARTSYS;
-		interruptible_sleep_on(&PIPE_WAIT(*inode));
+		}
+		interruptible_sleep_on_exclusive(&PIPE_WAIT(*inode));
 	}
 	PIPE_LOCK(*inode)++;
 	while (count>0 && (size = PIPE_SIZE(*inode))) {
@@ -42,6 +42,7 @@
 #include <linux/config.h>
 #include <linux/delay.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
 
 #include <asm/segment.h>
 #include <asm/pgtable.h>
@@ -505,7 +506,7 @@ static int get_stat(int pid, char * buffer)
 		(*p)->priority, /* this is the nice value ---
 				   subtract 15 in your user-level program. */
 		(*p)->timeout,
-		(*p)->it_real_value,
+		(*p)->real_timer.next ? (*p)->real_timer.expires - jiffies : 0,
 		(*p)->start_time,
 		vsize,
 		(*p)->mm->rss, /* you might want to shift this left 3 */
@@ -804,6 +805,18 @@ static int get_root_array(char * page, int type)
 
 		case PROC_IOPORTS:
 			return get_ioport_list(page);
+
+		case PROC_SLABINFO:
+			return get_slabinfo(page);
+
+		case PROC_BUDDYINFO:
+			return get_buddyinfo(page);
+
+		case PROC_BUFFERINFO:
+			return get_bufferinfo(page);
+
+		case PROC_DCACHEINFO:
+			return get_dcacheinfo(page);
 	}
 	return -EBADF;
 }
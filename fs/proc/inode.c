@@ -152,6 +152,14 @@ void proc_read_inode(struct inode * inode)
 		return;
 	}
 #endif
+#ifdef CONFIG_INET
+	/* root sets the ICMP rate limits by writing to this one */
+	if (ino == PROC_NET_ICMP) {
+		inode->i_mode = S_IFREG | S_IRUGO | S_IWUSR;
+		inode->i_op = &proc_net_inode_operations;
+		return;
+	}
+#endif
 #ifdef CONFIG_IP_FIREWALL
 	/* these files may be opened R/W by root to reset the counters */
 	if ((ino == PROC_NET_IPFWFWD) || (ino == PROC_NET_IPFWBLK)) {
@@ -21,6 +21,7 @@
  *	      /proc/net/snmp.
  * Alan Cox (gw4pts@gw4pts.ampr.org) 1/95
  *	      Added Appletalk slots
+ *	      /proc/net/icmp, and writing to /proc/net files that allow it.
  *
  *  proc net directory handling functions
  */
@@ -39,6 +40,8 @@
 /* forward references */
 static int proc_readnet(struct inode * inode, struct file * file,
 			 char * buf, int count);
+static int proc_writenet(struct inode * inode, struct file * file,
+			 char * buf, int count);
 static int proc_readnetdir(struct inode *, struct file *,
 			   struct dirent *, int);
 static int proc_lookupnet(struct inode *,const char *,int,struct inode **);
@@ -55,6 +58,8 @@ extern int rarp_get_info(char *, char **, off_t, int);
 extern int dev_get_info(char *, char **, off_t, int);
 extern int rt_get_info(char *, char **, off_t, int);
 extern int snmp_get_info(char *, char **, off_t, int);
+extern int icmp_limit_get_info(char *, char **, off_t, int);
+extern int icmp_limit_write(char *, int);
 extern int afinet_get_info(char *, char **, off_t, int);
 #if	defined(CONFIG_WAVELAN)
 extern int wavelan_get_info(char *, char **, off_t, int);
@@ -93,7 +98,7 @@ extern int atalk_if_get_info(char *, char **, off_t, int);
 static struct file_operations proc_net_operations = {
 	NULL,			/* lseek - default */
 	proc_readnet,		/* read - bad */
-	NULL,			/* write - bad */
+	proc_writenet,		/* write - only a few files */
 	proc_readnetdir,	/* readdir */
 	NULL,			/* select - default */
 	NULL,			/* ioctl - default */
@@ -136,6 +141,7 @@ static struct proc_dir_entry net_dir[] = {
 	{ PROC_NET_TCP,		3, "tcp" },
 	{ PROC_NET_UDP,		3, "udp" },
 	{ PROC_NET_SNMP,	4, "snmp" },
+	{ PROC_NET_ICMP,	4, "icmp" },
 	{ PROC_NET_SOCKSTAT,	8, "sockstat" },
 #ifdef CONFIG_INET_RARP
 	{ PROC_NET_RARP,	4, "rarp"},
@@ -288,6 +294,9 @@ static int proc_readnet(struct inode * inode, struct file * file,
 			case PROC_NET_SNMP:
 				length = snmp_get_info(page, &start, file->f_pos,thistime);
 				break;
+			case PROC_NET_ICMP:
+				length = icmp_limit_get_info(page, &start, file->f_pos,thistime);
+				break;
 #ifdef CONFIG_IP_MULTICAST
 			case PROC_NET_IGMP:
 				length = ip_mc_procinfo(page, &start, file->f_pos,thistime);
@@ -394,3 +403,35 @@ static int proc_readnet(struct inode * inode, struct file * file,
 	return copied;
 
 }
+
+/*
+ *	The few writable files take one page of text at a time. The
+ *	permission bits set up in proc_read_inode() decide who gets here.
+ */
+
+static int proc_writenet(struct inode * inode, struct file * file,
+			 char * buf, int count)
+{
+	char * page;
+	int length;
+
+	if (count < 0 || count >= PAGE_SIZE)
+		return -EINVAL;
+	if (!(page = (char*) __get_free_page(GFP_KERNEL)))
+		return -ENOMEM;
+	memcpy_fromfs(page, buf, count);
+	page[count] = '\0';
+
+	switch (inode->i_ino) 
+	{
+#ifdef CONFIG_INET
+		case PROC_NET_ICMP:
+			length = icmp_limit_write(page, count);
+			break;
+#endif /* CONFIG_INET */
+		default:
+			length = -EINVAL;
+	}
+	free_page((unsigned long) page);
+	return length;
+}
@@ -77,6 +77,10 @@ static struct proc_dir_entry root_dir[] = {
    	{ PROC_KSYMS,		5, "ksyms" },
    	{ PROC_DMA,		3, "dma" },
 	{ PROC_IOPORTS,		7, "ioports"},
+	{ PROC_SLABINFO,	8, "slabinfo" },
+	{ PROC_BUDDYINFO,	9, "buddyinfo" },
+	{ PROC_BUFFERINFO,	10,"bufferinfo" },
+	{ PROC_DCACHEINFO,	10,"dcacheinfo" },
 #ifdef CONFIG_PROFILE
 	{ PROC_PROFILE,		7, "profile"},
 #endif
@@ -109,11 +109,8 @@ int sysv_file_read(struct inode * inode, struct file * filp, char * buf, int cou
 	size = (size + sb->sv_block_size_1) >> sb->sv_block_size_bits;
 	blocks = (left + offset + sb->sv_block_size_1) >> sb->sv_block_size_bits;
 	bhb = bhe = buflist;
-	if (filp->f_reada) {
-		blocks += read_ahead[MAJOR(inode->i_dev)] >> (sb->sv_block_size_bits - 9);
-		if (block + blocks > size)
-			blocks = size - block;
-	}
+	blocks = file_readahead(filp, block, blocks, size,
+		read_ahead[MAJOR(inode->i_dev)] >> (sb->sv_block_size_bits - 9));
 
 	/* We do this in a two stage process.  We first try and request
 	   as many blocks as we can, then we wait for the first one to
@@ -46,6 +46,8 @@
  * Define EXT2_PREALLOCATE to preallocate data blocks for expanding files
  */
 #define EXT2_PREALLOCATE
+#define EXT2_PREALLOC_MIN	8	/* Blocks reserved at a time, at first */
+#define EXT2_PREALLOC_MAX	64	/* ... and for long sequential writes */
 
 /*
  * The second extended file system version
@@ -200,6 +202,7 @@ struct ext2_group_desc
 #define EXT2_IMMUTABLE_FL		0x00000010 /* Immutable file */
 #define EXT2_APPEND_FL			0x00000020 /* writes to file may only append */
 #define EXT2_NODUMP_FL			0x00000040 /* do not dump file */
+#define EXT2_INDEX_FL			0x00001000 /* hash-indexed directory */
 
 /*
  * ioctl commands
@@ -306,6 +309,7 @@ struct ext2_inode {
 #define EXT2_MOUNT_ERRORS_RO		0x0020	/* Remount fs ro on errors */
 #define EXT2_MOUNT_ERRORS_PANIC		0x0040	/* Panic on errors */
 #define EXT2_MOUNT_MINIX_DF		0x0080	/* Mimics the Minix statfs */
+#define EXT2_MOUNT_INDEX		0x0100	/* Index growing directories */
 
 #define clear_opt(o, opt)		o &= ~EXT2_MOUNT_##opt
 #define set_opt(o, opt)			o |= EXT2_MOUNT_##opt
@@ -412,7 +416,7 @@ extern int ext2_permission (struct inode *, int);
 
 /* balloc.c */
 extern int ext2_new_block (struct super_block *, unsigned long,
-			   __u32 *, __u32 *);
+			   __u32 *, __u32 *, int);
 extern void ext2_free_blocks (struct super_block *, unsigned long,
 			      unsigned long);
 extern unsigned long ext2_count_free_blocks (struct super_block *);
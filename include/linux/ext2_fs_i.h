@@ -35,6 +35,8 @@ struct ext2_inode_info {
 	__u32	i_next_alloc_goal;
 	__u32	i_prealloc_block;
 	__u32	i_prealloc_count;
+	__u16	i_prealloc_window;
+	__u16	i_prealloc_want;
 };
 
 #endif	/* _LINUX_EXT2_FS_I */
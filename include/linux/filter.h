@@ -0,0 +1,111 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		Definitions for the socket filter (a BPF style interpreter
+ *		run on frames before a SOCK_PACKET socket keeps them).
+ *
+ * Version:	@(#)filter.h	1.0.0	10/18/95
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+#ifndef _LINUX_FILTER_H
+#define _LINUX_FILTER_H
+
+/*
+ *	One instruction. The program runs over the frame, starting at the
+ *	MAC header, and returns the number of bytes to keep: 0 drops it.
+ */
+ 
+struct sock_filter {
+  unsigned short	code;		/* opcode			*/
+  unsigned char		jt;		/* jump if true			*/
+  unsigned char		jf;		/* jump if false		*/
+  unsigned long		k;		/* generic field		*/
+};
+
+struct sock_fprog {			/* SO_ATTACH_FILTER argument	*/
+  unsigned short	len;		/* number of instructions	*/
+  struct sock_filter	*filter;
+};
+
+/* Instruction classes */
+#define BPF_CLASS(code)	((code) & 0x07)
+#define BPF_LD		0x00
+#define BPF_LDX		0x01
+#define BPF_ST		0x02
+#define BPF_STX		0x03
+#define BPF_ALU		0x04
+#define BPF_JMP		0x05
+#define BPF_RET		0x06
+#define BPF_MISC	0x07
+
+/* ld/ldx fields */
+#define BPF_SIZE(code)	((code) & 0x18)
+#define BPF_W		0x00
+#define BPF_H		0x08
+#define BPF_B		0x10
+#define BPF_MODE(code)	((code) & 0xe0)
+#define BPF_IMM		0x00
+#define BPF_ABS		0x20
+#define BPF_IND		0x40
+#define BPF_MEM		0x60
+#define BPF_LEN		0x80
+#define BPF_MSH		0xa0
+
+/* alu/jmp fields */
+#define BPF_OP(code)	((code) & 0xf0)
+#define BPF_ADD		0x00
+#define BPF_SUB		0x10
+#define BPF_MUL		0x20
+#define BPF_DIV		0x30
+#define BPF_OR		0x40
+#define BPF_AND		0x50
+#define BPF_LSH		0x60
+#define BPF_RSH		0x70
+#define BPF_NEG		0x80
+#define BPF_JA		0x00
+#define BPF_JEQ		0x10
+#define BPF_JGT		0x20
+#define BPF_JGE		0x30
+#define BPF_JSET	0x40
+#define BPF_SRC(code)	((code) & 0x08)
+#define BPF_K		0x00
+#define BPF_X		0x08
+
+/* ret - BPF_K and BPF_X also apply */
+#define BPF_RVAL(code)	((code) & 0x18)
+#define BPF_A		0x10
+
+/* misc */
+#define BPF_MISCOP(code) ((code) & 0xf8)
+#define BPF_TAX		0x00
+#define BPF_TXA		0x80
+
+#define BPF_MAXINSNS	512		/* longest program accepted	*/
+#define BPF_MEMWORDS	16		/* scratch memory slots		*/
+
+/* Macros for filter block array initializers. */
+#define BPF_STMT(code, k)		{ (unsigned short)(code), 0, 0, k }
+#define BPF_JUMP(code, k, jt, jf)	{ (unsigned short)(code), jt, jf, k }
+
+#ifdef __KERNEL__
+
+/* A filter attached to a socket. */
+ 
+struct sk_filter {
+  int			len;		/* number of instructions	*/
+  struct sock_filter	*insns;		/* follows this structure	*/
+};
+
+extern int sk_chk_filter(struct sock_filter *filter, int flen);
+extern unsigned int sk_run_filter(unsigned char *data, int len,
+				  struct sock_filter *filter, int flen);
+
+#endif	/* __KERNEL__ */
+
+#endif	/* _LINUX_FILTER_H */
@@ -42,9 +42,13 @@
 #define WRITEA 3	/* "write-ahead" - silly, but somewhat useful */
 
 extern void buffer_init(void);
+extern int get_bufferinfo(char * buffer);
+extern void locks_init(void);
 extern unsigned long inode_init(unsigned long start, unsigned long end);
 extern unsigned long file_table_init(unsigned long start, unsigned long end);
-extern unsigned long name_cache_init(unsigned long start, unsigned long end);
+extern void name_cache_init(void);
+extern int shrink_dcache(int priority);
+extern int get_dcacheinfo(char * buffer);
 
 #define MAJOR(a) (int)((unsigned short)(a) >> 8)
 #define MINOR(a) (int)((unsigned short)(a) & 0xFF)
@@ -257,6 +261,9 @@ struct file {
 	unsigned short f_flags;
 	unsigned short f_count;
 	off_t f_reada;
+	unsigned long f_ra_next;	/* read-ahead: where a sequential read starts */
+	unsigned long f_ra_end;		/* end of the blocks read ahead */
+	int f_ra_window;		/* blocks to read ahead */
 	struct file *f_next, *f_prev;
 	int f_owner;		/* pid or -pgrp where SIGIO should be sent */
 	struct inode * f_inode;
@@ -422,6 +429,7 @@ extern struct super_block super_blocks[NR_SUPER];
 
 extern int shrink_buffers(unsigned int priority);
 extern void refile_buffer(struct buffer_head * buf);
+extern void balance_dirty(void);
 extern void set_writetime(struct buffer_head * buf, int flag);
 extern void refill_freelist(int size);
 
@@ -436,7 +444,8 @@ extern int nr_buffer_heads;
 #define BUF_LOCKED1 3  /* Supers, inodes */
 #define BUF_DIRTY 4    /* Dirty buffers, not yet scheduled for write */
 #define BUF_SHARED 5   /* Buffers shared */
-#define NR_LIST 6
+#define BUF_HOT 6      /* Clean buffers that have been re-referenced */
+#define NR_LIST 7
 
 extern inline void mark_buffer_clean(struct buffer_head * bh)
 {
@@ -451,7 +460,10 @@ extern inline void mark_buffer_dirty(struct buffer_head * bh, int flag)
   if(!bh->b_dirt) {
     bh->b_dirt = 1;
     set_writetime(bh, flag);
-    if(bh->b_list != BUF_DIRTY) refile_buffer(bh);
+    if(bh->b_list != BUF_DIRTY) {
+      refile_buffer(bh);
+      balance_dirty();
+    }
   }
 }
 
@@ -474,6 +486,7 @@ extern void put_write_access(struct inode * inode);
 extern int open_namei(const char * pathname, int flag, int mode,
 	struct inode ** res_inode, struct inode * base);
 extern int do_mknod(const char * filename, int mode, dev_t dev);
+extern int close_fp(struct file *filp);
 extern void iput(struct inode * inode);
 extern struct inode * __iget(struct super_block * sb,int nr,int crsmnt);
 extern struct inode * get_empty_inode(void);
@@ -493,6 +506,8 @@ extern struct buffer_head * bread(dev_t dev, int block, int size);
 extern unsigned long bread_page(unsigned long addr,dev_t dev,int b[],int size,int no_share);
 extern struct buffer_head * breada(dev_t dev,int block, int size, 
 				   unsigned int pos, unsigned int filesize);
+extern int file_readahead(struct file * filp, unsigned long block, int blocks,
+			  unsigned long size, int initial);
 extern void put_super(dev_t dev);
 unsigned long generate_cluster(dev_t dev, int b[], int size);
 extern dev_t ROOT_DEV;
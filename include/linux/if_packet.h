@@ -0,0 +1,59 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		Global definitions for SOCK_PACKET socket options.
+ *
+ * Version:	@(#)if_packet.h	1.0.0	10/18/95
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+#ifndef _LINUX_IF_PACKET_H
+#define _LINUX_IF_PACKET_H
+
+/* Socket options at level SOL_PACKET. */
+#define PACKET_RX_RING		5
+#define PACKET_STATISTICS	6
+
+/*
+ *	Receive ring. The application asks for a ring with PACKET_RX_RING
+ *	and maps it with mmap(MAP_SHARED) on the socket. Each frame slot
+ *	starts with a tpacket_hdr. The kernel fills slots whose status is
+ *	TP_STATUS_KERNEL and hands them over by setting TP_STATUS_USER;
+ *	the application gives a slot back by storing TP_STATUS_KERNEL.
+ */
+ 
+struct tpacket_req {
+  unsigned int		tp_frame_size;	/* slot size, divides PAGE_SIZE	*/
+  unsigned int		tp_frame_nr;	/* number of slots, 0 = no ring	*/
+};
+
+struct tpacket_hdr {
+  unsigned long		tp_status;	/* TP_STATUS_xxx		*/
+  unsigned int		tp_len;		/* frame length on the wire	*/
+  unsigned int		tp_snaplen;	/* bytes stored in the slot	*/
+  unsigned short	tp_mac;		/* frame offset from slot start	*/
+  unsigned short	tp_family;	/* device type (as sa_family)	*/
+  char			tp_dev[14];	/* device name (as sa_data)	*/
+  unsigned int		tp_sec;		/* receive time stamp		*/
+  unsigned int		tp_usec;
+};
+
+#define TP_STATUS_KERNEL	0	/* slot belongs to the kernel	*/
+#define TP_STATUS_USER		1	/* slot holds a frame for user	*/
+#define TP_STATUS_LOSING	2	/* frames were dropped before	*/
+
+#define TPACKET_ALIGN(x)	(((x) + 15) & ~15)
+#define TPACKET_HDRLEN		TPACKET_ALIGN(sizeof(struct tpacket_hdr))
+
+struct tpacket_stats {
+  unsigned int		tp_packets;	/* frames stored		*/
+  unsigned int		tp_drops;	/* frames lost, no room		*/
+  unsigned int		tp_filtered;	/* frames refused by the filter	*/
+};
+
+#endif	/* _LINUX_IF_PACKET_H */
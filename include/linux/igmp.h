@@ -38,10 +38,31 @@ struct igmphdr
  */
 
 #ifdef __KERNEL__
+
+/*
+ *	One socket's membership of a group, hashed by group so multicast
+ *	delivery only looks at the sockets that joined it.
+ */
+
+struct ip_mc_member
+{
+	unsigned long multiaddr;
+	struct device *interface;
+	struct sock *sk;
+	struct ip_mc_member *next;
+};
+
+#define IP_MC_MEMBER_HASH	64		/* Must be a power of two */
+#define ip_mc_member_hash(addr)	\
+	((ntohl(addr) ^ (ntohl(addr) >> 8)) & (IP_MC_MEMBER_HASH - 1))
+
+extern struct ip_mc_member *ip_mc_members[IP_MC_MEMBER_HASH];
+
 struct ip_mc_socklist
 {
 	unsigned long multiaddr[IP_MAX_MEMBERSHIPS];	/* This is a speed trade off */
 	struct device *multidev[IP_MAX_MEMBERSHIPS];
+	struct ip_mc_member member[IP_MAX_MEMBERSHIPS];	/* Hashed copies of the above */
 };
 
 struct ip_mc_list 
@@ -49,10 +70,37 @@ struct ip_mc_list
 	struct device *interface;
 	unsigned long multiaddr;
 	struct ip_mc_list *next;
-	struct timer_list timer;
+	struct ip_mc_list *hash_next;	/* Chain in interface->ip_mc_dev */
+	struct ip_mc_list *tm_next;	/* Reports due in the same slot */
+	struct ip_mc_list **tm_pprev;
+	unsigned long tm_when;		/* When the report is due */
 	int tm_running;
 	int users;
 };
+
+/*
+ *	Per device IGMP state: the groups hashed for lookup, and one timer
+ *	driving a wheel of pending reports rather than a timer per group.
+ *	A query schedules each group into a random slot; the wheel turns
+ *	every IGMP_TICK while anything is pending.
+ */
+
+#define IP_MC_HASH_SIZE		16		/* Must be a power of two */
+#define ip_mc_hash(addr)	\
+	((ntohl(addr) ^ (ntohl(addr) >> 8)) & (IP_MC_HASH_SIZE - 1))
+
+#define IGMP_TIMER_SLOTS	32
+#define IGMP_TICK		((10*HZ)/IGMP_TIMER_SLOTS)	/* Covers the 10s report delay */
+
+struct ip_mc_dev
+{
+	struct ip_mc_list *hash[IP_MC_HASH_SIZE];
+	struct ip_mc_list *pending[IGMP_TIMER_SLOTS];
+	int slot;			/* Slot sent when the timer next fires */
+	int pending_count;
+	struct timer_list timer;
+	struct device *dev;
+};
  
 extern struct ip_mc_list *ip_mc_head;
 
@@ -60,6 +108,7 @@ extern struct ip_mc_list *ip_mc_head;
 extern int igmp_rcv(struct sk_buff *, struct device *, struct options *, unsigned long, unsigned short,
 	unsigned long, int , struct inet_protocol *);
 extern void ip_mc_drop_device(struct device *dev); 
+extern struct ip_mc_list *ip_mc_find(struct device *dev, unsigned long addr);
 extern int ip_mc_join_group(struct sock *sk, struct device *dev, unsigned long addr);
 extern int ip_mc_leave_group(struct sock *sk, struct device *dev,unsigned long addr);
 extern void ip_mc_drop_socket(struct sock *sk);
@@ -142,6 +142,8 @@ extern void ip_acct_cnt(struct iphdr *, struct device *, struct ip_fw *);
 extern int ip_acct_ctl(int, void *, int);
 #endif
 extern int ip_fw_chk(struct iphdr *, struct device *rif,struct ip_fw *, int, int);
+extern int ip_fw_chk_flow(struct iphdr *, struct device *rif, struct ip_fw *, int,
+	struct ip_fw **, int *);
 #endif /* KERNEL */
 
 #endif /* _IP_FW_H */
@@ -168,6 +168,7 @@ extern inline unsigned long get_free_page(int priority)
 extern void free_pages(unsigned long addr, unsigned long order);
 
 extern void show_free_areas(void);
+extern int get_buddyinfo(char * buffer);
 extern unsigned long put_dirty_page(struct task_struct * tsk,unsigned long page,
 	unsigned long address);
 
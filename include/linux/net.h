@@ -43,6 +43,10 @@
 #define SYS_SHUTDOWN	13		/* sys_shutdown(2)		*/
 #define SYS_SETSOCKOPT	14		/* sys_setsockopt(2)		*/
 #define SYS_GETSOCKOPT	15		/* sys_getsockopt(2)		*/
+#define SYS_SENDMSG	16		/* sys_sendmsg(2)		*/
+#define SYS_RECVMSG	17		/* sys_recvmsg(2)		*/
+#define SYS_RECVMMSG	19		/* sys_recvmmsg(2)		*/
+#define SYS_SENDMMSG	20		/* sys_sendmmsg(2)		*/
 
 
 typedef enum {
@@ -85,6 +89,8 @@ struct socket {
 
 #define SOCK_INODE(S)	((S)->inode)
 
+struct vm_area_struct;		/* for mmap, see <linux/mm.h>	*/
+
 struct proto_ops {
   int	family;
 
@@ -124,6 +130,11 @@ struct proto_ops {
 			 char *optval, int *optlen);
   int	(*fcntl)	(struct socket *sock, unsigned int cmd,
 			 unsigned long arg);	
+  int	(*mmap)		(struct socket *sock, struct vm_area_struct *vma);
+  int	(*sendmsg)	(struct socket *sock, struct msghdr *msg, int len,
+			 int nonblock, unsigned flags);
+  int	(*recvmsg)	(struct socket *sock, struct msghdr *msg, int size,
+			 int nonblock, unsigned flags);
 };
 
 struct net_proto {
@@ -137,5 +148,8 @@ extern int	sock_register(int family, struct proto_ops *ops);
 extern int	sock_unregister(int family);
 extern struct socket *sock_alloc(void);
 extern void	sock_release(struct socket *sock);
+extern int	verify_iovec(struct msghdr *msg, struct iovec *iov, int type);
+extern void	memcpy_fromiovec(unsigned char *kdata, struct iovec *iov, int len);
+extern void	memcpy_toiovec(struct iovec *iov, unsigned char *kdata, int len);
 #endif /* __KERNEL__ */
 #endif	/* _LINUX_NET_H */
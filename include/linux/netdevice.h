@@ -46,11 +46,28 @@
 struct dev_mc_list
 {	
 	struct dev_mc_list *next;
+	struct dev_mc_list **pprev;	/* Link pointing at us in mc_list */
+	struct dev_mc_list *hash_next;	/* Chain in dev->mc_table */
 	char dmi_addr[MAX_ADDR_LEN];
 	unsigned short dmi_addrlen;
 	unsigned short dmi_users;
 };
 
+/*
+ *	Per device lookup table for mc_list, and use counts for each bit
+ *	of a 64 bit hardware hash filter, so a driver with such a filter
+ *	only hears about the bits that actually change.
+ */
+
+#define DEV_MC_HASH_SIZE	32
+
+struct dev_mc_table
+{
+	struct dev_mc_list *hash[DEV_MC_HASH_SIZE];
+	unsigned short filter_users[64];
+	unsigned char filter[8];
+};
+
 /*
  * The DEVICE structure.
  * Actually, this whole structure is a big mistake.  It mixes I/O
@@ -122,8 +139,10 @@ struct device
 
   struct dev_mc_list	 *mc_list;	/* Multicast mac addresses	*/
   int			 mc_count;	/* Number of installed mcasts	*/
+  struct dev_mc_table	 *mc_table;	/* mc_list hashed, filter bits	*/
   
   struct ip_mc_list	 *ip_mc_list;	/* IP multicast filter chain    */
+  struct ip_mc_dev	 *ip_mc_dev;	/* Groups hashed, report timers	*/
     
   /* For load balancing driver pair support */
   
@@ -159,6 +178,11 @@ struct device
   int			  (*do_ioctl)(struct device *dev, struct ifreq *ifr, int cmd);
 #define HAVE_SET_CONFIG
   int			  (*set_config)(struct device *dev, struct ifmap *map);
+#define HAVE_MULTICAST_FILTER
+  /* Load an 8 byte hash filter, bit n set for addresses whose
+     Ethernet CRC has n in its top six bits */
+  void			  (*set_multicast_filter)(struct device *dev,
+					 unsigned char *filter);
   
 };
 
@@ -170,6 +194,10 @@ struct packet_type {
 				 struct packet_type *);
   void			*data;
   struct packet_type	*next;
+  /* if set, called instead of func with a frame that is shared with
+     the other receivers; it may look at the frame but not keep it */
+  int			(*tap) (struct sk_buff *, struct device *,
+				 struct packet_type *);
 };
 
 
@@ -172,6 +172,7 @@ struct ppp {
   char			sending;	/* "channel busy" indicator	*/
   char			escape;		/* 0x20 if prev char was PPP_ESC*/
   char			toss;		/* toss this frame		*/
+  char			xmap_fast;	/* xmap escapes only ctls,ESC,FLAG */
 
   unsigned int		flags;		/* miscellany			*/
 
@@ -30,6 +30,10 @@ enum root_directory_inos {
 	PROC_KSYMS,
 	PROC_DMA,	
 	PROC_IOPORTS,
+	PROC_SLABINFO,
+	PROC_BUDDYINFO,
+	PROC_BUFFERINFO,
+	PROC_DCACHEINFO,
 	PROC_PROFILE /* whether enabled or not */
 };
 
@@ -61,6 +65,7 @@ enum net_directory_inos {
 	PROC_NET_TCP,
 	PROC_NET_UDP,
 	PROC_NET_SNMP,
+	PROC_NET_ICMP,
 #ifdef CONFIG_INET_RARP
 	PROC_NET_RARP,
 #endif
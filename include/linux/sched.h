@@ -61,6 +61,7 @@ extern int nr_running, nr_tasks;
 #include <linux/vm86.h>
 #include <linux/math_emu.h>
 #include <linux/ptrace.h>
+#include <linux/timer.h>
 
 #include <asm/processor.h>
 
@@ -152,6 +153,9 @@ struct task_struct {
 /* various fields */
 	struct linux_binfmt *binfmt;
 	struct task_struct *next_task, *prev_task;
+	struct task_struct *next_run, *prev_run;	/* run queue, see sched.c */
+	int run_slot;			/* -1 when not on a run queue */
+	unsigned long sched_epoch;	/* counters last recharged */
 	struct sigaction sigaction[32];
 	unsigned long saved_kernel_stack;
 	unsigned long kernel_stack_page;
@@ -171,8 +175,9 @@ struct task_struct {
 	unsigned short uid,euid,suid,fsuid;
 	unsigned short gid,egid,sgid,fsgid;
 	unsigned long timeout;
-	unsigned long it_real_value, it_prof_value, it_virt_value;
+	unsigned long it_prof_value, it_virt_value;
 	unsigned long it_real_incr, it_prof_incr, it_virt_incr;
+	struct timer_list real_timer;	/* ITIMER_REAL */
 	long utime, stime, cutime, cstime, start_time;
 	struct rlimit rlim[RLIM_NLIMITS]; 
 	unsigned short used_math;
@@ -223,6 +228,7 @@ struct task_struct {
 /* exec domain */&default_exec_domain, \
 /* binfmt */	NULL, \
 /* schedlink */	&init_task,&init_task, \
+/* run queue */	NULL,NULL,-1,0, \
 /* signals */	{{ 0, },}, \
 /* stack */	0,(unsigned long) &init_kernel_stack, \
 /* ec,brk... */	0,0,0,0,0, \
@@ -230,7 +236,9 @@ struct task_struct {
 /* suppl grps*/ {NOGROUP,}, \
 /* proc links*/ &init_task,&init_task,NULL,NULL,NULL,NULL, \
 /* uid etc */	0,0,0,0,0,0,0,0, \
-/* timeout */	0,0,0,0,0,0,0,0,0,0,0,0, \
+/* timeout */	0,0,0,0,0,0, \
+/* real timer */ { NULL, NULL, 0, 0, NULL }, \
+/* times */	0,0,0,0,0, \
 /* rlimits */   { {LONG_MAX, LONG_MAX}, {LONG_MAX, LONG_MAX},  \
 		  {LONG_MAX, LONG_MAX}, {LONG_MAX, LONG_MAX},  \
 		  {       0, LONG_MAX}, {LONG_MAX, LONG_MAX}, \
@@ -253,8 +261,6 @@ extern struct task_struct *task[NR_TASKS];
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
 extern unsigned long volatile jiffies;
-extern unsigned long itimer_ticks;
-extern unsigned long itimer_next;
 extern struct timeval xtime;
 extern int need_resched;
 
@@ -262,8 +268,10 @@ extern int need_resched;
 
 extern void sleep_on(struct wait_queue ** p);
 extern void interruptible_sleep_on(struct wait_queue ** p);
+extern void interruptible_sleep_on_exclusive(struct wait_queue ** p);
 extern void wake_up(struct wait_queue ** p);
 extern void wake_up_interruptible(struct wait_queue ** p);
+extern void wake_up_process(struct task_struct * tsk);
 
 extern void notify_parent(struct task_struct * tsk);
 extern int send_sig(unsigned long sig,struct task_struct * p,int priv);
@@ -422,6 +430,7 @@ extern inline void select_wait(struct wait_queue ** wait_address, select_table *
 	entry->wait_address = wait_address;
 	entry->wait.task = current;
 	entry->wait.next = NULL;
+	entry->wait.flags = 0;
 	add_wait_queue(wait_address,&entry->wait);
 	p->nr++;
 }
@@ -48,6 +48,7 @@ struct sk_buff {
   struct timeval		stamp;
   struct device			*dev;
   struct sk_buff		*mem_addr;
+  struct sk_buff		*data_skb;	/* Buffer whose memory holds our data */
   union {
 	struct tcphdr	*th;
 	struct ethhdr	*eth;
@@ -59,7 +60,7 @@ struct sk_buff {
   struct iphdr		*ip_hdr;		/* For IPPROTO_RAW */
   unsigned long			mem_len;
   unsigned long 		len;
-  unsigned long			fraglen;
+  unsigned long			fraglen;	/* Bytes held in this buffer (see below) */
   struct sk_buff		*fraglist;	/* Fragment list */
   unsigned long			truesize;
   unsigned long 		saddr;
@@ -75,14 +76,36 @@ struct sk_buff {
 #define PACKET_MULTICAST	2
 #define PACKET_OTHERHOST	3		/* Unmatched promiscuous */
   unsigned short		users;		/* User count - see datagram.c (and soon seqpacket.c/stream.c) */
+  unsigned short		datarefs;	/* Buffers sharing our data (if we are a data_skb) */
   unsigned short		pkt_class;	/* For drivers that need to cache the packet type with the skbuff (new PPP) */
 #ifdef CONFIG_SLAVE_BALANCING
   unsigned short		in_dev_queue;
 #endif  
-  unsigned long			padding[0];
-  unsigned char			data[0];
+  unsigned char			*data;		/* Data area */
 };
 
+/*
+ *	Fragment lists. A reassembled IP datagram is not copied into one
+ *	buffer, it is described by the buffer of its first fragment (the
+ *	head) with the remaining fragment buffers hung off fraglist in
+ *	order. For the head, fraglen is the number of bytes from ip_hdr
+ *	onwards (IP header included) that live in the head itself, and len
+ *	is the length of the whole datagram. For each buffer on the list
+ *	the data is the fraglen bytes starting at h.raw. Freeing the head
+ *	frees the list. Code that wants a flat buffer uses skb_linearize();
+ *	skb_clone() of a chain returns a flat copy.
+ */
+
+/*
+ *	Shared data. alloc_skb() places the data area straight after the
+ *	sk_buff in one block and that buffer is its own data_skb. A clone is
+ *	only a header: it points at the same data and holds a reference on
+ *	the data_skb, whose memory is not released until the last buffer
+ *	using it is freed. Anyone who is going to change the data of a
+ *	buffer that might be shared calls skb_unshare() first; skb_copy()
+ *	always makes a private copy.
+ */
+
 #define SK_WMEM_MAX	32767
 #define SK_RMEM_MAX	32767
 
@@ -111,9 +134,14 @@ extern void 			skb_insert(struct sk_buff *old,struct sk_buff *newsk);
 extern void			skb_append(struct sk_buff *old,struct sk_buff *newsk);
 extern void			skb_unlink(struct sk_buff *buf);
 extern struct sk_buff *		skb_peek_copy(struct sk_buff_head *list);
+extern void			skb_init(void);
 extern struct sk_buff *		alloc_skb(unsigned int size, int priority);
 extern void			kfree_skbmem(struct sk_buff *skb, unsigned size);
 extern struct sk_buff *		skb_clone(struct sk_buff *skb, int priority);
+extern struct sk_buff *		skb_copy(struct sk_buff *skb, int priority);
+extern struct sk_buff *		skb_unshare(struct sk_buff *skb, int priority, int rw);
+extern struct sk_buff *		skb_linearize(struct sk_buff *skb, int priority);
+extern unsigned long		skb_chain_memory(struct sk_buff *skb);
 extern void			skb_device_lock(struct sk_buff *skb);
 extern void			skb_device_unlock(struct sk_buff *skb);
 extern void			dev_kfree_skb(struct sk_buff *skb, int mode);
@@ -130,6 +158,14 @@ static __inline__ struct sk_buff *skb_peek(struct sk_buff_head *list_)
 	return (list->next != list)? list->next : NULL;
 }
 
+/*
+ *	Is the data of this buffer also in use by another buffer?
+ */
+static __inline__ int skb_shared(struct sk_buff *skb)
+{
+	return skb->data_skb->datarefs > 1;
+}
+
 #if CONFIG_SKB_CHECK
 extern int 			skb_check(struct sk_buff *skb,int,int, char *);
 #define IS_SKB(skb)		skb_check((skb), 0, __LINE__,__FILE__)
@@ -0,0 +1,32 @@
+#ifndef _LINUX_SLAB_H
+#define _LINUX_SLAB_H
+
+/*
+ * Object caches ("slabs").
+ *
+ * A cache hands out objects of one fixed size, carved out of blocks of
+ * 2^order pages.  Objects are constructed once when their slab is
+ * created and are expected to be returned to the cache in constructed
+ * state, so frequently used structures don't have to be set up from
+ * scratch on every allocation.  kmalloc() itself is built on a set of
+ * general caches.
+ */
+
+#include <linux/mm.h>
+
+typedef struct kmem_cache_s kmem_cache_t;
+
+/* kmem_cache_create() flags */
+#define SLAB_HWCACHE_ALIGN	0x01	/* align objects on cache lines */
+#define SLAB_DMA		0x02	/* use GFP_DMA memory */
+
+extern kmem_cache_t *kmem_cache_create(const char *name, int size,
+	unsigned long flags, void (*ctor)(void *));
+extern int kmem_cache_destroy(kmem_cache_t *cachep);
+extern int kmem_cache_shrink(kmem_cache_t *cachep);
+extern void *kmem_cache_alloc(kmem_cache_t *cachep, int priority);
+extern void kmem_cache_free(kmem_cache_t *cachep, void *objp);
+extern int kmem_cache_reap(void);
+extern int get_slabinfo(char *buf);
+
+#endif /* _LINUX_SLAB_H */
@@ -2,6 +2,7 @@
 #define _LINUX_SOCKET_H
 
 #include <linux/sockios.h>		/* the SIOCxxx I/O controls	*/
+#include <linux/uio.h>			/* struct iovec for msghdr	*/
 
 
 struct sockaddr {
@@ -9,6 +10,38 @@ struct sockaddr {
   char			sa_data[14];	/* 14 bytes of protocol address	*/
 };
 
+/*
+ * sendmsg/recvmsg header, in the usual BSD layout. The data is
+ * gathered from (or scattered to) msg_iovlen blocks. The control
+ * buffer holds one cmsghdr followed by its data; for SCM_RIGHTS that
+ * is an array of ints.
+ */
+struct msghdr {
+  void			*msg_name;	/* peer address, may be NULL	*/
+  int			msg_namelen;	/* in: size, out: bytes used	*/
+  struct iovec		*msg_iov;	/* data blocks			*/
+  int			msg_iovlen;	/* number of blocks		*/
+  void			*msg_control;	/* ancillary data		*/
+  int			msg_controllen;	/* in: size, out: bytes used	*/
+  int			msg_flags;	/* out: MSG_TRUNC, MSG_CTRUNC	*/
+};
+
+/* One datagram of a sendmmsg/recvmmsg vector. */
+struct mmsghdr {
+  struct msghdr		msg_hdr;	/* as for sendmsg/recvmsg	*/
+  unsigned int		msg_len;	/* out: bytes sent/received	*/
+};
+
+#define MMSG_MAX	1024		/* longest vector per call	*/
+
+struct cmsghdr {
+  int			cmsg_len;	/* header plus data		*/
+  int			cmsg_level;	/* SOL_SOCKET			*/
+  int			cmsg_type;	/* SCM_xxx			*/
+};
+
+#define SCM_RIGHTS	1		/* pass open file descriptors	*/
+
 struct linger {
   int 			l_onoff;	/* Linger active		*/
   int			l_linger;	/* How long to linger for	*/
@@ -50,6 +83,8 @@ struct linger {
 #define MSG_OOB		1
 #define MSG_PEEK	2
 #define MSG_DONTROUTE	4
+#define MSG_CTRUNC	8		/* recvmsg: control data lost	*/
+#define MSG_TRUNC	0x20		/* recvmsg: datagram truncated	*/
 
 /* Setsockoptions(2) level. Thanks to BSD these must match IPPROTO_xxx */
 #define SOL_SOCKET	1
@@ -57,6 +92,7 @@ struct linger {
 #define SOL_IPX		256
 #define SOL_AX25	257
 #define SOL_ATALK	258
+#define SOL_PACKET	263
 #define SOL_TCP		6
 #define SOL_UDP		17
 
@@ -74,6 +110,8 @@ struct linger {
 #define SO_NO_CHECK	11
 #define SO_PRIORITY	12
 #define SO_LINGER	13
+#define SO_ATTACH_FILTER 26
+#define SO_DETACH_FILTER 27
 /* To add :#define SO_REUSEPORT 14 */
 
 /* IP options */
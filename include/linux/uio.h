@@ -0,0 +1,15 @@
+#ifndef _LINUX_UIO_H
+#define _LINUX_UIO_H
+
+/*
+ * A block of user memory, as used by the msg_iov array of a msghdr.
+ * The layout is the Berkeley one.
+ */
+struct iovec {
+  void			*iov_base;	/* start of the block		*/
+  int			iov_len;	/* its size in bytes		*/
+};
+
+#define UIO_MAXIOV	16		/* most blocks per call, as BSD	*/
+
+#endif /* _LINUX_UIO_H */
@@ -11,8 +11,16 @@
 struct wait_queue {
 	struct task_struct * task;
 	struct wait_queue * next;
+	unsigned int flags;
 };
 
+/*
+ * Of the exclusive sleepers on a queue, a wake up wakes only one; the
+ * others are all woken as before. An exclusive sleeper that leaves
+ * without using what it was woken for should wake the queue again.
+ */
+#define WQ_FLAG_EXCLUSIVE	0x01
+
 struct semaphore {
 	int count;
 	struct wait_queue * wait;
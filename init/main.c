@@ -78,6 +78,7 @@ extern void cdu31a_setup(char *str, int *ints);
 extern void sonycd535_setup(char *str, int *ints);
 #endif CONFIG_CDU535
 void ramdisk_setup(char *str, int *ints);
+extern void dcache_setup(char *str, int *ints);
 
 #ifdef CONFIG_SYSVIPC
 extern void ipc_init(void);
@@ -132,6 +133,7 @@ struct {
 } bootsetups[] = {
 	{ "reserve=", reserve_setup },
 	{ "ramdisk=", ramdisk_setup },
+	{ "dcache=", dcache_setup },
 #ifdef CONFIG_BUGi386
 	{ "no-hlt", no_halt },
 	{ "no387", no_387 },
@@ -376,9 +378,10 @@ asmlinkage void start_kernel(void)
 #endif
 	memory_start = inode_init(memory_start,memory_end);
 	memory_start = file_table_init(memory_start,memory_end);
-	memory_start = name_cache_init(memory_start,memory_end);
 	mem_init(memory_start,memory_end);
 	buffer_init();
+	locks_init();
+	name_cache_init();
 	time_init();
 	sock_init();
 #ifdef CONFIG_SYSVIPC
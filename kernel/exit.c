@@ -58,7 +58,7 @@ int send_sig(unsigned long sig,struct task_struct * p,int priv)
 		return 0;
 	if ((sig == SIGKILL) || (sig == SIGCONT)) {
 		if (p->state == TASK_STOPPED)
-			p->state = TASK_RUNNING;
+			wake_up_process(p);
 		p->exit_code = 0;
 		p->signal &= ~( (1<<(SIGSTOP-1)) | (1<<(SIGTSTP-1)) |
 				(1<<(SIGTTIN-1)) | (1<<(SIGTTOU-1)) );
@@ -67,7 +67,9 @@ int send_sig(unsigned long sig,struct task_struct * p,int priv)
 	if ((sig >= SIGSTOP) && (sig <= SIGTTOU)) 
 		p->signal &= ~(1<<(SIGCONT-1));
 	/* Actually generate the signal */
-	generate(sig,p);
+	if (generate(sig,p) && p->state == TASK_INTERRUPTIBLE &&
+	    (p->signal & ~p->blocked))
+		wake_up_process(p);
 	return 0;
 }
 
@@ -387,6 +389,7 @@ NORET_TYPE void do_exit(long code)
 	}
 fake_volatile:
 	current->flags |= PF_EXITING;
+	del_timer(&current->real_timer);
 	sem_exit();
 	exit_mmap(current);
 	free_page_tables(current);
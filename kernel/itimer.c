@@ -35,7 +35,9 @@ int _getitimer(int which, struct itimerval *value)
 
 	switch (which) {
 	case ITIMER_REAL:
-		val = current->it_real_value;
+		val = 0;
+		if (current->real_timer.next)
+			val = current->real_timer.expires - jiffies;
 		interval = current->it_real_incr;
 		break;
 	case ITIMER_VIRTUAL:
@@ -71,6 +73,21 @@ asmlinkage int sys_getitimer(int which, struct itimerval *value)
 	return 0;
 }
 
+/*
+ * ITIMER_REAL runs off the timer list. It fires from the timer bottom
+ * half and rearms itself if there is an interval.
+ */
+static void it_real_fn(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	send_sig(SIGALRM, p, 1);
+	if (p->it_real_incr) {
+		p->real_timer.expires = p->it_real_incr;
+		add_timer(&p->real_timer);
+	}
+}
+
 int _setitimer(int which, struct itimerval *value, struct itimerval *ovalue)
 {
 	register unsigned long i, j;
@@ -82,13 +99,14 @@ int _setitimer(int which, struct itimerval *value, struct itimerval *ovalue)
 		return k;
 	switch (which) {
 		case ITIMER_REAL:
+			del_timer(&current->real_timer);
+			current->it_real_incr = i;
 			if (j) {
-				j += 1+itimer_ticks;
-				if (j < itimer_next)
-					itimer_next = j;
+				current->real_timer.expires = j;
+				current->real_timer.data = (unsigned long) current;
+				current->real_timer.function = it_real_fn;
+				add_timer(&current->real_timer);
 			}
-			current->it_real_value = j;
-			current->it_real_incr = i;
 			break;
 		case ITIMER_VIRTUAL:
 			if (j)
@@ -350,6 +350,7 @@ struct symbol_table symbol_table = {
 	X(file_fsync),
 	X(clear_inode),
 	X(refile_buffer),
+	X(balance_dirty),
 	X(___strtok),
 	X(init_fifo),
 	X(super_blocks),
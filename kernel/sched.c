@@ -92,106 +92,219 @@ struct task_struct * task[NR_TASKS] = {&init_task, };
 
 struct kernel_stat kstat = { 0 };
 
-unsigned long itimer_ticks = 0;
-unsigned long itimer_next = ~0;
+/*
+ * The run queues. Only runnable tasks are on them, one FIFO per value
+ * of 'counter' (the running task is re-slotted each time it comes
+ * through schedule()), with a bitmap of the non-empty ones, so picking
+ * the next task doesn't depend on how many processes there are.
+ *
+ * Tasks are woken with wake_up_process(), which puts them on their
+ * queue; a task leaves it when it calls schedule() in any state other
+ * than TASK_RUNNING. Interrupts wake tasks, so the queues are only
+ * touched with interrupts off.
+ */
+#define NR_RUNQ		128
+#define RUN_MAP_WORDS	(NR_RUNQ / 32)
+
+static struct task_struct * run_head[NR_RUNQ], * run_tail[NR_RUNQ];
+static unsigned int run_map[RUN_MAP_WORDS];
+
+/*
+ * When every runnable task has used up its counter, they are recharged
+ * as counter = counter/2 + priority. Sleeping tasks get the same, but
+ * not until they are woken: sched_epoch counts the recharges and each
+ * task remembers the last one it saw.
+ */
+static unsigned long sched_epoch = 0;
+
+static inline void add_to_runqueue(struct task_struct * p)
+{
+	int slot = p->counter;
+
+	if (slot < 0)
+		slot = 0;
+	else if (slot >= NR_RUNQ)
+		slot = NR_RUNQ - 1;
+	p->run_slot = slot;
+	p->next_run = NULL;
+	if ((p->prev_run = run_tail[slot]) != NULL)
+		p->prev_run->next_run = p;
+	else {
+		run_head[slot] = p;
+		run_map[slot >> 5] |= 1U << (slot & 31);
+	}
+	run_tail[slot] = p;
+	nr_running++;
+}
+
+static inline void del_from_runqueue(struct task_struct * p)
+{
+	int slot = p->run_slot;
+
+	if (p->next_run)
+		p->next_run->prev_run = p->prev_run;
+	else
+		run_tail[slot] = p->prev_run;
+	if (p->prev_run)
+		p->prev_run->next_run = p->next_run;
+	else if ((run_head[slot] = p->next_run) == NULL)
+		run_map[slot >> 5] &= ~(1U << (slot & 31));
+	p->next_run = p->prev_run = NULL;
+	p->run_slot = -1;
+	nr_running--;
+}
+
+/*
+ * Highest non-empty queue, or -1 if nothing is runnable.
+ */
+static inline int highest_runqueue(void)
+{
+	int i, bit;
+	unsigned int word;
+
+	for (i = RUN_MAP_WORDS - 1; i >= 0; i--) {
+		if (!(word = run_map[i]))
+			continue;
+		bit = 0;
+		if (word & 0xffff0000) { word >>= 16; bit += 16; }
+		if (word & 0xff00) { word >>= 8; bit += 8; }
+		if (word & 0xf0) { word >>= 4; bit += 4; }
+		if (word & 0xc) { word >>= 2; bit += 2; }
+		if (word & 0x2) bit++;
+		return (i << 5) + bit;
+	}
+	return -1;
+}
+
+/*
+ * Catch up on the recharges a task slept through. The counter settles
+ * at about 2*priority within a few rounds, so there is no point doing
+ * more than that.
+ */
+static inline void update_counter(struct task_struct * p)
+{
+	unsigned long n = sched_epoch - p->sched_epoch;
+
+	if (!n)
+		return;
+	if (n > 8)
+		n = 8;
+	do {
+		p->counter = (p->counter >> 1) + p->priority;
+	} while (--n);
+	p->sched_epoch = sched_epoch;
+}
+
+/*
+ * Everything runnable is on queue 0: start a new epoch.
+ */
+static void recharge_counters(void)
+{
+	struct task_struct * p, * next;
+
+	sched_epoch++;
+	for (p = run_head[0]; p; p = next) {
+		next = p->next_run;
+		del_from_runqueue(p);
+		update_counter(p);
+		add_to_runqueue(p);
+	}
+}
+
+/*
+ * Make a task runnable. Safe from interrupts.
+ */
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (p->run_slot < 0) {
+		update_counter(p);
+		add_to_runqueue(p);
+	}
+	restore_flags(flags);
+	if (p->counter > current->counter + 3)
+		need_resched = 1;
+}
+
+static void process_timeout(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->timeout = 0;
+	wake_up_process(p);
+}
 
 /*
  *  'schedule()' is the scheduler function. It's a very simple and nice
  * scheduler: it's not perfect, but certainly works for most things.
- * The one thing you might take a look at is the signal-handler code here.
+ *
+ * The task with the highest counter runs, as it always has, but the
+ * candidates come straight off the run queues above instead of from a
+ * walk over every process. Signals wake sleepers in send_sig(),
+ * ITIMER_REAL is a timer of its own, and a sleep with a timeout puts a
+ * timer on our stack here.
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
- * information in task[0] is never used.
- *
- * The "confuse_gcc" goto is used only to get better assembly code..
- * Dijkstra probably hates me.
+ * information in task[0] is never used, and it is never on a run queue.
  */
 asmlinkage void schedule(void)
 {
-	int c;
-	struct task_struct * p;
-	struct task_struct * next;
-	unsigned long ticks;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
+	int slot;
+	struct task_struct * prev, * next;
+	struct timer_list timer;
+	unsigned long timeout = 0;
 
 	if (intr_count) {
 		printk("Aiee: scheduling in interrupt\n");
 		intr_count = 0;
 	}
 	run_task_queue(&tq_scheduler);
-	cli();
-	ticks = itimer_ticks;
-	itimer_ticks = 0;
-	itimer_next = ~0;
-	sti();
 	need_resched = 0;
-	nr_running = 0;
-	p = &init_task;
-	for (;;) {
-		if ((p = p->next_task) == &init_task)
-			goto confuse_gcc1;
-		if (ticks && p->it_real_value) {
-			if (p->it_real_value <= ticks) {
-				send_sig(SIGALRM, p, 1);
-				if (!p->it_real_incr) {
-					p->it_real_value = 0;
-					goto end_itimer;
-				}
-				do {
-					p->it_real_value += p->it_real_incr;
-				} while (p->it_real_value <= ticks);
+	prev = current;
+	cli();
+	if (prev != &init_task) {
+		if (prev->state == TASK_INTERRUPTIBLE) {
+			if (prev->signal & ~prev->blocked)
+				prev->state = TASK_RUNNING;
+			else if ((timeout = prev->timeout) != 0 && timeout <= jiffies) {
+				prev->timeout = 0;
+				timeout = 0;
+				prev->state = TASK_RUNNING;
 			}
-			p->it_real_value -= ticks;
-			if (p->it_real_value < itimer_next)
-				itimer_next = p->it_real_value;
-		}
-end_itimer:
-		if (p->state != TASK_INTERRUPTIBLE)
-			continue;
-		if (p->signal & ~p->blocked) {
-			p->state = TASK_RUNNING;
-			continue;
-		}
-		if (p->timeout && p->timeout <= jiffies) {
-			p->timeout = 0;
-			p->state = TASK_RUNNING;
 		}
-	}
-confuse_gcc1:
-
-/* this is the scheduler proper: */
-#if 0
-	/* give processes that go to sleep a bit higher priority.. */
-	/* This depends on the values for TASK_XXX */
-	/* This gives smoother scheduling for some things, but */
-	/* can be very unfair under some circumstances, so.. */
- 	if (TASK_UNINTERRUPTIBLE >= (unsigned) current->state &&
-	    current->counter < current->priority*2) {
-		++current->counter;
-	}
-#endif
-	c = -1000;
-	next = p = &init_task;
-	for (;;) {
-		if ((p = p->next_task) == &init_task)
-			goto confuse_gcc2;
-		if (p->state == TASK_RUNNING) {
-			nr_running++;
-			if (p->counter > c)
-				c = p->counter, next = p;
+		/* requeue at our current counter, behind our equals */
+		if (prev->run_slot >= 0)
+			del_from_runqueue(prev);
+		if (prev->state == TASK_RUNNING) {
+			timeout = 0;
+			add_to_runqueue(prev);
 		}
 	}
-confuse_gcc2:
-	if (!c) {
-		for_each_task(p)
-			p->counter = (p->counter >> 1) + p->priority;
+	slot = highest_runqueue();
+	if (slot == 0) {
+		recharge_counters();
+		slot = highest_runqueue();
 	}
-	if (current == next)
+	next = (slot < 0) ? &init_task : run_head[slot];
+	sti();
+	if (prev == next)
 		return;
+	if (timeout) {
+		init_timer(&timer);
+		timer.expires = timeout - jiffies - 1;
+		timer.data = (unsigned long) prev;
+		timer.function = process_timeout;
+		add_timer(&timer);
+	}
 	kstat.context_swtch++;
 	switch_to(next);
+	if (timeout)
+		del_timer(&timer);
 }
 
 asmlinkage int sys_pause(void)
@@ -203,7 +316,8 @@ asmlinkage int sys_pause(void)
 
 /*
  * wake_up doesn't wake up stopped processes - they have to be awakened
- * with signals or similar.
+ * with signals or similar. Only the first exclusive sleeper that is
+ * actually asleep gets woken (see <linux/wait.h>).
  *
  * Note that this doesn't need cli-sti pairs: interrupts may not change
  * the wait-queue structures directly, but only call wake_up() to wake
@@ -213,16 +327,17 @@ void wake_up(struct wait_queue **q)
 {
 	struct wait_queue *tmp;
 	struct task_struct * p;
+	int exclusive = 0;
 
 	if (!q || !(tmp = *q))
 		return;
 	do {
 		if ((p = tmp->task) != NULL) {
-			if ((p->state == TASK_UNINTERRUPTIBLE) ||
-			    (p->state == TASK_INTERRUPTIBLE)) {
-				p->state = TASK_RUNNING;
-				if (p->counter > current->counter + 3)
-					need_resched = 1;
+			if (((p->state == TASK_UNINTERRUPTIBLE) ||
+			     (p->state == TASK_INTERRUPTIBLE)) &&
+			    !(exclusive && (tmp->flags & WQ_FLAG_EXCLUSIVE))) {
+				wake_up_process(p);
+				exclusive |= tmp->flags & WQ_FLAG_EXCLUSIVE;
 			}
 		}
 		if (!tmp->next) {
@@ -241,15 +356,16 @@ void wake_up_interruptible(struct wait_queue **q)
 {
 	struct wait_queue *tmp;
 	struct task_struct * p;
+	int exclusive = 0;
 
 	if (!q || !(tmp = *q))
 		return;
 	do {
 		if ((p = tmp->task) != NULL) {
-			if (p->state == TASK_INTERRUPTIBLE) {
-				p->state = TASK_RUNNING;
-				if (p->counter > current->counter + 3)
-					need_resched = 1;
+			if (p->state == TASK_INTERRUPTIBLE &&
+			    !(exclusive && (tmp->flags & WQ_FLAG_EXCLUSIVE))) {
+				wake_up_process(p);
+				exclusive |= tmp->flags & WQ_FLAG_EXCLUSIVE;
 			}
 		}
 		if (!tmp->next) {
@@ -277,10 +393,10 @@ void __down(struct semaphore * sem)
 	remove_wait_queue(&sem->wait, &wait);
 }
 
-static inline void __sleep_on(struct wait_queue **p, int state)
+static inline void __sleep_on(struct wait_queue **p, int state, unsigned int wflags)
 {
 	unsigned long flags;
-	struct wait_queue wait = { current, NULL };
+	struct wait_queue wait = { current, NULL, wflags };
 
 	if (!p)
 		return;
@@ -297,12 +413,21 @@ static inline void __sleep_on(struct wait_queue **p, int state)
 
 void interruptible_sleep_on(struct wait_queue **p)
 {
-	__sleep_on(p,TASK_INTERRUPTIBLE);
+	__sleep_on(p,TASK_INTERRUPTIBLE,0);
+}
+
+/*
+ * For queues with many sleepers of which only one can use each event,
+ * like processes blocked in accept().
+ */
+void interruptible_sleep_on_exclusive(struct wait_queue **p)
+{
+	__sleep_on(p,TASK_INTERRUPTIBLE,WQ_FLAG_EXCLUSIVE);
 }
 
 void sleep_on(struct wait_queue **p)
 {
-	__sleep_on(p,TASK_UNINTERRUPTIBLE);
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,0);
 }
 
 /*
@@ -665,9 +790,6 @@ static void do_timer(int irq, struct pt_regs * regs)
 		mark_bh(TIMER_BH);
 	}
 	cli();
-	itimer_ticks++;
-	if (itimer_ticks > itimer_next)
-		need_resched = 1;
 	if (timer_head.next->expires < jiffies)
 		mark_bh(TIMER_BH);
 	if (tq_timer != &tq_last)
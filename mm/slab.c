@@ -0,0 +1,570 @@
+/*
+ *  linux/mm/slab.c
+ *
+ *  Object cache ("slab") allocator, and kmalloc() on top of it.
+ *
+ *  This replaces the old power-of-two bucket kmalloc (mm/kmalloc.c by
+ *  R.E. Wolff and Alex Bligh).
+ */
+
+/*
+ * Every cache manages objects of a single size.  Memory is taken from
+ * the page allocator in slabs of 2^order pages; the slab header sits at
+ * the start of the area, followed by an array of free-list indices (one
+ * short per object) and then the objects themselves.  The free list
+ * lives outside the objects, so an object keeps whatever state its
+ * constructor gave it for as long as the slab exists.
+ *
+ * A slab is on the "partial" list while it has free objects, on the
+ * "empty" list when none of its objects are in use, and on no list at
+ * all when it is full.  Each cache keeps at most one empty slab around
+ * to absorb alloc/free ping-pong (except when a slab holds only one
+ * object); that one is given back when the page allocator runs short
+ * (kmem_cache_reap()).
+ *
+ * Since buddy blocks are naturally aligned, the slab an object belongs
+ * to is found by masking the object address with the slab size.
+ *
+ * Slabs with room to spare use it to stagger the first object by a
+ * multiple of the alignment ("colouring"), so that the same object in
+ * different slabs doesn't always land on the same cache lines.
+ *
+ * As with the old kmalloc, everything that touches the lists runs with
+ * interrupts off, and the allocation routines may be called from
+ * interrupts with GFP_ATOMIC.
+ */
+
+#include <linux/mm.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/malloc.h>
+#include <linux/slab.h>
+#include <asm/system.h>
+
+#define GFP_LEVEL_MASK 0xf
+
+#define BYTES_PER_WORD		8	/* default object alignment */
+#define L1_CACHE_BYTES		32	/* alignment for SLAB_HWCACHE_ALIGN */
+#define MAX_SLAB_ORDER		5	/* largest slab, 32 pages */
+#define BREAK_SLAB_ORDER	3	/* don't go beyond this just to save space */
+
+#define BUFCTL_END		0xffff
+
+/* private cache flags */
+#define CFLGS_GENERAL		0x100	/* one of the kmalloc() caches */
+
+struct slab {
+	struct kmem_cache_s *cache;
+	struct slab *next, *prev;
+	char *mem;			/* first object */
+	unsigned int inuse;		/* objects handed out */
+	unsigned short free;		/* index of first free object */
+	unsigned short bufctl[0];	/* free list, one entry per object */
+};
+
+struct kmem_cache_s {
+	const char *name;
+	unsigned int objsize;
+	unsigned int num;		/* objects per slab */
+	unsigned int order;		/* pages per slab = 1 << order */
+	unsigned int offset;		/* slab header + bufctl array */
+	unsigned int colour;		/* number of colour offsets */
+	unsigned int colour_next;
+	unsigned int colour_off;
+	unsigned long flags;
+	void (*ctor)(void *);
+	struct slab *partial;		/* slabs with free objects */
+	struct slab *empty;		/* slabs with no objects in use */
+	unsigned int nempty;
+
+	/* statistics, for /proc/slabinfo */
+	unsigned long active;		/* objects in use */
+	unsigned long total;		/* objects in all slabs */
+	unsigned long slabs;
+	unsigned long allocs;
+	unsigned long grown;
+	unsigned long reaped;
+	unsigned long high;		/* highest "active" seen */
+
+	struct kmem_cache_s *next;
+};
+
+#define SLAB_SIZE(cachep)	(PAGE_SIZE << (cachep)->order)
+#define SLAB_OF(cachep,objp) \
+	((struct slab *) ((unsigned long) (objp) & ~(SLAB_SIZE(cachep) - 1)))
+#define SLAB_OBJ(cachep,slabp,i) ((slabp)->mem + (i) * (cachep)->objsize)
+#define SLAB_HDR(num)		(sizeof(struct slab) + (num) * sizeof(unsigned short))
+
+/* the cache of cache descriptors */
+static struct kmem_cache_s cache_cache;
+
+static struct kmem_cache_s *cache_chain = &cache_cache;
+
+/*
+ * Work out objsize, order, num and colouring for a cache.  The smallest
+ * slab that wastes no more than an eighth of itself is used; objects
+ * that won't fit that way get the smallest slab they fit in at all.
+ */
+static int kmem_cache_estimate(struct kmem_cache_s *cachep, int size)
+{
+	unsigned int align, order, num, left;
+
+	align = BYTES_PER_WORD;
+	if (cachep->flags & SLAB_HWCACHE_ALIGN)
+		align = L1_CACHE_BYTES;
+	size = (size + align - 1) & ~(align - 1);
+	if (!size)
+		size = align;
+	cachep->objsize = size;
+
+	for (order = 0; order <= MAX_SLAB_ORDER; order++) {
+		unsigned long slabsize = PAGE_SIZE << order;
+
+		if (slabsize < SLAB_HDR(1) + size)
+			continue;
+		num = (slabsize - sizeof(struct slab)) / (size + sizeof(unsigned short));
+		if (num > BUFCTL_END - 1)
+			num = BUFCTL_END - 1;
+		/* the objects must start aligned */
+		while (num && ((SLAB_HDR(num) + align - 1) & ~(align - 1)) + num * size > slabsize)
+			num--;
+		if (!num)
+			continue;
+		cachep->order = order;
+		cachep->num = num;
+		cachep->offset = (SLAB_HDR(num) + align - 1) & ~(align - 1);
+		left = slabsize - cachep->offset - num * size;
+		cachep->colour_off = align;
+		cachep->colour = left / align + 1;
+		cachep->colour_next = 0;
+		if (order >= BREAK_SLAB_ORDER || left * 8 <= slabsize)
+			return 0;
+	}
+	return -1;
+}
+
+static void kmem_cache_setup(struct kmem_cache_s *cachep, const char *name,
+	unsigned long flags, void (*ctor)(void *))
+{
+	cachep->name = name;
+	cachep->flags = flags;
+	cachep->ctor = ctor;
+	cachep->partial = NULL;
+	cachep->empty = NULL;
+	cachep->nempty = 0;
+	cachep->active = 0;
+	cachep->total = 0;
+	cachep->slabs = 0;
+	cachep->allocs = 0;
+	cachep->grown = 0;
+	cachep->reaped = 0;
+	cachep->high = 0;
+	cachep->next = NULL;
+}
+
+static inline void slab_link(struct slab **list, struct slab *slabp)
+{
+	slabp->prev = NULL;
+	slabp->next = *list;
+	if (*list)
+		(*list)->prev = slabp;
+	*list = slabp;
+}
+
+static inline void slab_unlink(struct slab **list, struct slab *slabp)
+{
+	if (slabp->next)
+		slabp->next->prev = slabp->prev;
+	if (slabp->prev)
+		slabp->prev->next = slabp->next;
+	else
+		*list = slabp->next;
+	slabp->next = slabp->prev = NULL;
+}
+
+/*
+ * Hand an empty slab back to the page allocator.  Called with
+ * interrupts off and the slab already off the lists.
+ */
+static void kmem_slab_destroy(struct kmem_cache_s *cachep, struct slab *slabp)
+{
+	cachep->slabs--;
+	cachep->total -= cachep->num;
+	slabp->cache = NULL;
+	free_pages((unsigned long) slabp, cachep->order);
+}
+
+/*
+ * Add a new slab to the cache.  The pages are allocated and the objects
+ * constructed with interrupts as the caller had them; only linking the
+ * slab in is done with them off.
+ */
+static int kmem_cache_grow(struct kmem_cache_s *cachep, int priority)
+{
+	struct slab *slabp;
+	unsigned long flags;
+	unsigned int i, colour;
+
+	if (cachep->flags & SLAB_DMA)
+		slabp = (struct slab *) __get_dma_pages(priority, cachep->order);
+	else
+		slabp = (struct slab *) __get_free_pages(priority, cachep->order);
+	if (!slabp)
+		return 0;
+
+	save_flags(flags);
+	cli();
+	colour = cachep->colour_next;
+	if (++cachep->colour_next >= cachep->colour)
+		cachep->colour_next = 0;
+	restore_flags(flags);
+
+	slabp->cache = cachep;
+	slabp->mem = (char *) slabp + cachep->offset + colour * cachep->colour_off;
+	slabp->inuse = 0;
+	slabp->free = 0;
+	for (i = 0; i < cachep->num; i++) {
+		slabp->bufctl[i] = i + 1;
+		if (cachep->ctor)
+			cachep->ctor(SLAB_OBJ(cachep, slabp, i));
+	}
+	slabp->bufctl[cachep->num - 1] = BUFCTL_END;
+
+	cli();
+	slab_link(&cachep->empty, slabp);
+	cachep->nempty++;
+	cachep->slabs++;
+	cachep->total += cachep->num;
+	cachep->grown++;
+	restore_flags(flags);
+	return 1;
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, int size,
+	unsigned long flags, void (*ctor)(void *))
+{
+	struct kmem_cache_s *cachep;
+	unsigned long iflags;
+
+	if (size <= 0 || (flags & ~(SLAB_HWCACHE_ALIGN | SLAB_DMA))) {
+		printk("kmem_cache_create: bad arguments for cache %s\n", name);
+		return NULL;
+	}
+	cachep = (struct kmem_cache_s *) kmem_cache_alloc(&cache_cache, GFP_KERNEL);
+	if (!cachep)
+		return NULL;
+	kmem_cache_setup(cachep, name, flags, ctor);
+	if (kmem_cache_estimate(cachep, size)) {
+		printk("kmem_cache_create: objects of cache %s too large (%d bytes)\n",
+			name, size);
+		kmem_cache_free(&cache_cache, cachep);
+		return NULL;
+	}
+	save_flags(iflags);
+	cli();
+	cachep->next = cache_chain->next;
+	cache_chain->next = cachep;
+	restore_flags(iflags);
+	return cachep;
+}
+
+/*
+ * Release all empty slabs of a cache.  Returns the number of pages
+ * freed.
+ */
+int kmem_cache_shrink(kmem_cache_t *cachep)
+{
+	struct slab *slabp;
+	unsigned long flags;
+	int freed = 0;
+
+	save_flags(flags);
+	cli();
+	while ((slabp = cachep->empty) != NULL) {
+		slab_unlink(&cachep->empty, slabp);
+		cachep->nempty--;
+		kmem_slab_destroy(cachep, slabp);
+		cachep->reaped++;
+		freed += 1 << cachep->order;
+	}
+	restore_flags(flags);
+	return freed;
+}
+
+int kmem_cache_destroy(kmem_cache_t *cachep)
+{
+	struct kmem_cache_s *p;
+	unsigned long flags;
+
+	if (!cachep || cachep == &cache_cache || (cachep->flags & CFLGS_GENERAL))
+		return -EINVAL;
+	save_flags(flags);
+	cli();
+	if (cachep->active) {
+		restore_flags(flags);
+		printk("kmem_cache_destroy: cache %s still has %lu objects in use\n",
+			cachep->name, cachep->active);
+		return -EBUSY;
+	}
+	for (p = cache_chain; p->next; p = p->next) {
+		if (p->next == cachep) {
+			p->next = cachep->next;
+			break;
+		}
+	}
+	restore_flags(flags);
+	kmem_cache_shrink(cachep);
+	kmem_cache_free(&cache_cache, cachep);
+	return 0;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cachep, int priority)
+{
+	struct slab *slabp;
+	unsigned long flags;
+	void *objp;
+
+	priority &= GFP_LEVEL_MASK;
+	if (intr_count && priority != GFP_ATOMIC) {
+		static int count = 0;
+		if (++count < 5) {
+			printk("kmem_cache_alloc called nonatomically from interrupt %p\n",
+				__builtin_return_address(0));
+			priority = GFP_ATOMIC;
+		}
+	}
+
+	save_flags(flags);
+	for (;;) {
+		cli();
+		slabp = cachep->partial;
+		if (slabp)
+			break;
+		slabp = cachep->empty;
+		if (slabp) {
+			slab_unlink(&cachep->empty, slabp);
+			cachep->nempty--;
+			slab_link(&cachep->partial, slabp);
+			break;
+		}
+		restore_flags(flags);
+		if (!kmem_cache_grow(cachep, priority))
+			return NULL;
+	}
+
+	objp = SLAB_OBJ(cachep, slabp, slabp->free);
+	slabp->free = slabp->bufctl[slabp->free];
+	slabp->inuse++;
+	if (slabp->free == BUFCTL_END)
+		slab_unlink(&cachep->partial, slabp);
+	cachep->allocs++;
+	if (++cachep->active > cachep->high)
+		cachep->high = cachep->active;
+	restore_flags(flags);
+	return objp;
+}
+
+static inline void __kmem_cache_free(struct kmem_cache_s *cachep,
+	struct slab *slabp, void *objp)
+{
+	unsigned int i = ((char *) objp - slabp->mem) / cachep->objsize;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	slabp->bufctl[i] = slabp->free;
+	if (slabp->free == BUFCTL_END)
+		slab_link(&cachep->partial, slabp);
+	slabp->free = i;
+	cachep->active--;
+	if (!--slabp->inuse) {
+		slab_unlink(&cachep->partial, slabp);
+		if (cachep->nempty || cachep->num == 1)
+			kmem_slab_destroy(cachep, slabp);
+		else {
+			slab_link(&cachep->empty, slabp);
+			cachep->nempty++;
+		}
+	}
+	restore_flags(flags);
+}
+
+void kmem_cache_free(kmem_cache_t *cachep, void *objp)
+{
+	struct slab *slabp = SLAB_OF(cachep, objp);
+
+	if (slabp->cache != cachep || (char *) objp < slabp->mem ||
+	    ((char *) objp - slabp->mem) % cachep->objsize ||
+	    (char *) objp >= SLAB_OBJ(cachep, slabp, cachep->num)) {
+		printk("kmem_cache_free: bad object %p for cache %s\n",
+			objp, cachep->name);
+		return;
+	}
+	__kmem_cache_free(cachep, slabp, objp);
+}
+
+/*
+ * Called by the page allocator when memory is short: give back the
+ * spare empty slab of every cache.
+ */
+int kmem_cache_reap(void)
+{
+	struct kmem_cache_s *cachep;
+	int freed = 0;
+
+	for (cachep = cache_chain; cachep; cachep = cachep->next)
+		freed += kmem_cache_shrink(cachep);
+	return freed;
+}
+
+int get_slabinfo(char *buf)
+{
+	struct kmem_cache_s *cachep;
+	int len;
+
+	len = sprintf(buf, "slabinfo - version: 1.0\n"
+		"%-16s %8s %8s %7s %6s %5s %9s %6s %6s %8s\n",
+		"name", "active", "total", "objsize", "slabs", "pages",
+		"allocs", "grown", "reaped", "high");
+	for (cachep = cache_chain; cachep; cachep = cachep->next) {
+		if (len > PAGE_SIZE - 100)
+			break;
+		len += sprintf(buf + len,
+			"%-16s %8lu %8lu %7u %6lu %5u %9lu %6lu %6lu %8lu\n",
+			cachep->name, cachep->active, cachep->total,
+			cachep->objsize, cachep->slabs, 1 << cachep->order,
+			cachep->allocs, cachep->grown, cachep->reaped,
+			cachep->high);
+	}
+	return len;
+}
+
+/*
+ * kmalloc() is served from a fixed set of general caches.  The small
+ * ones pack several objects into a page; the rest hold a single object
+ * in a slab of 1 to 32 pages, using whatever the slab header leaves of
+ * the area.
+ */
+#define NR_SMALL	7
+#define NR_GENERAL	(NR_SMALL + MAX_SLAB_ORDER + 1)
+#define SMALL_SHIFT	3
+#define MAX_SMALL	2032
+
+static struct general_size {
+	const char *name, *dmaname;
+	int size;		/* 0: one object per slab of "order" */
+	int order;
+} general_sizes[NR_GENERAL] = {
+	{ "size-32",	"size-32(DMA)",		32,	0 },
+	{ "size-64",	"size-64(DMA)",		64,	0 },
+	{ "size-128",	"size-128(DMA)",	128,	0 },
+	{ "size-248",	"size-248(DMA)",	248,	0 },
+	{ "size-504",	"size-504(DMA)",	504,	0 },
+	{ "size-1008",	"size-1008(DMA)",	1008,	0 },
+	{ "size-2032",	"size-2032(DMA)",	MAX_SMALL, 0 },
+	{ "size-4k",	"size-4k(DMA)",		0,	0 },
+	{ "size-8k",	"size-8k(DMA)",		0,	1 },
+	{ "size-16k",	"size-16k(DMA)",	0,	2 },
+	{ "size-32k",	"size-32k(DMA)",	0,	3 },
+	{ "size-64k",	"size-64k(DMA)",	0,	4 },
+	{ "size-128k",	"size-128k(DMA)",	0,	5 }
+};
+
+/* [0..NR_GENERAL-1] normal memory, [NR_GENERAL..] GFP_DMA memory */
+static struct kmem_cache_s general_caches[2 * NR_GENERAL];
+
+/* size class by (size-1) >> SMALL_SHIFT, and by the number of pages */
+static unsigned char small_index[(MAX_SMALL >> SMALL_SHIFT) + 1];
+static unsigned char large_index[1 << MAX_SLAB_ORDER];
+
+static unsigned int max_kmalloc;
+
+static void kmem_cache_init(void)
+{
+	kmem_cache_setup(&cache_cache, "kmem_cache", 0, NULL);
+	kmem_cache_estimate(&cache_cache, sizeof(struct kmem_cache_s));
+}
+
+long kmalloc_init(long start_mem, long end_mem)
+{
+	int i, j, size;
+
+	kmem_cache_init();
+
+	for (i = 0; i < 2 * NR_GENERAL; i++) {
+		struct general_size *g = general_sizes + i % NR_GENERAL;
+		struct kmem_cache_s *cachep = general_caches + i;
+
+		size = g->size;
+		if (!size)
+			size = ((PAGE_SIZE << g->order) - SLAB_HDR(1)) & ~(BYTES_PER_WORD - 1);
+		kmem_cache_setup(cachep, i < NR_GENERAL ? g->name : g->dmaname,
+			CFLGS_GENERAL | (i < NR_GENERAL ? 0 : SLAB_DMA), NULL);
+		/*
+		 * Check the static table.  kfree_s() finds the slab from the
+		 * page an object starts in, so a general cache must not put
+		 * objects beyond the first page of a multi-page slab.
+		 */
+		if (kmem_cache_estimate(cachep, size) || cachep->objsize != size ||
+		    cachep->order != g->order ||
+		    (cachep->order && cachep->num != 1))
+			panic("kmalloc_init: bad general cache %s", cachep->name);
+		cachep->next = cache_chain->next;
+		cache_chain->next = cachep;
+	}
+	max_kmalloc = general_caches[NR_GENERAL - 1].objsize;
+
+	for (i = 0, j = 0; i < sizeof(small_index); i++) {
+		while (general_sizes[j].size < ((i + 1) << SMALL_SHIFT) &&
+		       j < NR_SMALL - 1)
+			j++;
+		small_index[i] = j;
+	}
+	for (i = 0, j = 0; i < sizeof(large_index); i++) {
+		while ((1 << j) < i + 1)
+			j++;
+		large_index[i] = NR_SMALL + j;
+	}
+	return start_mem;
+}
+
+void *kmalloc(size_t size, int priority)
+{
+	int i;
+
+	if (size > max_kmalloc) {
+		printk("kmalloc of too large a block (%d bytes).\n", (int) size);
+		return NULL;
+	}
+	if (size <= MAX_SMALL)
+		i = small_index[size ? (size - 1) >> SMALL_SHIFT : 0];
+	else {
+		i = large_index[(size - 1 + SLAB_HDR(1)) >> PAGE_SHIFT];
+		if (size > general_caches[i].objsize)
+			i++;
+	}
+	if (priority & GFP_DMA)
+		i += NR_GENERAL;
+	return kmem_cache_alloc(general_caches + i, priority);
+}
+
+void kfree_s(void *objp, int size)
+{
+	struct slab *slabp = (struct slab *) ((unsigned long) objp & PAGE_MASK);
+	struct kmem_cache_s *cachep = slabp->cache;
+
+	if (cachep < general_caches || cachep >= general_caches + 2 * NR_GENERAL ||
+	    (char *) objp < slabp->mem ||
+	    ((char *) objp - slabp->mem) % cachep->objsize ||
+	    (char *) objp >= SLAB_OBJ(cachep, slabp, cachep->num)) {
+		printk("kfree of non-kmalloced memory: %p, from %p\n",
+			objp, __builtin_return_address(0));
+		return;
+	}
+	if (size > (int) cachep->objsize) {
+		printk("Trying to free pointer at %p with wrong size: %d instead of at most %u.\n",
+			objp, size, cachep->objsize);
+		return;
+	}
+	__kmem_cache_free(cachep, slabp, objp);
+}
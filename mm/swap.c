@@ -18,6 +18,7 @@
 #include <linux/string.h>
 #include <linux/stat.h>
 #include <linux/fs.h>
+#include <linux/slab.h>
 
 #include <asm/dma.h>
 #include <asm/system.h> /* for cli()/sti() */
@@ -35,6 +36,38 @@
 
 int min_free_pages = 20;
 
+/*
+ * Reserve pool for atomic allocations.  Interrupt handlers (mostly the
+ * network receive path) can't wait for memory to be freed, so a few
+ * blocks of the small orders are set aside for them.  GFP_ATOMIC falls
+ * back on the pool when the free lists can't satisfy a request, either
+ * because they are empty or because they are too fragmented.
+ *
+ * The pool is topped up from a timer once an atomic allocation has
+ * taken it below its low watermark.  That only uses memory that is
+ * free anyway; if there isn't enough, the next GFP_KERNEL or GFP_USER
+ * allocation frees pages to refill it before it is served.
+ */
+#define RESERVE_ORDERS	2
+
+static struct reserve_pool {
+	struct mem_list list;
+	int nr;			/* blocks in the pool */
+	int low, high;		/* watermarks, in blocks */
+	unsigned long used;	/* allocations served from the pool */
+	unsigned long empty;	/* times an atomic allocation found it empty */
+} reserve[RESERVE_ORDERS];
+
+static int reserve_short = 0;	/* some pool is below its low watermark */
+static struct timer_list reserve_timer;
+
+/* allocation statistics for /proc/buddyinfo */
+#define NR_GFP_PRIO	6
+
+static unsigned long gfp_allocs[NR_MEM_LISTS];
+static unsigned long gfp_fails[NR_MEM_LISTS];
+static unsigned long gfp_prio_fails[NR_GFP_PRIO];
+
 static int nr_swapfiles = 0;
 static struct wait_queue * lock_queue = NULL;
 
@@ -592,6 +625,8 @@ static int try_to_free_page(int priority)
 	static int state = 0;
 	int i=6;
 
+	if (kmem_cache_reap())
+		return 1;
 	switch (state) {
 		do {
 		case 0:
@@ -599,9 +634,13 @@ static int try_to_free_page(int priority)
 				return 1;
 			state = 1;
 		case 1:
-			if (shm_swap(i))
+			if (shrink_dcache(i) && kmem_cache_reap())
 				return 1;
 			state = 2;
+		case 2:
+			if (shm_swap(i))
+				return 1;
+			state = 3;
 		default:
 			if (swap_out(i))
 				return 1;
@@ -736,9 +775,106 @@ do { unsigned long size = PAGE_SIZE << high; \
 	} mem_map[MAP_NR((unsigned long) addr)] = 1; \
 } while (0)
 
-unsigned long __get_free_pages(int priority, unsigned long order)
+/*
+ * Take a block off the free lists regardless of the watermarks.
+ */
+static unsigned long get_free_block(unsigned long order)
 {
 	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	RMQUEUE(order);
+	restore_flags(flags);
+	return 0;
+}
+
+static void check_reserve(void)
+{
+	int order;
+
+	reserve_short = 0;
+	for (order = 0; order < RESERVE_ORDERS; order++)
+		if (reserve[order].nr < reserve[order].low)
+			reserve_short = 1;
+}
+
+/*
+ * Fill the pools up to their high watermarks.  Pages are only taken
+ * while there are more than min_free_pages free; if "priority" allows
+ * it, memory is freed to get there, otherwise we stop.
+ */
+static void refill_reserve(int priority)
+{
+	static int refilling = 0;
+	unsigned long flags, addr;
+	int order;
+
+	if (refilling)
+		return;
+	refilling = 1;
+	for (order = 0; order < RESERVE_ORDERS; order++) {
+		struct reserve_pool * pool = reserve + order;
+
+		while (pool->nr < pool->high) {
+			if (nr_free_pages <= min_free_pages + (1 << order)) {
+				if (priority != GFP_KERNEL && priority != GFP_USER)
+					break;
+				if (!try_to_free_page(priority))
+					break;
+				continue;
+			}
+			addr = get_free_block(order);
+			if (!addr)
+				break;
+			save_flags(flags);
+			cli();
+			add_mem_queue(&pool->list, (struct mem_list *) addr);
+			pool->nr++;
+			restore_flags(flags);
+		}
+	}
+	save_flags(flags);
+	cli();
+	check_reserve();
+	restore_flags(flags);
+	refilling = 0;
+}
+
+static void reserve_timer_fn(unsigned long data)
+{
+	refill_reserve(GFP_ATOMIC);
+}
+
+/*
+ * An atomic allocation the free lists couldn't satisfy.  Called with
+ * interrupts off.
+ */
+static unsigned long get_reserve_block(unsigned long order)
+{
+	struct reserve_pool * pool = reserve + order;
+	struct mem_list * entry;
+
+	entry = pool->list.next;
+	if (entry == &pool->list) {
+		pool->empty++;
+		return 0;
+	}
+	remove_mem_queue(&pool->list, entry);
+	pool->used++;
+	if (--pool->nr < pool->low) {
+		reserve_short = 1;
+		if (!reserve_timer.next) {
+			reserve_timer.expires = 0;
+			add_timer(&reserve_timer);
+		}
+	}
+	return (unsigned long) entry;
+}
+
+unsigned long __get_free_pages(int priority, unsigned long order)
+{
+	unsigned long flags, addr;
 	int reserved_pages;
 
 	if (intr_count && priority != GFP_ATOMIC) {
@@ -749,20 +885,34 @@ unsigned long __get_free_pages(int priority, unsigned long order)
 			priority = GFP_ATOMIC;
 		}
 	}
+	if (order >= NR_MEM_LISTS)
+		return 0;
+	if (reserve_short && priority != GFP_ATOMIC)
+		refill_reserve(priority);
 	reserved_pages = 5;
 	if (priority != GFP_NFS)
 		reserved_pages = min_free_pages;
+	gfp_allocs[order]++;
 	save_flags(flags);
 repeat:
 	cli();
 	if ((priority==GFP_ATOMIC) || nr_free_pages > reserved_pages) {
 		RMQUEUE(order);
+		if (priority == GFP_ATOMIC && order < RESERVE_ORDERS &&
+		    (addr = get_reserve_block(order)) != 0) {
+			restore_flags(flags);
+			return addr;
+		}
 		restore_flags(flags);
-		return 0;
+		goto fail;
 	}
 	restore_flags(flags);
 	if (priority != GFP_BUFFER && try_to_free_page(priority))
 		goto repeat;
+fail:
+	gfp_fails[order]++;
+	if ((unsigned) priority < NR_GFP_PRIO)
+		gfp_prio_fails[priority]++;
 	return 0;
 }
 
@@ -822,6 +972,53 @@ void show_free_areas(void)
 #endif	
 }
 
+/*
+ * /proc/buddyinfo: free blocks, allocations and failures per order,
+ * the atomic reserve, and failures per allocation priority.
+ */
+int get_buddyinfo(char * buffer)
+{
+	static const char * prio_name[NR_GFP_PRIO] = {
+		"buffer", "atomic", "user", "kernel", "nobuffer", "nfs"
+	};
+	unsigned long nr_free[NR_MEM_LISTS];
+	unsigned long order, flags;
+	int len, i;
+
+	save_flags(flags);
+	cli();
+	for (order = 0 ; order < NR_MEM_LISTS ; order++) {
+		struct mem_list * tmp;
+		nr_free[order] = 0;
+		for (tmp = free_area_list[order].next ; tmp != free_area_list + order ; tmp = tmp->next)
+			nr_free[order]++;
+	}
+	restore_flags(flags);
+
+	len = sprintf(buffer, "order    ");
+	for (order = 0 ; order < NR_MEM_LISTS ; order++)
+		len += sprintf(buffer+len, " %9lu", order);
+	len += sprintf(buffer+len, "\nfree     ");
+	for (order = 0 ; order < NR_MEM_LISTS ; order++)
+		len += sprintf(buffer+len, " %9lu", nr_free[order]);
+	len += sprintf(buffer+len, "\nallocs   ");
+	for (order = 0 ; order < NR_MEM_LISTS ; order++)
+		len += sprintf(buffer+len, " %9lu", gfp_allocs[order]);
+	len += sprintf(buffer+len, "\nfailures ");
+	for (order = 0 ; order < NR_MEM_LISTS ; order++)
+		len += sprintf(buffer+len, " %9lu", gfp_fails[order]);
+	len += sprintf(buffer+len, "\n\nreserve  %9s %9s %9s %9s %9s\n",
+		"blocks", "low", "high", "used", "empty");
+	for (i = 0 ; i < RESERVE_ORDERS ; i++)
+		len += sprintf(buffer+len, "order %d  %9d %9d %9d %9lu %9lu\n",
+			i, reserve[i].nr, reserve[i].low, reserve[i].high,
+			reserve[i].used, reserve[i].empty);
+	len += sprintf(buffer+len, "\nfailures by priority:\n");
+	for (i = 0 ; i < NR_GFP_PRIO ; i++)
+		len += sprintf(buffer+len, "%-9s %9lu\n", prio_name[i], gfp_prio_fails[i]);
+	return len;
+}
+
 /*
  * Trying to stop swapping from a file is fraught with races, so
  * we repeat quite a bit here when we have to pause. swapoff()
@@ -1214,6 +1411,21 @@ unsigned long free_area_init(unsigned long start_mem, unsigned long end_mem)
 	if (i < 16)
 		i = 16;
 	min_free_pages = i;
+	/*
+	 * The atomic reserve gets a quarter of that in single pages and
+	 * a sixteenth in page pairs.
+	 */
+	for (i = 0 ; i < RESERVE_ORDERS ; i++) {
+		reserve[i].list.prev = reserve[i].list.next = &reserve[i].list;
+		reserve[i].nr = 0;
+		reserve[i].high = min_free_pages >> (2 + 2*i);
+		if (reserve[i].high < 4 >> i)
+			reserve[i].high = 4 >> i;
+		reserve[i].low = (reserve[i].high + 1) >> 1;
+	}
+	reserve_short = 1;
+	init_timer(&reserve_timer);
+	reserve_timer.function = reserve_timer_fn;
 	// 腾出一块给交换区使用
 	start_mem = init_swap_cache(start_mem, end_mem);
 	mem_map = (mem_map_t *) start_mem;
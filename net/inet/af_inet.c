@@ -175,6 +175,10 @@ void put_sock(unsigned short num, struct sock *sk)
 
 	sk->num = num;
 	sk->next = NULL;
+#ifdef CONFIG_IP_MULTICAST
+	sk->ip_mc_bound = 1;
+	udp_mc_update(sk);
+#endif
 	num = num &(SOCK_ARRAY_SIZE -1);
 
 	/* We can't have an interrupt re-enter here. */
@@ -257,7 +261,7 @@ static void remove_sock(struct sock *sk1)
 		sk1->prot->inuse -= 1;
 		sk1->prot->sock_array[sk1->num &(SOCK_ARRAY_SIZE -1)] = sk1->next;
 		restore_flags(flags);
-		return;
+		goto unbound;
 	}
 	// 找sk1
 	while(sk2 && sk2->next != sk1) 
@@ -270,9 +274,17 @@ static void remove_sock(struct sock *sk1)
 		sk1->prot->inuse -= 1;
 		sk2->next = sk1->next;
 		restore_flags(flags);
-		return;
+		goto unbound;
 	}
 	restore_flags(flags);
+	return;
+
+unbound:
+#ifdef CONFIG_IP_MULTICAST
+	sk1->ip_mc_bound = 0;
+	udp_mc_update(sk1);
+#endif
+	return;
 }
 
 /*
@@ -383,7 +395,7 @@ void destroy_sock(struct sock *sk)
 
 	  if (sk->dead && sk->rmem_alloc == 0 && sk->wmem_alloc == 0) 
 	  {
-		kfree_s((void *)sk,sizeof(*sk));
+		kmem_cache_free(sk_cachep, sk);
 	  } 
 	  else 
 	  {
@@ -460,6 +472,20 @@ static int inet_getsockopt(struct socket *sock, int level, int optname,
   		return sk->prot->getsockopt(sk,level,optname,optval,optlen);
 }
 
+/*
+ *	Map protocol owned memory (the SOCK_PACKET receive ring) into
+ *	the caller. Only protocols that have such memory support this.
+ */
+
+static int inet_mmap(struct socket *sock, struct vm_area_struct *vma)
+{
+	struct sock *sk = (struct sock *) sock->data;
+
+	if (sk->prot->mmap == NULL)
+		return(-ENODEV);
+	return sk->prot->mmap(sk, vma);
+}
+
 /*
  *	Automatically bind an unbound socket.
  */
@@ -551,7 +577,7 @@ static int inet_create(struct socket *sock, int protocol)
 	struct proto *prot;
 	int err;
 	// 分配一个sock结构体
-	sk = (struct sock *) kmalloc(sizeof(*sk), GFP_KERNEL);
+	sk = (struct sock *) kmem_cache_alloc(sk_cachep, GFP_KERNEL);
 	if (sk == NULL) 
 		return(-ENOBUFS);
 	sk->num = 0;
@@ -562,7 +588,7 @@ static int inet_create(struct socket *sock, int protocol)
 		case SOCK_SEQPACKET:
 			if (protocol && protocol != IPPROTO_TCP) 
 			{
-				kfree_s((void *)sk, sizeof(*sk));
+				kmem_cache_free(sk_cachep, sk);
 				return(-EPROTONOSUPPORT);
 			}
 			protocol = IPPROTO_TCP;
@@ -574,7 +600,7 @@ static int inet_create(struct socket *sock, int protocol)
 		case SOCK_DGRAM:
 			if (protocol && protocol != IPPROTO_UDP) 
 			{
-				kfree_s((void *)sk, sizeof(*sk));
+				kmem_cache_free(sk_cachep, sk);
 				return(-EPROTONOSUPPORT);
 			}
 			protocol = IPPROTO_UDP;
@@ -585,12 +611,12 @@ static int inet_create(struct socket *sock, int protocol)
 		case SOCK_RAW:
 			if (!suser()) 
 			{
-				kfree_s((void *)sk, sizeof(*sk));
+				kmem_cache_free(sk_cachep, sk);
 				return(-EPERM);
 			}
 			if (!protocol) 
 			{
-				kfree_s((void *)sk, sizeof(*sk));
+				kmem_cache_free(sk_cachep, sk);
 				return(-EPROTONOSUPPORT);
 			}
 			prot = &raw_prot;
@@ -606,12 +632,12 @@ static int inet_create(struct socket *sock, int protocol)
 		case SOCK_PACKET:
 			if (!suser()) 
 			{
-				kfree_s((void *)sk, sizeof(*sk));
+				kmem_cache_free(sk_cachep, sk);
 				return(-EPERM);
 			}
 			if (!protocol) 
 			{
-				kfree_s((void *)sk, sizeof(*sk));
+				kmem_cache_free(sk_cachep, sk);
 				return(-EPROTONOSUPPORT);
 			}
 			prot = &packet_prot;
@@ -623,7 +649,7 @@ static int inet_create(struct socket *sock, int protocol)
 			break;
 
 		default:
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sk_cachep, sk);
 			return(-ESOCKTNOSUPPORT);
 	}
 	// sock结构体的socket字段指向上层的socket结构体
@@ -641,6 +667,10 @@ static int inet_create(struct socket *sock, int protocol)
 	sk->sndbuf = SK_WMEM_MAX;
 	sk->rcvbuf = SK_RMEM_MAX;
 	sk->pair = NULL;
+	sk->ip_rc = NULL;
+	sk->pk_ring = NULL;
+	sk->filter = NULL;
+	memset(&sk->pk_stats, 0, sizeof(sk->pk_stats));
 	sk->opt = NULL;
 	sk->write_seq = 0;
 	sk->acked_seq = 0;
@@ -688,6 +718,7 @@ static int inet_create(struct socket *sock, int protocol)
 	skb_queue_head_init(&sk->write_queue);
 	skb_queue_head_init(&sk->receive_queue);
 	sk->mtu = 576;
+	sk->pmtu_clamp = 0;
 	// 下层的操作函数集
 	sk->prot = prot;
 	// 来自socket结构体的wait字段，wait字段来自inode的wait字段
@@ -729,6 +760,8 @@ static int inet_create(struct socket *sock, int protocol)
 	sk->ip_mc_ttl=1;
 	*sk->ip_mc_name=0;
 	sk->ip_mc_list=NULL;
+	sk->ip_mc_bound=0;
+	sk->ip_mc_wild=0;
 #endif
   	// 下面两个函数用于阻塞型的网络函数被阻塞时，一旦底层条件符合，则回调下面的函数通知上层，即唤醒进程
 	sk->state_change = def_callback1;
@@ -1524,19 +1557,32 @@ struct sock *get_sock_mcast(struct sock *sk,
 	{
 		if (s->num != hnum) 
 			continue;
-		if(s->dead && (s->state == TCP_CLOSE))
-			continue;
-		if(s->daddr && s->daddr!=raddr)
-			continue;
-		if (s->dummy_th.dest != rnum && s->dummy_th.dest != 0) 
-			continue;
- 		if(s->saddr  && s->saddr!=laddr)
+		if (!sock_mcast_match(s, raddr, rnum, laddr))
 			continue;
 		return(s);
   	}
   	return(NULL);
 }
 
+/*
+ *	Would this socket, already known to be on the right port, take a
+ *	multicast/broadcast datagram with these addresses?
+ */
+
+int sock_mcast_match(struct sock *s, unsigned long raddr,
+			unsigned short rnum, unsigned long laddr)
+{
+	if(s->dead && (s->state == TCP_CLOSE))
+		return 0;
+	if(s->daddr && s->daddr!=raddr)
+		return 0;
+	if (s->dummy_th.dest != rnum && s->dummy_th.dest != 0) 
+		return 0;
+	if(s->saddr  && s->saddr!=laddr)
+		return 0;
+	return 1;
+}
+
 #endif
 
 static struct proto_ops inet_proto_ops = {
@@ -1563,10 +1609,13 @@ static struct proto_ops inet_proto_ops = {
 	inet_setsockopt,
 	inet_getsockopt,
 	inet_fcntl,
+	inet_mmap,
 };
 
 extern unsigned long seq_offset;
 
+kmem_cache_t *sk_cachep;
+
 /*
  *	Called by socket.c on kernel startup.  
  */
@@ -1587,6 +1636,12 @@ void inet_proto_init(struct net_proto *pro)
 
   	seq_offset = CURRENT_TIME*250;
 
+	skb_init();
+	sk_cachep = kmem_cache_create("sock", sizeof(struct sock),
+		SLAB_HWCACHE_ALIGN, NULL);
+	if (!sk_cachep)
+		panic("cannot create sock cache");
+
 	/*
 	 *	Add all the protocols. 
 	 */
@@ -212,6 +212,7 @@ static void arp_check_expire(unsigned long dummy)
 				*pentry = entry->next;	/* remove from list */
 				del_timer(&entry->timer);	/* Paranoia */
 				kfree_s(entry, sizeof(struct arp_table));
+				rt_stamp++;
 			}
 			else
 				pentry = &entry->next;	/* go to next entry */
@@ -250,6 +251,7 @@ static void arp_release_entry(struct arp_table *entry)
 	restore_flags(flags);
 	del_timer(&entry->timer);
 	kfree_s(entry, sizeof(struct arp_table));
+	rt_stamp++;
 	return;
 }
 
@@ -283,6 +285,7 @@ int arp_device_event(unsigned long event, void *ptr)
 				*pentry = entry->next;	/* remove from list */
 				del_timer(&entry->timer);	/* Paranoia */
 				kfree_s(entry, sizeof(struct arp_table));
+				rt_stamp++;
 			}
 			else
 				pentry = &entry->next;	/* go to next entry */
@@ -740,6 +743,8 @@ int arp_rcv(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
 /*
  *	Entry found; update it.
  */
+		if (memcmp(entry->ha, sha, hlen))
+			rt_stamp++;
 		memcpy(entry->ha, sha, hlen);
 		entry->hlen = hlen;
 		entry->last_used = jiffies;
@@ -1152,6 +1157,7 @@ static int arp_req_set(struct arpreq *req)
 	
 	memcpy(&entry->ha, &r.arp_ha.sa_data, hlen);
 	entry->last_used = jiffies;
+	rt_stamp++;
 	entry->flags = r.arp_flags | ATF_COM;
 	if ((entry->flags & ATF_PUBL) && (entry->flags & ATF_NETMASK))
 	  {
@@ -65,6 +65,7 @@ restart:
 		if (sk->shutdown & RCV_SHUTDOWN)
 		{
 			release_sock(sk);
+			wake_up_interruptible(sk->sleep);
 			*err=0;
 			return NULL;
 		}
@@ -72,6 +73,7 @@ restart:
 		if(sk->err)
 		{
 			release_sock(sk);
+			wake_up_interruptible(sk->sleep);
 			*err=-sk->err;
 			sk->err=0;
 			return NULL;
@@ -99,10 +101,20 @@ restart:
 		cli();
 		if (skb_peek(&sk->receive_queue) == NULL)
 		{
-			interruptible_sleep_on(sk->sleep);
+			/*
+			 *	Each datagram is for one reader, so only one
+			 *	is woken per packet. A peek leaves it there for
+			 *	the others, and anyone who leaves without a
+			 *	datagram passes the wake up on.
+			 */
+			if (flags & MSG_PEEK)
+				interruptible_sleep_on(sk->sleep);
+			else
+				interruptible_sleep_on_exclusive(sk->sleep);
 			/* Signals may need a restart of the syscall */
 			if (current->signal & ~current->blocked)
 			{
+				wake_up_interruptible(sk->sleep);
 				restore_flags(intflags);;
 				*err=-ERESTARTSYS;
 				return(NULL);
@@ -111,6 +123,7 @@ restart:
 						   eg an icmp sent earlier by the
 						   peer has finally turned up now */
 			{
+				wake_up_interruptible(sk->sleep);
 				*err = -sk->err;
 				sk->err=0;
 				restore_flags(intflags);
@@ -161,11 +174,53 @@ void skb_free_datagram(struct sk_buff *skb)
 	restore_flags(flags);
 }
 
+/*
+ *	Copy a datagram to user space. A reassembled datagram may be a chain
+ *	of fragment buffers; offset counts from h.raw across the whole chain.
+ */
+
 void skb_copy_datagram(struct sk_buff *skb, int offset, char *to, int size)
 {
-	/* We will know all about the fraglist options to allow >4K receives
-	   but not this release */
-	memcpy_tofs(to,skb->h.raw+offset,size);
+	struct sk_buff *frag;
+	unsigned char *from, *end;
+	int n;
+
+	if(skb->fraglist==NULL)
+	{
+		memcpy_tofs(to,skb->h.raw+offset,size);
+		return;
+	}
+
+	from=skb->h.raw+offset;
+	end=((unsigned char *)skb->ip_hdr)+skb->fraglen;
+	if(from<end)
+	{
+		n=end-from;
+		if(n>size)
+			n=size;
+		memcpy_tofs(to,from,n);
+		to+=n;
+		size-=n;
+		offset=0;
+	}
+	else
+		offset=from-end;
+
+	for(frag=skb->fraglist;frag!=NULL && size>0;frag=frag->fraglist)
+	{
+		if(offset>=frag->fraglen)
+		{
+			offset-=frag->fraglen;
+			continue;
+		}
+		n=frag->fraglen-offset;
+		if(n>size)
+			n=size;
+		memcpy_tofs(to,frag->h.raw+offset,n);
+		to+=n;
+		size-=n;
+		offset=0;
+	}
 }
 
 /*
@@ -411,7 +411,26 @@ void dev_queue_xmit(struct sk_buff *skb, struct device *dev, int pri)
 			   ((struct sock *)ptype->data != skb->sk))
 			{
 				struct sk_buff *skb2;
-				if ((skb2 = skb_clone(skb, GFP_ATOMIC)) == NULL)
+				if (ptype->tap)
+				{
+					/* Looks but does not keep: no copy needed */
+					skb->len-=dev->hard_header_len;
+					ptype->tap(skb, dev, ptype);
+					skb->len+=dev->hard_header_len;
+					nitcount--;
+					continue;
+				}
+				/*
+				 *	A buffer the sender keeps (TCP, for
+				 *	retransmission) may be rewritten later,
+				 *	so the tap gets a copy of that rather
+				 *	than a share.
+				 */
+				if (skb->free)
+					skb2 = skb_clone(skb, GFP_ATOMIC);
+				else
+					skb2 = skb_copy(skb, GFP_ATOMIC);
+				if (skb2 == NULL)
 					break;
 				/*
 				 *	The protocol knows this has (for other paths) been taken off
@@ -721,6 +740,15 @@ void net_bh(void *tmp)
 		{
 			if ((ptype->type == type || ptype->type == htons(ETH_P_ALL)) && (!ptype->dev || ptype->dev==skb->dev))
 			{
+				/*
+				 *	A tap only looks at the frame, so it can
+				 *	have it without a copy of its own.
+				 */
+				if(ptype->tap)
+				{
+					ptype->tap(skb, skb->dev, ptype);
+					continue;
+				}
 				/*
 				 *	We already have a match queued. Deliver
 				 *	to it and then remember the new match
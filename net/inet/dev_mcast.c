@@ -53,6 +53,83 @@
  */
  
 
+/*
+ *	Which of the DEV_MC_HASH_SIZE chains an address lives on. Group
+ *	addresses share their leading bytes, so fold them all in.
+ */
+
+static int dev_mc_hash(void *addr, int alen)
+{
+	unsigned char *p=(unsigned char *)addr;
+	unsigned int h=0;
+	while(alen-->0)
+		h=(h<<1)^*p++;
+	return (h^(h>>5))&(DEV_MC_HASH_SIZE-1);
+}
+
+/*
+ *	The hardware hash filter bit an address selects: the top six bits
+ *	of its Ethernet CRC, fed in low bit first as it goes on the wire.
+ */
+
+static int dev_mc_filter_bit(void *addr, int alen)
+{
+	unsigned char *p=(unsigned char *)addr;
+	unsigned long crc=0xFFFFFFFF;
+	int bit;
+	while(alen-->0)
+	{
+		unsigned char c=*p++;
+		for(bit=0;bit<8;bit++,c>>=1)
+			crc=(crc<<1)^((((crc>>31)^c)&1)?0x04C11DB7:0);
+	}
+	return (crc>>26)&63;
+}
+
+/*
+ *	Count an address in or out of the hash filter. Returns 1 if this
+ *	flipped a bit of the filter.
+ */
+
+static int dev_mc_filter_count(struct dev_mc_table *t, void *addr, int alen, int add)
+{
+	int bit=dev_mc_filter_bit(addr,alen);
+	if(add)
+	{
+		if(t->filter_users[bit]++)
+			return 0;
+		t->filter[bit>>3]|=(1<<(bit&7));
+	}
+	else
+	{
+		if(--t->filter_users[bit])
+			return 0;
+		t->filter[bit>>3]&=~(1<<(bit&7));
+	}
+	return 1;
+}
+
+/*
+ *	Find an entry. Without a table (we ran out of memory making it)
+ *	the plain list still works.
+ */
+
+static struct dev_mc_list *dev_mc_find(struct device *dev, void *addr, int alen)
+{
+	struct dev_mc_list *dmi;
+	
+	if(dev->mc_table!=NULL)
+		dmi=dev->mc_table->hash[dev_mc_hash(addr,alen)];
+	else
+		dmi=dev->mc_list;
+	for(;dmi!=NULL;dmi=(dev->mc_table!=NULL)?dmi->hash_next:dmi->next)
+	{
+		if(dmi->dmi_addrlen==alen && memcmp(dmi->dmi_addr,addr,alen)==0)
+			return dmi;
+	}
+	return NULL;
+}
+
 /*
  *	Update the multicast list into the physical NIC controller.
  */
@@ -87,6 +164,14 @@ void dev_mc_upload(struct device *dev)
 		return;
 	}
 	
+	/*
+	 *	A hash filter is loaded before multicast reception is
+	 *	switched on, so the card never runs with a stale one.
+	 */
+	 
+	if(dev->set_multicast_filter!=NULL && dev->mc_table!=NULL)
+		dev->set_multicast_filter(dev, dev->mc_table->filter);
+	
 	data=kmalloc(dev->mc_count*dev->addr_len, GFP_KERNEL);
 	if(data==NULL)
 	{
@@ -103,6 +188,24 @@ void dev_mc_upload(struct device *dev)
 	dev->set_multicast_list(dev,dev->mc_count,data);
 	kfree(data);
 }
+
+/*
+ *	One address came or went. A card with a hash filter only needs the
+ *	filter reloading, and only if a bit of it flipped - unless the list
+ *	just became empty or non-empty, which changes its receive mode.
+ */
+
+static void dev_mc_update(struct device *dev, int bit_changed, int mode_changed)
+{
+	if(dev->set_multicast_filter==NULL || dev->mc_table==NULL || mode_changed)
+	{
+		dev_mc_upload(dev);
+		return;
+	}
+	if(!bit_changed || !(dev->flags&IFF_UP) || (dev->flags&IFF_PROMISC))
+		return;
+	dev->set_multicast_filter(dev, dev->mc_table->filter);
+}
   
 /*
  *	Delete a device level multicast
@@ -110,21 +213,27 @@ void dev_mc_upload(struct device *dev)
 // 删除多播组信息 
 void dev_mc_delete(struct device *dev, void *addr, int alen, int all)
 {
-	struct dev_mc_list **dmi;
-	for(dmi=&dev->mc_list;*dmi!=NULL;dmi=&(*dmi)->next)
+	struct dev_mc_list *dmi, **hp;
+	int changed=0;
+	
+	dmi=dev_mc_find(dev,addr,alen);
+	if(dmi==NULL)
+		return;
+	if(--dmi->dmi_users && !all)
+		return;
+	*dmi->pprev=dmi->next;
+	if(dmi->next!=NULL)
+		dmi->next->pprev=dmi->pprev;
+	if(dev->mc_table!=NULL)
 	{
-		if(memcmp((*dmi)->dmi_addr,addr,(*dmi)->dmi_addrlen)==0 && alen==(*dmi)->dmi_addrlen)
-		{
-			struct dev_mc_list *tmp= *dmi;
-			if(--(*dmi)->dmi_users && !all)
-				return;
-			*dmi=(*dmi)->next;
-			dev->mc_count--;
-			kfree_s(tmp,sizeof(*tmp));
-			dev_mc_upload(dev);
-			return;
-		}
+		for(hp=&dev->mc_table->hash[dev_mc_hash(addr,alen)];*hp!=dmi;hp=&(*hp)->hash_next)
+			;
+		*hp=dmi->hash_next;
+		changed=dev_mc_filter_count(dev->mc_table,addr,alen,0);
 	}
+	dev->mc_count--;
+	kfree_s(dmi,sizeof(*dmi));
+	dev_mc_update(dev, changed, dev->mc_count==0);
 }
 
 /*
@@ -134,14 +243,24 @@ void dev_mc_delete(struct device *dev, void *addr, int alen, int all)
 void dev_mc_add(struct device *dev, void *addr, int alen, int newonly)
 {
 	struct dev_mc_list *dmi;
-	for(dmi=dev->mc_list;dmi!=NULL;dmi=dmi->next)
+	int changed=0;
+	
+	dmi=dev_mc_find(dev,addr,alen);
+	if(dmi!=NULL)
+	{
+		if(!newonly)
+			dmi->dmi_users++;
+		return;
+	}
+	/*
+	 *	The table is made on first use. Only the list holds entries
+	 *	made before it, so it can only be made while that is empty.
+	 */
+	if(dev->mc_table==NULL && dev->mc_list==NULL)
 	{
-		if(memcmp(dmi->dmi_addr,addr,dmi->dmi_addrlen)==0 && dmi->dmi_addrlen==alen)
-		{
-			if(!newonly)
-				dmi->dmi_users++;
-			return;
-		}
+		dev->mc_table=(struct dev_mc_table *)kmalloc(sizeof(struct dev_mc_table),GFP_KERNEL);
+		if(dev->mc_table!=NULL)
+			memset(dev->mc_table,0,sizeof(struct dev_mc_table));
 	}
 	dmi=(struct dev_mc_list *)kmalloc(sizeof(*dmi),GFP_KERNEL);
 	if(dmi==NULL)
@@ -149,10 +268,20 @@ void dev_mc_add(struct device *dev, void *addr, int alen, int newonly)
 	memcpy(dmi->dmi_addr, addr, alen);
 	dmi->dmi_addrlen=alen;
 	dmi->next=dev->mc_list;
+	if(dmi->next!=NULL)
+		dmi->next->pprev=&dmi->next;
+	dmi->pprev=&dev->mc_list;
 	dmi->dmi_users=1;
 	dev->mc_list=dmi;
+	if(dev->mc_table!=NULL)
+	{
+		int h=dev_mc_hash(addr,alen);
+		dmi->hash_next=dev->mc_table->hash[h];
+		dev->mc_table->hash[h]=dmi;
+		changed=dev_mc_filter_count(dev->mc_table,addr,alen,1);
+	}
 	dev->mc_count++;
-	dev_mc_upload(dev);
+	dev_mc_update(dev, changed, dev->mc_count==1);
 }
 
 /*
@@ -168,5 +297,9 @@ void dev_mc_discard(struct device *dev)
 		kfree_s(tmp,sizeof(*tmp));
 	}
 	dev->mc_count=0;
+	if(dev->mc_table!=NULL)
+	{
+		kfree_s(dev->mc_table,sizeof(struct dev_mc_table));
+		dev->mc_table=NULL;
+	}
 }
-
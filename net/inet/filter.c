@@ -0,0 +1,351 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		Socket filter. A small BPF style interpreter that is run over
+ *		each frame before a SOCK_PACKET socket clones and queues it,
+ *		so that a monitor only pays for the frames it wants.
+ *
+ * Version:	@(#)filter.c	1.0.0	10/18/95
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/errno.h>
+#include <linux/socket.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/malloc.h>
+#include <linux/filter.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+#include "ip.h"
+#include "protocol.h"
+#include <linux/skbuff.h>
+#include "sock.h"
+
+/*
+ *	Fetch a big endian halfword/word from the frame. The frame has no
+ *	particular alignment so we go a byte at a time.
+ */
+
+static inline unsigned long load_w(unsigned char *p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) |
+		((unsigned long) p[2] << 8) | p[3];
+}
+
+static inline unsigned long load_h(unsigned char *p)
+{
+	return ((unsigned long) p[0] << 8) | p[1];
+}
+
+/*
+ *	Run a checked filter over LEN bytes of DATA. Returns how many bytes
+ *	of the frame to keep, 0 meaning drop it. Loads beyond the end of the
+ *	frame end the program with 0, like BSD.
+ */
+
+unsigned int sk_run_filter(unsigned char *data, int len, struct sock_filter *filter, int flen)
+{
+	struct sock_filter *fentry;
+	unsigned long A = 0;		/* accumulator */
+	unsigned long X = 0;		/* index register */
+	unsigned long mem[BPF_MEMWORDS];
+	unsigned long k;
+	int pc;
+
+	memset(mem, 0, sizeof(mem));
+	for (pc = 0; pc < flen; pc++)
+	{
+		fentry = &filter[pc];
+
+		switch (fentry->code)
+		{
+			case BPF_ALU|BPF_ADD|BPF_X:	A += X; continue;
+			case BPF_ALU|BPF_ADD|BPF_K:	A += fentry->k; continue;
+			case BPF_ALU|BPF_SUB|BPF_X:	A -= X; continue;
+			case BPF_ALU|BPF_SUB|BPF_K:	A -= fentry->k; continue;
+			case BPF_ALU|BPF_MUL|BPF_X:	A *= X; continue;
+			case BPF_ALU|BPF_MUL|BPF_K:	A *= fentry->k; continue;
+			case BPF_ALU|BPF_DIV|BPF_X:
+				if (X == 0)
+					return(0);
+				A /= X;
+				continue;
+			case BPF_ALU|BPF_DIV|BPF_K:	A /= fentry->k; continue;
+			case BPF_ALU|BPF_AND|BPF_X:	A &= X; continue;
+			case BPF_ALU|BPF_AND|BPF_K:	A &= fentry->k; continue;
+			case BPF_ALU|BPF_OR|BPF_X:	A |= X; continue;
+			case BPF_ALU|BPF_OR|BPF_K:	A |= fentry->k; continue;
+			case BPF_ALU|BPF_LSH|BPF_X:	A <<= X; continue;
+			case BPF_ALU|BPF_LSH|BPF_K:	A <<= fentry->k; continue;
+			case BPF_ALU|BPF_RSH|BPF_X:	A >>= X; continue;
+			case BPF_ALU|BPF_RSH|BPF_K:	A >>= fentry->k; continue;
+			case BPF_ALU|BPF_NEG:		A = -A; continue;
+
+			case BPF_JMP|BPF_JA:		pc += fentry->k; continue;
+			case BPF_JMP|BPF_JGT|BPF_K:	pc += (A > fentry->k) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JGE|BPF_K:	pc += (A >= fentry->k) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JEQ|BPF_K:	pc += (A == fentry->k) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JSET|BPF_K:	pc += (A & fentry->k) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JGT|BPF_X:	pc += (A > X) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JGE|BPF_X:	pc += (A >= X) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JEQ|BPF_X:	pc += (A == X) ? fentry->jt : fentry->jf; continue;
+			case BPF_JMP|BPF_JSET|BPF_X:	pc += (A & X) ? fentry->jt : fentry->jf; continue;
+
+			case BPF_LD|BPF_W|BPF_ABS:
+				k = fentry->k;
+			load_w:
+				if (k + 4 > len || k + 4 < k)
+					return(0);
+				A = load_w(data + k);
+				continue;
+			case BPF_LD|BPF_H|BPF_ABS:
+				k = fentry->k;
+			load_h:
+				if (k + 2 > len || k + 2 < k)
+					return(0);
+				A = load_h(data + k);
+				continue;
+			case BPF_LD|BPF_B|BPF_ABS:
+				k = fentry->k;
+			load_b:
+				if (k >= len)
+					return(0);
+				A = data[k];
+				continue;
+			case BPF_LD|BPF_W|BPF_IND:
+				k = X + fentry->k;
+				goto load_w;
+			case BPF_LD|BPF_H|BPF_IND:
+				k = X + fentry->k;
+				goto load_h;
+			case BPF_LD|BPF_B|BPF_IND:
+				k = X + fentry->k;
+				goto load_b;
+			case BPF_LDX|BPF_B|BPF_MSH:
+				/* X = 4 * (data[k] & 0xf), the IP header length */
+				if (fentry->k >= len)
+					return(0);
+				X = (data[fentry->k] & 0xf) << 2;
+				continue;
+			case BPF_LD|BPF_W|BPF_LEN:	A = len; continue;
+			case BPF_LDX|BPF_W|BPF_LEN:	X = len; continue;
+			case BPF_LD|BPF_IMM:		A = fentry->k; continue;
+			case BPF_LDX|BPF_IMM:		X = fentry->k; continue;
+			case BPF_LD|BPF_MEM:		A = mem[fentry->k]; continue;
+			case BPF_LDX|BPF_MEM:		X = mem[fentry->k]; continue;
+
+			case BPF_MISC|BPF_TAX:		X = A; continue;
+			case BPF_MISC|BPF_TXA:		A = X; continue;
+
+			case BPF_RET|BPF_K:		return(fentry->k);
+			case BPF_RET|BPF_A:		return(A);
+
+			case BPF_ST:			mem[fentry->k] = A; continue;
+			case BPF_STX:			mem[fentry->k] = X; continue;
+
+			default:
+				/* sk_chk_filter() should have stopped this */
+				return(0);
+		}
+	}
+	return(0);
+}
+
+/*
+ *	Check a filter before we let it near a frame. It must be of sane
+ *	length, only use known opcodes, never divide by a constant 0, only
+ *	touch scratch memory that exists, only jump forward and inside the
+ *	program, and end with a return. Then it always terminates and never
+ *	reads outside the frame or its own stack.
+ */
+
+int sk_chk_filter(struct sock_filter *filter, int flen)
+{
+	struct sock_filter *ftest;
+	int pc;
+
+	if (flen <= 0 || flen > BPF_MAXINSNS)
+		return(-EINVAL);
+
+	for (pc = 0; pc < flen; pc++)
+	{
+		ftest = &filter[pc];
+
+		switch (BPF_CLASS(ftest->code))
+		{
+			case BPF_ALU:
+				switch (ftest->code & ~BPF_X)
+				{
+					case BPF_ALU|BPF_ADD: case BPF_ALU|BPF_SUB:
+					case BPF_ALU|BPF_MUL: case BPF_ALU|BPF_OR:
+					case BPF_ALU|BPF_AND: case BPF_ALU|BPF_LSH:
+					case BPF_ALU|BPF_RSH:
+						break;
+					case BPF_ALU|BPF_DIV:
+						if (BPF_SRC(ftest->code) == BPF_K && ftest->k == 0)
+							return(-EINVAL);
+						break;
+					case BPF_ALU|BPF_NEG:
+						if (ftest->code != (BPF_ALU|BPF_NEG))
+							return(-EINVAL);
+						break;
+					default:
+						return(-EINVAL);
+				}
+				break;
+
+			case BPF_JMP:
+				if (ftest->code == (BPF_JMP|BPF_JA))
+				{
+					if (ftest->k >= flen - pc - 1)
+						return(-EINVAL);
+					break;
+				}
+				switch (ftest->code & ~BPF_X)
+				{
+					case BPF_JMP|BPF_JEQ: case BPF_JMP|BPF_JGT:
+					case BPF_JMP|BPF_JGE: case BPF_JMP|BPF_JSET:
+						break;
+					default:
+						return(-EINVAL);
+				}
+				if (pc + ftest->jt + 1 >= flen || pc + ftest->jf + 1 >= flen)
+					return(-EINVAL);
+				break;
+
+			case BPF_LD:
+			case BPF_LDX:
+				switch (ftest->code)
+				{
+					case BPF_LD|BPF_W|BPF_ABS: case BPF_LD|BPF_H|BPF_ABS:
+					case BPF_LD|BPF_B|BPF_ABS: case BPF_LD|BPF_W|BPF_IND:
+					case BPF_LD|BPF_H|BPF_IND: case BPF_LD|BPF_B|BPF_IND:
+					case BPF_LDX|BPF_B|BPF_MSH:
+					case BPF_LD|BPF_W|BPF_LEN: case BPF_LDX|BPF_W|BPF_LEN:
+					case BPF_LD|BPF_IMM: case BPF_LDX|BPF_IMM:
+						break;
+					case BPF_LD|BPF_MEM: case BPF_LDX|BPF_MEM:
+						if (ftest->k >= BPF_MEMWORDS)
+							return(-EINVAL);
+						break;
+					default:
+						return(-EINVAL);
+				}
+				break;
+
+			case BPF_ST:
+			case BPF_STX:
+				if (ftest->code != BPF_ST && ftest->code != BPF_STX)
+					return(-EINVAL);
+				if (ftest->k >= BPF_MEMWORDS)
+					return(-EINVAL);
+				break;
+
+			case BPF_RET:
+				if (ftest->code != (BPF_RET|BPF_K) && ftest->code != (BPF_RET|BPF_A))
+					return(-EINVAL);
+				break;
+
+			case BPF_MISC:
+				if (ftest->code != (BPF_MISC|BPF_TAX) && ftest->code != (BPF_MISC|BPF_TXA))
+					return(-EINVAL);
+				break;
+		}
+	}
+
+	/* Falling off the end is not allowed */
+	if (BPF_CLASS(filter[flen - 1].code) != BPF_RET)
+		return(-EINVAL);
+	return(0);
+}
+
+/*
+ *	Attach a user supplied program to a socket (SO_ATTACH_FILTER). Only
+ *	SOCK_PACKET sockets run filters. Any old filter is replaced.
+ */
+
+int sk_attach_filter(struct sock *sk, char *optval, int optlen)
+{
+	struct sock_fprog fprog;
+	struct sk_filter *fp, *old;
+	unsigned long flags;
+	int fsize, err;
+
+	if (sk->type != SOCK_PACKET)
+		return(-EOPNOTSUPP);
+	if (optval == NULL || optlen < sizeof(fprog))
+		return(-EINVAL);
+	err = verify_area(VERIFY_READ, optval, sizeof(fprog));
+	if (err)
+		return(err);
+	memcpy_fromfs(&fprog, optval, sizeof(fprog));
+	if (fprog.filter == NULL || fprog.len == 0 || fprog.len > BPF_MAXINSNS)
+		return(-EINVAL);
+
+	fsize = fprog.len * sizeof(struct sock_filter);
+	err = verify_area(VERIFY_READ, fprog.filter, fsize);
+	if (err)
+		return(err);
+
+	fp = (struct sk_filter *) kmalloc(sizeof(*fp) + fsize, GFP_KERNEL);
+	if (fp == NULL)
+		return(-ENOMEM);
+	fp->len = fprog.len;
+	fp->insns = (struct sock_filter *) (fp + 1);
+	memcpy_fromfs(fp->insns, fprog.filter, fsize);
+
+	err = sk_chk_filter(fp->insns, fp->len);
+	if (err)
+	{
+		kfree_s(fp, sizeof(*fp) + fsize);
+		return(err);
+	}
+
+	save_flags(flags);
+	cli();
+	old = sk->filter;
+	sk->filter = fp;
+	restore_flags(flags);
+
+	if (old)
+		sk_free_filter(old);
+	return(0);
+}
+
+/*
+ *	Drop the filter (SO_DETACH_FILTER, and on close).
+ */
+
+int sk_detach_filter(struct sock *sk)
+{
+	struct sk_filter *old;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	old = sk->filter;
+	sk->filter = NULL;
+	restore_flags(flags);
+
+	if (old == NULL)
+		return(-ENOENT);
+	sk_free_filter(old);
+	return(0);
+}
+
+void sk_free_filter(struct sk_filter *fp)
+{
+	kfree_s(fp, sizeof(*fp) + fp->len * sizeof(struct sock_filter));
+}
@@ -30,6 +30,7 @@
  *		Alan Cox	:	Tightened up icmp_send().
  *		Alan Cox	:	Multicasts.
  *		Stefan Becker   :       ICMP redirects in icmp_send().
+ *					Token bucket limits on errors and replies.
  *
  * 
  *
@@ -72,6 +73,162 @@
 struct icmp_mib	icmp_statistics={0,};
 
 
+/*
+ *	Rate limits. Errors (anything sent by icmp_send) and replies to
+ *	queries each have a global token bucket and a small direct mapped
+ *	table of per destination buckets, checked before we spend anything
+ *	on building the message. A bucket earns `rate' tokens a second up to
+ *	`burst'; a rate of 0 turns that limit off. Credit is kept in
+ *	1/HZ token units so the sums stay in integers.
+ */
+
+#define ICMP_LIMIT_HOSTS	64		/* Must be a power of two */
+#define ICMP_LIMIT_MAX		100000		/* Largest rate or burst accepted */
+
+struct icmp_bucket
+{
+	unsigned long	addr;
+	unsigned long	credit;
+	unsigned long	stamp;
+};
+
+struct icmp_limit
+{
+	char			*name;
+	int			rate, burst;		/* For everybody together */
+	int			host_rate, host_burst;	/* For one destination */
+	struct icmp_bucket	total;
+	struct icmp_bucket	host[ICMP_LIMIT_HOSTS];
+};
+
+#define ICMP_LIMIT_ERRORS	0
+#define ICMP_LIMIT_REPLIES	1
+
+static struct icmp_limit icmp_limits[2] = {
+	{ "errors",  1000, 200, 20, 50 },
+	{ "replies", 1000, 200, 50, 100 }
+};
+
+/*
+ *	Take a token from a bucket if it has one.
+ */
+ 
+static int icmp_bucket_take(struct icmp_bucket *b, int rate, int burst)
+{
+	unsigned long gap;
+	
+	if(rate==0)
+		return 1;
+	gap=jiffies-b->stamp;
+	if(gap>60*HZ)
+		gap=60*HZ;	/* Keep gap*rate in range; it is full by then */
+	b->stamp=jiffies;
+	b->credit+=gap*rate;
+	if(b->credit>burst*HZ)
+		b->credit=burst*HZ;
+	if(b->credit<HZ)
+		return 0;
+	b->credit-=HZ;
+	return 1;
+}
+
+/*
+ *	May we send a message of this class to addr? A destination that
+ *	lost its slot in the table starts again with a full bucket; the
+ *	global bucket still holds a flood from many sources in check.
+ */
+
+static int icmp_limit_ok(int class, unsigned long addr)
+{
+	struct icmp_limit *l=&icmp_limits[class];
+	struct icmp_bucket *b;
+	unsigned long h=ntohl(addr);
+	
+	b=&l->host[(h^(h>>8)^(h>>16))&(ICMP_LIMIT_HOSTS-1)];
+	if(b->addr!=addr)
+	{
+		b->addr=addr;
+		b->credit=l->host_burst*HZ;
+		b->stamp=jiffies;
+	}
+	if(!icmp_bucket_take(b, l->host_rate, l->host_burst))
+		return 0;
+	return icmp_bucket_take(&l->total, l->rate, l->burst);
+}
+
+/*
+ *	/proc/net/icmp: show the limits, or set them by writing lines of
+ *	"<class> <rate> <burst> <host rate> <host burst>".
+ */
+ 
+int icmp_limit_get_info(char *buffer, char **start, off_t offset, int length)
+{
+	int len, i;
+	
+	len=sprintf(buffer,"Class    Rate   Burst  HostRate HostBurst Limited\n");
+	for(i=0;i<2;i++)
+	{
+		struct icmp_limit *l=&icmp_limits[i];
+		len+=sprintf(buffer+len,"%-8s %-6d %-6d %-8d %-9d %lu\n",
+			l->name, l->rate, l->burst, l->host_rate, l->host_burst,
+			i==ICMP_LIMIT_ERRORS ? icmp_statistics.IcmpOutErrorsLimited
+					     : icmp_statistics.IcmpOutRepliesLimited);
+	}
+	if(offset>=len)
+	{
+		*start=buffer;
+		return 0;
+	}
+	*start=buffer+offset;
+	len-=offset;
+	if(len>length)
+		len=length;
+	return len;
+}
+
+int icmp_limit_write(char *buffer, int count)
+{
+	char *p=buffer, *end;
+	unsigned long v[4];
+	unsigned long flags;
+	int i, n;
+	
+	while(*p)
+	{
+		while(*p==' ' || *p=='\t' || *p=='\n')
+			p++;
+		if(*p=='\0')
+			break;
+		for(i=0;i<2;i++)
+		{
+			n=strlen(icmp_limits[i].name);
+			if(strncmp(p,icmp_limits[i].name,n)==0 && (p[n]==' ' || p[n]=='\t'))
+				break;
+		}
+		if(i==2)
+			return -EINVAL;
+		p+=n;
+		for(n=0;n<4;n++)
+		{
+			while(*p==' ' || *p=='\t')
+				p++;
+			v[n]=simple_strtoul(p,&end,0);
+			if(end==p || v[n]>ICMP_LIMIT_MAX)
+				return -EINVAL;
+			p=end;
+		}
+		save_flags(flags);
+		cli();
+		icmp_limits[i].rate=v[0];
+		icmp_limits[i].burst=v[1];
+		icmp_limits[i].host_rate=v[2];
+		icmp_limits[i].host_burst=v[3];
+		restore_flags(flags);
+	}
+	return count;
+}
+
+
 /* An array of errno for error messages from dest unreach. */
 struct icmp_err icmp_err_convert[] = {
   { ENETUNREACH,	0 },	/*	ICMP_NET_UNREACH	*/
@@ -163,6 +320,19 @@ void icmp_send(struct sk_buff *skb_in, int type, int code, unsigned long info, s
 				return;
 		}
 	}
+	
+	/*
+	 *	Scans and floods must not turn into floods of errors. Fragmentation
+	 *	needed is left alone: path MTU discovery depends on every one of
+	 *	them getting through.
+	 */
+	 
+	if(!(type==ICMP_DEST_UNREACH && code==ICMP_FRAG_NEEDED) &&
+	   !icmp_limit_ok(ICMP_LIMIT_ERRORS, iph->saddr))
+	{
+		icmp_statistics.IcmpOutErrorsLimited++;
+		return;
+	}
 	icmp_statistics.IcmpOutMsgs++;
 	
 	/*
@@ -267,6 +437,29 @@ void icmp_send(struct sk_buff *skb_in, int type, int code, unsigned long info, s
 }
 
 
+/*
+ *	The MTU a fragmentation needed message reports. Routers before
+ *	RFC 1191 leave it 0, so step down the plateaus it suggests below
+ *	the size of the frame that failed.
+ */
+
+static unsigned short icmp_mtu_plateaus[] =
+	{ 32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, IP_PMTU_MIN };
+
+static unsigned short icmp_frag_mtu(struct icmphdr *icmph, struct iphdr *iph)
+{
+	unsigned short mtu = ntohs(icmph->un.echo.sequence);
+	unsigned short size = ntohs(iph->tot_len);
+	int i;
+
+	if (mtu != 0 && mtu < size)
+		return mtu;
+	for (i = 0; icmp_mtu_plateaus[i] > IP_PMTU_MIN; i++)
+		if (icmp_mtu_plateaus[i] < size)
+			break;
+	return icmp_mtu_plateaus[i];
+}
+
 /* 
  *	Handle ICMP_UNREACH and ICMP_QUENCH. 
  */
@@ -294,8 +487,13 @@ static void icmp_unreach(struct icmphdr *icmph, struct sk_buff *skb)
 		case ICMP_PORT_UNREACH:
 			break;
 		case ICMP_FRAG_NEEDED:
-			printk("ICMP: %s: fragmentation needed and DF set.\n",
-								in_ntoa(iph->daddr));
+			/*
+			 *	Path MTU discovery: the router says how big a
+			 *	frame gets through (RFC 1191) or, if it is older
+			 *	than that, we guess.
+			 */
+			if (icmph->type == ICMP_DEST_UNREACH && icmph->code == ICMP_FRAG_NEEDED)
+				ip_rt_pmtu(iph->daddr, icmp_frag_mtu(icmph, iph));
 			break;
 		case ICMP_SR_FAILED:
 			printk("ICMP: %s: Source Route Failed.\n", in_ntoa(iph->daddr));
@@ -415,6 +613,12 @@ static void icmp_echo(struct icmphdr *icmph, struct sk_buff *skb, struct device
 	struct device *ndev=NULL;
 	int size, offset;
 
+	if(!icmp_limit_ok(ICMP_LIMIT_REPLIES, saddr))
+	{
+		icmp_statistics.IcmpOutRepliesLimited++;
+		kfree_skb(skb, FREE_READ);
+		return;
+	}
 	icmp_statistics.IcmpOutEchoReps++;
 	icmp_statistics.IcmpOutMsgs++;
 	
@@ -496,6 +700,13 @@ static void icmp_timestamp(struct icmphdr *icmph, struct sk_buff *skb, struct de
 			return;
 	}
 
+	if(!icmp_limit_ok(ICMP_LIMIT_REPLIES, saddr))
+	{
+		icmp_statistics.IcmpOutRepliesLimited++;
+		kfree_skb(skb, FREE_READ);
+		return;
+	}
+
 	size = dev->hard_header_len + 84;
 
 	if (! (skb2 = alloc_skb(size, GFP_ATOMIC))) 
@@ -584,6 +795,12 @@ static void icmp_address(struct icmphdr *icmph, struct sk_buff *skb, struct devi
 	int size, offset;
 	struct device *ndev=NULL;
 
+	if(!icmp_limit_ok(ICMP_LIMIT_REPLIES, saddr))
+	{
+		icmp_statistics.IcmpOutRepliesLimited++;
+		kfree_skb(skb, FREE_READ);
+		return;
+	}
 	icmp_statistics.IcmpOutMsgs++;
 	icmp_statistics.IcmpOutAddrMaskReps++;
 	
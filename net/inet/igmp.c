@@ -32,11 +32,100 @@
 #include "route.h"
 #include <linux/skbuff.h>
 #include "sock.h"
+#include "udp.h"
 #include <linux/igmp.h>
 
 #ifdef CONFIG_IP_MULTICAST
 
 
+static int random(void)
+{
+	static unsigned long seed=152L;
+	seed=seed*69069L+1;
+	return seed^jiffies;
+}
+
+/*
+ *	Per device state, made when the device gets its first group. If
+ *	that fails the group list is walked and reports go out at once.
+ */
+
+static void igmp_timer_expire(unsigned long data);
+
+static struct ip_mc_dev *igmp_dev_state(struct device *dev)
+{
+	struct ip_mc_dev *md=dev->ip_mc_dev;
+	
+	if(md!=NULL || dev->ip_mc_list!=NULL)
+		return md;
+	md=(struct ip_mc_dev *)kmalloc(sizeof(*md), GFP_KERNEL);
+	if(md==NULL)
+		return NULL;
+	memset(md,0,sizeof(*md));
+	md->dev=dev;
+	init_timer(&md->timer);
+	md->timer.data=(unsigned long)md;
+	md->timer.function=&igmp_timer_expire;
+	dev->ip_mc_dev=md;
+	return md;
+}
+
+/*
+ *	Find a group this device is in.
+ */
+
+struct ip_mc_list *ip_mc_find(struct device *dev, unsigned long addr)
+{
+	struct ip_mc_list *im;
+	
+	if(dev->ip_mc_dev!=NULL)
+	{
+		for(im=dev->ip_mc_dev->hash[ip_mc_hash(addr)];im!=NULL;im=im->hash_next)
+			if(im->multiaddr==addr)
+				return im;
+		return NULL;
+	}
+	for(im=dev->ip_mc_list;im!=NULL;im=im->next)
+		if(im->multiaddr==addr)
+			return im;
+	return NULL;
+}
+
+/*
+ *	Put a new group on the device list and in the hash.
+ */
+
+static void igmp_link_group(struct device *dev, struct ip_mc_list *im)
+{
+	struct ip_mc_dev *md=dev->ip_mc_dev;
+	
+	im->tm_running=0;
+	im->next=dev->ip_mc_list;
+	dev->ip_mc_list=im;
+	if(md!=NULL)
+	{
+		int h=ip_mc_hash(im->multiaddr);
+		im->hash_next=md->hash[h];
+		md->hash[h]=im;
+	}
+}
+
+static void igmp_unlink_hash(struct device *dev, struct ip_mc_list *im)
+{
+	struct ip_mc_list **imp;
+	
+	if(dev->ip_mc_dev==NULL)
+		return;
+	for(imp=&dev->ip_mc_dev->hash[ip_mc_hash(im->multiaddr)];*imp!=NULL;imp=&(*imp)->hash_next)
+	{
+		if(*imp==im)
+		{
+			*imp=im->hash_next;
+			return;
+		}
+	}
+}
+
 /*
  *	Timer management
  */
@@ -44,27 +133,57 @@
 // 关闭定时器 
 static void igmp_stop_timer(struct ip_mc_list *im)
 {
-	del_timer(&im->timer);
-	im->tm_running=0;
+	struct ip_mc_dev *md=im->interface->ip_mc_dev;
+	unsigned long flags;
+	
+	save_flags(flags);
+	cli();
+	if(im->tm_running)
+	{
+		*im->tm_pprev=im->tm_next;
+		if(im->tm_next!=NULL)
+			im->tm_next->tm_pprev=im->tm_pprev;
+		im->tm_running=0;
+		if(--md->pending_count==0)
+			del_timer(&md->timer);
+	}
+	restore_flags(flags);
 }
 
-static int random(void)
-{
-	static unsigned long seed=152L;
-	seed=seed*69069L+1;
-	return seed^jiffies;
-}
+static void igmp_send_report(struct device *dev, unsigned long address, int type);
 
 // 开启一个定时器
 static void igmp_start_timer(struct ip_mc_list *im)
 {
+	struct ip_mc_dev *md=im->interface->ip_mc_dev;
+	struct ip_mc_list **slot;
+	unsigned long flags;
 	int tv;
+	
 	if(im->tm_running)
 		return;
-	tv=random()%(10*HZ);		/* Pick a number any number 8) */
-	im->timer.expires=tv;
+	if(md==NULL)
+	{
+		igmp_send_report(im->interface, im->multiaddr, IGMP_HOST_MEMBERSHIP_REPORT);
+		return;
+	}
+	tv=((unsigned)random())%IGMP_TIMER_SLOTS;	/* Pick a number any number 8) */
+	save_flags(flags);
+	cli();
+	slot=&md->pending[(md->slot+tv)%IGMP_TIMER_SLOTS];
+	im->tm_next=*slot;
+	if(im->tm_next!=NULL)
+		im->tm_next->tm_pprev=&im->tm_next;
+	im->tm_pprev=slot;
+	*slot=im;
+	im->tm_when=jiffies+(tv+1)*IGMP_TICK;
 	im->tm_running=1;
-	add_timer(&im->timer);
+	if(md->pending_count++==0)
+	{
+		md->timer.expires=IGMP_TICK;
+		add_timer(&md->timer);
+	}
+	restore_flags(flags);
 }
  
 /*
@@ -100,29 +219,38 @@ static void igmp_send_report(struct device *dev, unsigned long address, int type
 	ip_queue_xmit(NULL,dev,skb,1);
 }
 
-// 
-static void igmp_timer_expire(unsigned long data)
-{
-	struct ip_mc_list *im=(struct ip_mc_list *)data;
-	igmp_stop_timer(im);
-	igmp_send_report(im->interface, im->multiaddr, IGMP_HOST_MEMBERSHIP_REPORT);
-}
+/*
+ *	The wheel turns: report every group due in this slot.
+ */
 
-static void igmp_init_timer(struct ip_mc_list *im)
+static void igmp_timer_expire(unsigned long data)
 {
-	im->tm_running=0;
-	init_timer(&im->timer);
-	im->timer.data=(unsigned long)im;
-	im->timer.function=&igmp_timer_expire;
+	struct ip_mc_dev *md=(struct ip_mc_dev *)data;
+	struct ip_mc_list *im;
+	
+	while((im=md->pending[md->slot])!=NULL)
+	{
+		md->pending[md->slot]=im->tm_next;
+		if(im->tm_next!=NULL)
+			im->tm_next->tm_pprev=&md->pending[md->slot];
+		im->tm_running=0;
+		md->pending_count--;
+		igmp_send_report(im->interface, im->multiaddr, IGMP_HOST_MEMBERSHIP_REPORT);
+	}
+	md->slot=(md->slot+1)%IGMP_TIMER_SLOTS;
+	if(md->pending_count)
+	{
+		md->timer.expires=IGMP_TICK;
+		add_timer(&md->timer);
+	}
 }
 	
 // 收到其他组成员，对于多播路由查询报文的回复，则自己就不用回复了，因为多播路由知道该组还有成员，不会删除路由信息，减少网络流量
 static void igmp_heard_report(struct device *dev, unsigned long address)
 {
-	struct ip_mc_list *im;
-	for(im=dev->ip_mc_list;im!=NULL;im=im->next)
-		if(im->multiaddr==address)
-			igmp_stop_timer(im);
+	struct ip_mc_list *im=ip_mc_find(dev,address);
+	if(im!=NULL)
+		igmp_stop_timer(im);
 }
 // 处理组播路由的查询报文，开启定时器，超时后回复
 static void igmp_heard_query(struct device *dev)
@@ -179,7 +307,7 @@ void ip_mc_filter_del(struct device *dev, unsigned long addr)
 // 退出多播组
 static void igmp_group_dropped(struct ip_mc_list *im)
 {
-	del_timer(&im->timer);
+	igmp_stop_timer(im);
 	igmp_send_report(im->interface, im->multiaddr, IGMP_HOST_LEAVE_MESSAGE);
 	ip_mc_filter_del(im->interface, im->multiaddr);
 /*	printk("Left group %lX\n",im->multiaddr);*/
@@ -187,8 +315,6 @@ static void igmp_group_dropped(struct ip_mc_list *im)
 // 加入多播组
 static void igmp_group_added(struct ip_mc_list *im)
 {
-	// 初始化定时器
-	igmp_init_timer(im);
 	// 发送一个igmp数据包
 	igmp_send_report(im->interface, im->multiaddr, IGMP_HOST_MEMBERSHIP_REPORT);
 	// 转换多播组ip到多播mac地址，并记录到设备中
@@ -230,14 +356,13 @@ static void ip_mc_inc_group(struct device *dev, unsigned long addr)
 {
 	struct ip_mc_list *i;
 	// 遍历该设置维护的多播组队列，判断是否已经有socket加入过该多播组，是则引用数加一
-	for(i=dev->ip_mc_list;i!=NULL;i=i->next)
+	i=ip_mc_find(dev,addr);
+	if(i!=NULL)
 	{
-		if(i->multiaddr==addr)
-		{
-			i->users++;
-			return;
-		}
+		i->users++;
+		return;
 	}
+	igmp_dev_state(dev);
 	// 到这说明，还没有socket加入过当前多播组，则记录并加入
 	i=(struct ip_mc_list *)kmalloc(sizeof(*i), GFP_KERNEL);
 	if(!i)
@@ -245,10 +370,9 @@ static void ip_mc_inc_group(struct device *dev, unsigned long addr)
 	i->users=1;
 	i->interface=dev;
 	i->multiaddr=addr;
-	i->next=dev->ip_mc_list;
+	igmp_link_group(dev,i);
 	// 通过igmp通知其他方
 	igmp_group_added(i);
-	dev->ip_mc_list=i;
 }
 
 /*
@@ -269,7 +393,9 @@ static void ip_mc_dec_group(struct device *dev, unsigned long addr)
 				struct ip_mc_list *tmp= *i;
 				igmp_group_dropped(tmp);
 				*i=(*i)->next;
+				igmp_unlink_hash(dev,tmp);
 				kfree_s(tmp,sizeof(*tmp));
+				return;
 			}
 		}
 	}
@@ -283,6 +409,12 @@ void ip_mc_drop_device(struct device *dev)
 {
 	struct ip_mc_list *i;
 	struct ip_mc_list *j;
+	if(dev->ip_mc_dev!=NULL)
+	{
+		del_timer(&dev->ip_mc_dev->timer);
+		kfree_s(dev->ip_mc_dev,sizeof(struct ip_mc_dev));
+		dev->ip_mc_dev=NULL;
+	}
 	for(i=dev->ip_mc_list;i!=NULL;i=j)
 	{
 		j=i->next;
@@ -298,21 +430,61 @@ void ip_mc_drop_device(struct device *dev)
 void ip_mc_allhost(struct device *dev)
 {
 	struct ip_mc_list *i;
-	for(i=dev->ip_mc_list;i!=NULL;i=i->next)
-		if(i->multiaddr==IGMP_ALL_HOSTS)
-			return;
+	if(ip_mc_find(dev,IGMP_ALL_HOSTS)!=NULL)
+		return;
+	igmp_dev_state(dev);
 	i=(struct ip_mc_list *)kmalloc(sizeof(*i), GFP_KERNEL);
 	if(!i)
 		return;
 	i->users=1;
 	i->interface=dev;
 	i->multiaddr=IGMP_ALL_HOSTS;
-	i->next=dev->ip_mc_list;
-	dev->ip_mc_list=i;
+	igmp_link_group(dev,i);
 	ip_mc_filter_add(i->interface, i->multiaddr);
 
 }	
  
+/*
+ *	The group -> socket index used for delivery. Entries live in the
+ *	socket's ip_mc_socklist and are linked in while the slot is in use.
+ */
+
+struct ip_mc_member *ip_mc_members[IP_MC_MEMBER_HASH];
+
+static void ip_mc_member_link(struct ip_mc_member *m, struct sock *sk,
+	struct device *dev, unsigned long addr)
+{
+	struct ip_mc_member **mp = &ip_mc_members[ip_mc_member_hash(addr)];
+	unsigned long flags;
+
+	m->multiaddr = addr;
+	m->interface = dev;
+	m->sk = sk;
+	save_flags(flags);
+	cli();
+	m->next = *mp;
+	*mp = m;
+	restore_flags(flags);
+}
+
+static void ip_mc_member_unlink(struct ip_mc_member *m)
+{
+	struct ip_mc_member **mp = &ip_mc_members[ip_mc_member_hash(m->multiaddr)];
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	for (; *mp != NULL; mp = &(*mp)->next)
+	{
+		if (*mp == m)
+		{
+			*mp = m->next;
+			break;
+		}
+	}
+	restore_flags(flags);
+}
+
 /*
  *	Join a socket to a group
  */
@@ -345,6 +517,8 @@ int ip_mc_join_group(struct sock *sk , struct device *dev, unsigned long addr)
 		return -ENOBUFS;
 	sk->ip_mc_list->multiaddr[unused]=addr;
 	sk->ip_mc_list->multidev[unused]=dev;
+	ip_mc_member_link(&sk->ip_mc_list->member[unused], sk, dev, addr);
+	udp_mc_update(sk);
 	// addr为多播组ip
 	ip_mc_inc_group(dev,addr);
 	return 0;
@@ -368,7 +542,9 @@ int ip_mc_leave_group(struct sock *sk, struct device *dev, unsigned long addr)
 	{
 		if(sk->ip_mc_list->multiaddr[i]==addr && sk->ip_mc_list->multidev[i]==dev)
 		{
+			ip_mc_member_unlink(&sk->ip_mc_list->member[i]);
 			sk->ip_mc_list->multidev[i]=NULL;
+			udp_mc_update(sk);
 			ip_mc_dec_group(dev,addr);
 			return 0;
 		}
@@ -391,12 +567,14 @@ void ip_mc_drop_socket(struct sock *sk)
 	{
 		if(sk->ip_mc_list->multidev[i])
 		{
+			ip_mc_member_unlink(&sk->ip_mc_list->member[i]);
 			ip_mc_dec_group(sk->ip_mc_list->multidev[i], sk->ip_mc_list->multiaddr[i]);
 			sk->ip_mc_list->multidev[i]=NULL;
 		}
 	}
 	kfree_s(sk->ip_mc_list,sizeof(*sk->ip_mc_list));
 	sk->ip_mc_list=NULL;
+	udp_mc_update(sk);
 }
 
 #endif
@@ -94,6 +94,7 @@
 #include <linux/kernel.h>
 #include <linux/sched.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/errno.h>
 #include <linux/config.h>
@@ -104,6 +105,7 @@
 #include <linux/inet.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
+#include <linux/if_arp.h>
 
 #include "snmp.h"
 #include "ip.h"
@@ -345,6 +347,12 @@ int ip_build_header(struct sk_buff *skb, unsigned long saddr, unsigned long dadd
 	iph->tos      = tos;
 	// 分片和偏移
 	iph->frag_off = 0;
+	/*
+	 *	TCP does path MTU discovery: its segments may not be split on
+	 *	the way, so a router too small for them has to tell us.
+	 */
+	if (type == IPPROTO_TCP && skb->sk != NULL)
+		iph->frag_off = htons(IP_DF);
 	// 跳数
 	iph->ttl      = ttl;
 	iph->daddr    = daddr;
@@ -365,6 +373,82 @@ int ip_build_header(struct sk_buff *skb, unsigned long saddr, unsigned long dadd
 }
 
 
+/*
+ *	Fill in a route cache for sends from saddr to daddr. This does the
+ *	work ip_build_header() would otherwise repeat for every frame. The
+ *	stamp is taken first so a change racing with us leaves it stale.
+ */
+
+int ip_rc_fill(struct ip_route_cache *rc, unsigned long saddr,
+	unsigned long daddr, int type)
+{
+	struct rtable *rt;
+	struct iphdr *iph;
+	unsigned long src;
+
+	rc->rc_stamp = rt_stamp;
+	rc->rc_dev = NULL;
+	rc->rc_hh_len = -1;
+
+	rt = ip_rt_route(daddr, NULL, &src);
+	if (rt == NULL)
+		return(-ENETUNREACH);
+
+	if (saddr == 0 || (LOOPBACK(saddr) && !LOOPBACK(daddr)))
+		saddr = src;
+
+	rc->rc_dev = rt->rt_dev;
+	rc->rc_raddr = rt->rt_gateway ? rt->rt_gateway : daddr;
+
+	iph = &rc->rc_iph;
+	memset(iph, 0, sizeof(*iph));
+	iph->version  = 4;
+	iph->ihl      = 5;
+	iph->protocol = type;
+	iph->saddr    = saddr;
+	iph->daddr    = daddr;
+
+	ip_rc_resolve(rc);
+	return(0);
+}
+
+/*
+ *	Try to finish the hardware header of a route cache. Returns 1 once
+ *	it is complete. Only plain unicast ARP lookups are done here; for
+ *	anything else arp_find() wants an skb, so we leave those to the
+ *	normal output path.
+ */
+
+int ip_rc_resolve(struct ip_route_cache *rc)
+{
+	struct device *dev = rc->rc_dev;
+	int mac;
+
+	if (dev == NULL)
+		return 0;
+	if (rc->rc_hh_len >= 0)
+		return 1;
+	if (dev->hard_header == NULL)
+	{
+		rc->rc_hh_len = 0;
+		return 1;
+	}
+	mac = dev->hard_header(rc->rc_hh, dev, ETH_P_IP, NULL, NULL, 0, NULL);
+	if (mac < 0)
+	{
+		if (dev->type != ARPHRD_ETHER && dev->type != ARPHRD_IEEE802)
+			return 0;
+		if (ip_chk_addr(rc->rc_raddr) != 0)
+			return 0;
+		if (dev->rebuild_header(rc->rc_hh, dev, rc->rc_raddr, NULL))
+			return 0;
+		mac = -mac;
+	}
+	rc->rc_hh_len = mac;
+	return 1;
+}
+
+
 static int
 do_options(struct iphdr *iph, struct options *opt)
 {
@@ -580,6 +664,8 @@ void ip_send_check(struct iphdr *iph)
  */
 
 static struct ipq *ipqueue = NULL;		/* IP fragment queue	*/
+static kmem_cache_t *ipq_cachep;		/* queue descriptors	*/
+static kmem_cache_t *ipfrag_cachep;		/* fragment entries	*/
 
 /*
  *	Create a new fragment entry.
@@ -589,7 +675,7 @@ static struct ipfrag *ip_frag_create(int offset, int end, struct sk_buff *skb, u
 {
 	struct ipfrag *fp;
 
-	fp = (struct ipfrag *) kmalloc(sizeof(struct ipfrag), GFP_ATOMIC);
+	fp = (struct ipfrag *) kmem_cache_alloc(ipfrag_cachep, GFP_ATOMIC);
 	if (fp == NULL)
 	{
 		printk("IP: frag_create: no memory left !\n");
@@ -685,9 +771,13 @@ static void ip_free(struct ipq *qp)
 	while (fp != NULL)
 	{
 		xp = fp->next;
-		IS_SKB(fp->skb);
-		kfree_skb(fp->skb,FREE_READ);
-		kfree_s(fp, sizeof(struct ipfrag));
+		/* ip_glue() takes the buffers it chains */
+		if (fp->skb != NULL)
+		{
+			IS_SKB(fp->skb);
+			kfree_skb(fp->skb,FREE_READ);
+		}
+		kmem_cache_free(ipfrag_cachep, fp);
 		fp = xp;
 	}
 	// 删除mac头和ip头，8字节是icmp用的，存放传输层的前8个字节
@@ -698,7 +788,7 @@ static void ip_free(struct ipq *qp)
 	kfree_s(qp->iph, qp->ihlen + 8);
 
 	/* Finally, release the queue descriptor itself. */
-	kfree_s(qp, sizeof(struct ipq));
+	kmem_cache_free(ipq_cachep, qp);
 	sti();
 }
 
@@ -746,7 +836,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
 	int maclen;
 	int ihlen;
 	// 分片一个新的表示分片队列的节点
-	qp = (struct ipq *) kmalloc(sizeof(struct ipq), GFP_ATOMIC);
+	qp = (struct ipq *) kmem_cache_alloc(ipq_cachep, GFP_ATOMIC);
 	if (qp == NULL)
 	{
 		printk("IP: create: no memory left !\n");
@@ -767,7 +857,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
 	if (qp->mac == NULL)
 	{
 		printk("IP: create: no memory left !\n");
-		kfree_s(qp, sizeof(struct ipq));
+		kmem_cache_free(ipq_cachep, qp);
 		return(NULL);
 	}
 
@@ -781,7 +871,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
 	{
 		printk("IP: create: no memory left !\n");
 		kfree_s(qp->mac, maclen);
-		kfree_s(qp, sizeof(struct ipq));
+		kmem_cache_free(ipq_cachep, qp);
 		return(NULL);
 	}
 
@@ -858,78 +948,84 @@ static int ip_done(struct ipq *qp)
 /*
  *	Build a new IP datagram from all its fragments.
  *
- *	FIXME: We copy here because we lack an effective way of handling lists
- *	of bits on input. Until the new skb data handling is in I'm not going
- *	to touch this with a bargepole. This also causes a 4Kish limit on
- *	packet sizes.
+ *	Nothing is copied. The buffer holding the first fragment becomes the
+ *	head of the datagram and the other fragment buffers are chained
+ *	behind it, each sliced down to the part of the data it contributes
+ *	(see skbuff.h). Protocols that cannot walk a chain get it flattened
+ *	by ip_rcv().
  */
 // 重组成功后构造完整的ip报文
 static struct sk_buff *ip_glue(struct ipq *qp)
 {
 	struct sk_buff *skb;
+	struct sk_buff *tail;
 	struct iphdr *iph;
 	struct ipfrag *fp;
-	unsigned char *ptr;
-	int count, len;
+	int count, ihl;
 
 	/*
-	 *	Allocate a new buffer for the datagram.
+	 *	Check the pieces add up before taking any of them.
 	 */
-	// 整个包的长度等于mac头长度+ip头长度+数据长度
-	len = qp->maclen + qp->ihlen + qp->len;
-	// 分配新的skb	
-	if ((skb = alloc_skb(len,GFP_ATOMIC)) == NULL)
+
+	count = 0;
+	for (fp = qp->fragments; fp != NULL; fp = fp->next)
 	{
-		ip_statistics.IpReasmFails++;
-		printk("IP: queue_glue: no memory for gluing queue 0x%X\n", (int) qp);
+		if (fp->len > 0)
+			count += fp->len;
+	}
+	fp = qp->fragments;
+	if (count != qp->len || fp->offset != 0)
+	{
+		printk("Invalid fragment list: Fragment over size.\n");
 		ip_free(qp);
-		return(NULL);
+		ip_statistics.IpReasmFails++;
+		return NULL;
 	}
 
-	/* Fill in the basic details. */
-	// 这里应该是等于qp->len？
-	skb->len = (len - qp->maclen);
-	skb->h.raw = skb->data; // data字段指向新分配的内存首地址
-	skb->free = 1;
-
-	/* Copy the original MAC and IP headers into the new buffer. */
-	ptr = (unsigned char *) skb->h.raw;
-	memcpy(ptr, ((unsigned char *) qp->mac), qp->maclen); // 把mac头复制到新的内存
-	ptr += qp->maclen;
-	memcpy(ptr, ((unsigned char *) qp->iph), qp->ihlen); // 把ip头复制到新的内存
-	ptr += qp->ihlen; // 指向数据部分的首地址
-	skb->h.raw += qp->maclen;// 指向ip头首地址
+	/*
+	 *	The first fragment's buffer is the head. Its own IP header
+	 *	is the one carrying all the options.
+	 */
 
-	count = 0;
+	skb = fp->skb;
+	fp->skb = NULL;
+	skb = skb_unshare(skb, GFP_ATOMIC, FREE_READ);	/* We rewrite its header */
+	if (skb == NULL)
+	{
+		ip_free(qp);
+		ip_statistics.IpReasmFails++;
+		return NULL;
+	}
+	iph = skb->h.iph;
+	ihl = iph->ihl * sizeof(unsigned long);
+	skb->fraglen = ihl + fp->len;
+	skb->fraglist = NULL;
+	skb->free = 1;
+	tail = skb;
 
-	/* Copy the data portions of all fragments into the new buffer. */
-	fp = qp->fragments;
-	// 开始复制数据部分
-	while(fp != NULL)
-	{	// 如果当前节点的数据长度+已经复制的内容长度大于skb->len则说明内容溢出了，丢弃该数据包
-		if(count+fp->len > skb->len)
-		{
-			printk("Invalid fragment list: Fragment over size.\n");
-			ip_free(qp);
-			kfree_skb(skb,FREE_WRITE);
-			ip_statistics.IpReasmFails++;
-			return NULL;
-		}
-		// 把分片中的数据复制到对应偏移的位置 
-		memcpy((ptr + fp->offset), fp->ptr, fp->len);
-		// 已复制的数据长度
-		count += fp->len;
-		fp = fp->next;
+	/* Chain the rest, in order. Fully overlapped pieces are left for ip_free */
+	for (fp = fp->next; fp != NULL; fp = fp->next)
+	{
+		if (fp->len <= 0)
+			continue;
+		tail->fraglist = fp->skb;
+		tail = fp->skb;
+		fp->skb = NULL;
+		tail->h.raw = fp->ptr;
+		tail->fraglen = fp->len;
+		tail->fraglist = NULL;
+		tail->sk = NULL;
+		tail->free = 1;
 	}
 
-	/* We glued together all fragments, so remove the queue entry. */
-	ip_free(qp);// 数据复制完后可以释放分片队列了
+	/* We took all the buffers we need, so remove the queue entry. */
+	ip_free(qp);
 
-	/* Done with all fragments. Fixup the new IP header. */
-	iph = skb->h.iph; // 上面的raw字段指向了ip头首地址，skb->h.iph等价于raw字段的值
+	/* Done with all fragments. Fixup the head's IP header. */
 	iph->frag_off = 0; // 清除分片字段
 	// 更新总长度为ip头+数据的长度
-	iph->tot_len = htons((iph->ihl * sizeof(unsigned long)) + count);
+	iph->tot_len = htons(ihl + count);
+	skb->len = ihl + count;
 	skb->ip_hdr = iph;
 
 	ip_statistics.IpReasmOKs++;
@@ -1056,6 +1152,18 @@ static struct sk_buff *ip_defrag(struct iphdr *iph, struct sk_buff *skb, struct
 		ptr += i;	/* ptr into fragment data */
 	}
 
+	/*
+	 *	Nothing new in this one (a duplicate, or wholly inside the
+	 *	fragment before it).
+	 */
+
+	if (offset >= end)
+	{
+		skb->sk = NULL;
+		kfree_skb(skb, FREE_READ);
+		return NULL;
+	}
+
 	/*
 	 * Look for overlap with succeeding segments.
 	 * If we can merge fragments, do it.
@@ -1090,7 +1198,7 @@ static struct sk_buff *ip_defrag(struct iphdr *iph, struct sk_buff *skb, struct
 				next->next->prev = next->prev;
 
 			kfree_skb(next->skb,FREE_READ);
-			kfree_s(next, sizeof(struct ipfrag));
+			kmem_cache_free(ipfrag_cachep, next);
 		}
 	}
 
@@ -1195,7 +1303,7 @@ void ip_fragment(struct sock *sk, struct sk_buff *skb, struct device *dev, int i
 		 *	Reply giving the MTU of the failed hop.
 		 */
 		ip_statistics.IpFragFails++;
-		icmp_send(skb,ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, dev->mtu, dev);
+		icmp_send(skb,ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, htonl(dev->mtu), dev);
 		return;
 	}
 
@@ -1208,7 +1316,7 @@ void ip_fragment(struct sock *sk, struct sk_buff *skb, struct device *dev, int i
 	if(mtu<8)
 	{
 		/* It's wrong but it's better than nothing */
-		icmp_send(skb,ICMP_DEST_UNREACH,ICMP_FRAG_NEEDED,dev->mtu, dev);
+		icmp_send(skb,ICMP_DEST_UNREACH,ICMP_FRAG_NEEDED,htonl(dev->mtu), dev);
 		ip_statistics.IpFragFails++;
 		return;
 	}
@@ -1335,11 +1443,48 @@ void ip_fragment(struct sock *sk, struct sk_buff *skb, struct device *dev, int i
 
 #ifdef CONFIG_IP_FORWARD
 
+struct ip_fwd_stats ip_fwd_statistics;
+
 /*
- *	Forward an IP datagram to its next destination.
+ *	Forwarding flow cache. A flow is (saddr, daddr, tos, arrival device)
+ *	and remembers the output device, first hop and link header, and
+ *	which firewall entry let it through, so a datagram of a known flow
+ *	costs one probe instead of a firewall walk, two route lookups and
+ *	an ARP search. The table is direct mapped: a colliding flow just
+ *	takes the slot over. Entries die when rt_stamp moves on, which
+ *	happens on any route, ARP or firewall change.
  */
 
-static void ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
+#define IP_FLOW_SIZE	256		/* Must be a power of two */
+
+struct ip_flow
+{
+	unsigned long		fl_saddr;
+	unsigned long		fl_daddr;
+	struct device		*fl_in;		/* Arrival device, NULL if unused */
+	unsigned char		fl_tos;
+#ifdef CONFIG_IP_FIREWALL
+	struct ip_fw		*fl_rule;	/* Deciding entry, NULL for the policy */
+#endif
+	struct ip_route_cache	fl_rc;		/* Output device, first hop, header */
+};
+
+static struct ip_flow ip_flow_cache[IP_FLOW_SIZE];
+
+static inline struct ip_flow *ip_flow_slot(struct iphdr *iph)
+{
+	unsigned long h = iph->saddr ^ iph->daddr ^ iph->tos;
+
+	h ^= h >> 16;
+	return &ip_flow_cache[(h ^ (h >> 8)) & (IP_FLOW_SIZE - 1)];
+}
+
+/*
+ *	Forward an IP datagram to its next destination. Returns 1 if the
+ *	buffer itself went out and the caller must not free it.
+ */
+
+static int ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
 {
 	struct device *dev2;	/* Output device */
 	struct iphdr *iph;	/* Our header */
@@ -1347,19 +1492,46 @@ static void ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
 	struct rtable *rt;	/* Route we use */
 	unsigned char *ptr;	/* Data pointer */
 	unsigned long raddr;	/* Router IP address */
-	
+	unsigned long check;	/* Header checksum being adjusted */
+	unsigned long stamp;	/* Route generation we looked up under */
+	struct ip_flow *fl;	/* Flow cache slot */
+	int hit;		/* Slot holds this flow */
+	int len;		/* Datagram length */
+#ifdef CONFIG_IP_FIREWALL
+	struct ip_fw *rule;
+	int flow, err;
+#endif
+
+	iph = skb->h.iph;
+	stamp = rt_stamp;
+	fl = ip_flow_slot(iph);
+	hit = (fl->fl_in == dev && fl->fl_rc.rc_stamp == stamp &&
+		fl->fl_saddr == iph->saddr && fl->fl_daddr == iph->daddr &&
+		fl->fl_tos == iph->tos);
+	if (hit)
+		ip_fwd_statistics.FwdFlowHits++;
+	else
+		ip_fwd_statistics.FwdFlowMisses++;
+
 	/* 
 	 *	See if we are allowed to forward this.
 	 */
 
 #ifdef CONFIG_IP_FIREWALL
-	int err;
-	
-	if((err=ip_fw_chk(skb->h.iph, dev, ip_fw_fwd_chain, ip_fw_fwd_policy, 0))!=1)
+	if (hit)
+	{
+		/* Count it as ip_fw_chk() would have */
+		if (fl->fl_rule != NULL)
+		{
+			fl->fl_rule->fw_bcnt += ntohs(iph->tot_len);
+			fl->fl_rule->fw_pcnt++;
+		}
+	}
+	else if((err=ip_fw_chk_flow(iph, dev, ip_fw_fwd_chain, ip_fw_fwd_policy, &rule, &flow))!=1)
 	{
 		if(err==-1)
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_HOST_UNREACH, 0, dev);
-		return;
+		return 0;
 	}
 #endif
 	/*
@@ -1373,76 +1545,109 @@ static void ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
 	 *	sometimes VERY important.
 	 */
 
-	iph = skb->h.iph;
 	iph->ttl--;
 	if (iph->ttl <= 0)
 	{
 		/* Tell the sender its packet died... */
 		icmp_send(skb, ICMP_TIME_EXCEEDED, ICMP_EXC_TTL, 0, dev);
-		return;
+		return 0;
 	}
 
 	/*
-	 *	Re-compute the IP header checksum.
-	 *	This is inefficient. We know what has happened to the header
-	 *	and could thus adjust the checksum as Phil Karn does in KA9Q
+	 *	Adjust the IP header checksum for the TTL change rather than
+	 *	recomputing it (RFC 1624). TTL is the high byte of its 16 bit
+	 *	word, so the header sum dropped by 0x0100 and the stored
+	 *	complement goes up by the same amount, end-around carry and all.
 	 */
 
-	ip_send_check(iph);
-
-	/*
-	 * OK, the packet is still valid.  Fetch its destination address,
-	 * and give it to the IP sender for further processing.
-	 */
+	check = iph->check;
+	check += htons(0x0100);
+	iph->check = check + (check >= 0xFFFF);
 
-	rt = ip_rt_route(iph->daddr, NULL, NULL);
-	if (rt == NULL)
+	if (hit)
+	{
+		dev2 = fl->fl_rc.rc_dev;
+		raddr = fl->fl_rc.rc_raddr;
+	}
+	else
 	{
 		/*
-		 *	Tell the sender its packet cannot be delivered. Again
-		 *	ICMP is screened later.
+		 * OK, the packet is still valid.  Fetch its destination address,
+		 * and give it to the IP sender for further processing.
 		 */
-		icmp_send(skb, ICMP_DEST_UNREACH, ICMP_NET_UNREACH, 0, dev);
-		return;
-	}
-
 
-	/*
-	 * Gosh.  Not only is the packet valid; we even know how to
-	 * forward it onto its final destination.  Can we say this
-	 * is being plain lucky?
-	 * If the router told us that there is no GW, use the dest.
-	 * IP address itself- we seem to be connected directly...
-	 */
+		rt = ip_rt_route(iph->daddr, NULL, NULL);
+		if (rt == NULL)
+		{
+			/*
+			 *	Tell the sender its packet cannot be delivered. Again
+			 *	ICMP is screened later.
+			 */
+			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_NET_UNREACH, 0, dev);
+			return 0;
+		}
 
-	raddr = rt->rt_gateway;
 
-	if (raddr != 0)
-	{
 		/*
-		 *	There is a gateway so find the correct route for it.
-		 *	Gateways cannot in turn be gatewayed.
+		 * Gosh.  Not only is the packet valid; we even know how to
+		 * forward it onto its final destination.  Can we say this
+		 * is being plain lucky?
+		 * If the router told us that there is no GW, use the dest.
+		 * IP address itself- we seem to be connected directly...
 		 */
-		rt = ip_rt_route(raddr, NULL, NULL);
-		if (rt == NULL)
+
+		raddr = rt->rt_gateway;
+
+		if (raddr != 0)
 		{
 			/*
-			 *	Tell the sender its packet cannot be delivered...
+			 *	There is a gateway so find the correct route for it.
+			 *	Gateways cannot in turn be gatewayed.
 			 */
-			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_HOST_UNREACH, 0, dev);
-			return;
+			rt = ip_rt_route(raddr, NULL, NULL);
+			if (rt == NULL)
+			{
+				/*
+				 *	Tell the sender its packet cannot be delivered...
+				 */
+				icmp_send(skb, ICMP_DEST_UNREACH, ICMP_HOST_UNREACH, 0, dev);
+				return 0;
+			}
+			if (rt->rt_gateway != 0)
+				raddr = rt->rt_gateway;
 		}
-		if (rt->rt_gateway != 0)
-			raddr = rt->rt_gateway;
-	}
-	else
-		raddr = iph->daddr;
+		else
+			raddr = iph->daddr;
 
-	/*
-	 *	Having picked a route we can now send the frame out.
-	 */
+		/*
+		 *	Having picked a route we can now send the frame out.
+		 */
+
+		dev2 = rt->rt_dev;
 
-	dev2 = rt->rt_dev;
+		/*
+		 *	Remember the flow, unless the firewall verdict might
+		 *	differ for its next datagram.
+		 */
+
+#ifdef CONFIG_IP_FIREWALL
+		if (flow)
+#endif
+		{
+			fl->fl_saddr = iph->saddr;
+			fl->fl_daddr = iph->daddr;
+			fl->fl_tos = iph->tos;
+			fl->fl_in = dev;
+#ifdef CONFIG_IP_FIREWALL
+			fl->fl_rule = rule;
+#endif
+			fl->fl_rc.rc_stamp = stamp;
+			fl->fl_rc.rc_dev = dev2;
+			fl->fl_rc.rc_raddr = raddr;
+			fl->fl_rc.rc_hh_len = -1;
+			hit = 1;
+		}
+	}
 
 	/*
 	 *	In IP you never have to forward a frame on the interface that it 
@@ -1451,27 +1656,42 @@ static void ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
 	 */
 #ifdef CONFIG_IP_NO_ICMP_REDIRECT
 	if (dev == dev2)
-		return;
+		return 0;
 #else
 	if (dev == dev2 && (iph->saddr&dev->pa_mask) == (iph->daddr & dev->pa_mask))
 		icmp_send(skb, ICMP_REDIRECT, ICMP_REDIR_HOST, raddr, dev);
 #endif		
 
 	/*
-	 * We now allocate a new buffer, and copy the datagram into it.
 	 * If the indicated interface is up and running, kick it.
 	 */
 
-	if (dev2->flags & IFF_UP)
+	if (!(dev2->flags & IFF_UP))
+		return 0;
+
+	len = skb->len;
+	if (skb->h.raw - skb->data == dev2->hard_header_len)
 	{
+		/*
+		 *	The new link header is exactly as long as the one the
+		 *	frame came in with, so the datagram is already where
+		 *	dev2 wants it. Send the received buffer itself and just
+		 *	write the new link header over the old one.
+		 */
 
+		skb2 = skb;
+		skb2->free = 1;
+		skb2->len = len + dev2->hard_header_len;
+		ip_fwd_statistics.FwdInPlace++;
+	}
+	else
+	{
 		/*
-		 *	Current design decrees we copy the packet. For identical header
-		 *	lengths we could avoid it. The new skb code will let us push
-		 *	data so the problem goes away then.
+		 *	The headers differ in size: copy the datagram into a
+		 *	buffer laid out for dev2.
 		 */
 
-		skb2 = alloc_skb(dev2->hard_header_len + skb->len, GFP_ATOMIC);
+		skb2 = alloc_skb(dev2->hard_header_len + len, GFP_ATOMIC);
 		/*
 		 *	This is rare and since IP is tolerant of network failures
 		 *	quite harmless.
@@ -1479,57 +1699,70 @@ static void ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
 		if (skb2 == NULL)
 		{
 			printk("\nIP: No memory available for IP forward\n");
-			return;
+			return 0;
 		}
 		ptr = skb2->data;
 		skb2->free = 1;
-		skb2->len = skb->len + dev2->hard_header_len;
+		skb2->len = len + dev2->hard_header_len;
 		skb2->h.raw = ptr;
 
 		/*
 		 *	Copy the packet data into the new buffer.
 		 */
-		memcpy(ptr + dev2->hard_header_len, skb->h.raw, skb->len);
+		memcpy(ptr + dev2->hard_header_len, skb->h.raw, len);
+		ip_fwd_statistics.FwdCopied++;
+	}
 
-		/* Now build the MAC header. */
-		(void) ip_send(skb2, raddr, skb->len, dev2, dev2->pa_addr);
+	/*
+	 *	Now build the MAC header, straight from the flow cache once
+	 *	the first hop is resolved.
+	 */
 
-		ip_statistics.IpForwDatagrams++;
+	if (hit && ip_rc_resolve(&fl->fl_rc))
+	{
+		memcpy(skb2->data, fl->fl_rc.rc_hh, fl->fl_rc.rc_hh_len);
+		skb2->dev = dev2;
+		skb2->arp = 1;
+	}
+	else
+		(void) ip_send(skb2, raddr, len, dev2, dev2->pa_addr);
 
-		/*
-		 *	See if it needs fragmenting. Note in ip_rcv we tagged
-		 *	the fragment type. This must be right so that
-		 *	the fragmenter does the right thing.
-		 */
+	ip_statistics.IpForwDatagrams++;
 
-		if(skb2->len > dev2->mtu + dev2->hard_header_len)
-		{
-			ip_fragment(NULL,skb2,dev2, is_frag);
-			kfree_skb(skb2,FREE_WRITE);
-		}
-		else
-		{
+	/*
+	 *	See if it needs fragmenting. Note in ip_rcv we tagged
+	 *	the fragment type. This must be right so that
+	 *	the fragmenter does the right thing.
+	 */
+
+	if(skb2->len > dev2->mtu + dev2->hard_header_len)
+	{
+		ip_fragment(NULL,skb2,dev2, is_frag);
+		kfree_skb(skb2,FREE_WRITE);
+	}
+	else
+	{
 #ifdef CONFIG_IP_ACCT		
-			/*
-			 *	Count mapping we shortcut
-			 */
-			 
-			ip_acct_cnt(iph,dev,ip_acct_chain);
+		/*
+		 *	Count mapping we shortcut
+		 */
+		 
+		ip_acct_cnt(iph,dev,ip_acct_chain);
 #endif			
-			
-			/*
-			 *	Map service types to priority. We lie about
-			 *	throughput being low priority, but it's a good
-			 *	choice to help improve general usage.
-			 */
-			if(iph->tos & IPTOS_LOWDELAY)
-				dev_queue_xmit(skb2, dev2, SOPRI_INTERACTIVE);
-			else if(iph->tos & IPTOS_THROUGHPUT)
-				dev_queue_xmit(skb2, dev2, SOPRI_BACKGROUND);
-			else
-				dev_queue_xmit(skb2, dev2, SOPRI_NORMAL);
-		}
+		
+		/*
+		 *	Map service types to priority. We lie about
+		 *	throughput being low priority, but it's a good
+		 *	choice to help improve general usage.
+		 */
+		if(iph->tos & IPTOS_LOWDELAY)
+			dev_queue_xmit(skb2, dev2, SOPRI_INTERACTIVE);
+		else if(iph->tos & IPTOS_THROUGHPUT)
+			dev_queue_xmit(skb2, dev2, SOPRI_BACKGROUND);
+		else
+			dev_queue_xmit(skb2, dev2, SOPRI_NORMAL);
 	}
+	return skb2 == skb;
 }
 
 
@@ -1539,6 +1772,26 @@ static void ip_forward(struct sk_buff *skb, struct device *dev, int is_frag)
  *	This function receives all incoming IP datagrams.
  */
 
+/*
+ *	Can a reassembled datagram be passed up as a fragment chain? Only if
+ *	no raw socket wants it and every protocol taking it has a fragment
+ *	handler.
+ */
+
+static int ip_chain_ok(struct iphdr *iph)
+{
+	struct inet_protocol *ipprot;
+
+	if(raw_prot.sock_array[iph->protocol & (SOCK_ARRAY_SIZE-1)]!=NULL)
+		return 0;
+	for (ipprot = (struct inet_protocol *)inet_protos[iph->protocol & (MAX_INET_PROTOS -1)];ipprot != NULL;ipprot=(struct inet_protocol *)ipprot->next)
+	{
+		if (ipprot->protocol == iph->protocol && ipprot->frag_handler == NULL)
+			return 0;
+	}
+	return 1;
+}
+
 int ip_rcv(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
 {
 	struct iphdr *iph = skb->h.iph;
@@ -1662,15 +1915,24 @@ int ip_rcv(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
 		 */
 
 #ifdef CONFIG_IP_FORWARD
-		ip_forward(skb, dev, is_frag);
+		/*
+		 *	The forwarder rewrites the frame in place, so it must
+		 *	not be sharing its data with a packet tap.
+		 */
+
+		skb=skb_unshare(skb, GFP_ATOMIC, FREE_WRITE);
+		if(skb==NULL)
+			return 0;
+		if (ip_forward(skb, dev, is_frag))
+			return(0);
 #else
 /*		printk("Machine %lx tried to use us as a forwarder to %lx but we have forwarding disabled!\n",
 			iph->saddr,iph->daddr);*/
 		ip_statistics.IpInAddrErrors++;
 #endif
 		/*
-		 *	The forwarder is inefficient and copies the packet. We
-		 *	free the original now.
+		 *	Unless the forwarder sent this very buffer on, it made a
+		 *	copy (or dropped the frame). We free the original now.
 		 */
 
 		kfree_skb(skb, FREE_WRITE);
@@ -1684,19 +1946,11 @@ int ip_rcv(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
 		/*
 		 *	Check it is for one of our groups
 		 */
-		struct ip_mc_list *ip_mc=dev->ip_mc_list;
-		do
-		{
-			if(ip_mc==NULL)
-			{	
-				kfree_skb(skb, FREE_WRITE);
-				return 0;
-			}
-			if(ip_mc->multiaddr==iph->daddr)
-				break;
-			ip_mc=ip_mc->next;
+		if(ip_mc_find(dev,iph->daddr)==NULL)
+		{	
+			kfree_skb(skb, FREE_WRITE);
+			return 0;
 		}
-		while(1);
 	}
 #endif
 	/*
@@ -1719,6 +1973,24 @@ int ip_rcv(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
 			return 0;
 		skb->dev = dev;
 		iph=skb->h.iph;
+
+		/*
+		 *	The datagram is a chain of the fragment buffers.
+		 *	Flatten it unless everyone it is going to can walk
+		 *	a chain.
+		 */
+
+		if(skb->fraglist && !ip_chain_ok(iph))
+		{
+			skb=skb_linearize(skb, GFP_ATOMIC);
+			if(skb==NULL)
+			{
+				ip_statistics.IpInDiscards++;
+				return 0;
+			}
+			skb->dev = dev;
+			iph=skb->h.iph;
+		}
 	}
 	
 		 
@@ -1807,7 +2079,12 @@ int ip_rcv(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
 		* based on the datagram protocol.  We should really
 		* check the protocol handler's return values here...
 		*/
-		ipprot->handler(skb2, dev, opts_p ? &opt : 0, iph->daddr,
+		if(skb2->fraglist)
+			ipprot->frag_handler(skb2, dev, opts_p ? &opt : 0, iph->daddr,
+				(ntohs(iph->tot_len) - (iph->ihl * 4)),
+				iph->saddr, 0, ipprot);
+		else
+			ipprot->handler(skb2, dev, opts_p ? &opt : 0, iph->daddr,
 				(ntohs(iph->tot_len) - (iph->ihl * 4)),
 				iph->saddr, 0, ipprot);
 
@@ -1919,6 +2196,15 @@ void ip_queue_xmit(struct sock *sk, struct device *dev,
 	// 整个ip头和数据的长度
 	iph->tot_len = ntohs(skb->len-dev->hard_header_len);
 
+	/*
+	 *	A segment built before the path MTU came down would only be
+	 *	bounced again: let it be fragmented instead.
+	 */
+	 
+	if ((iph->frag_off & htons(IP_DF)) && sk != NULL &&
+	    skb->len - dev->hard_header_len > sk->mtu + HEADER_SIZE)
+		iph->frag_off &= ~htons(IP_DF);
+
 #ifdef CONFIG_IP_FIREWALL
 	if(ip_fw_chk(iph, dev, ip_fw_blk_chain, ip_fw_blk_policy, 0) != 1)
 		/* just don't send this packet */
@@ -2043,16 +2329,8 @@ void ip_queue_xmit(struct sock *sk, struct device *dev,
 			else
 			{	
 				// 判断目的ip是否在当前设备的多播ip列表中，是的回传一份
-				struct ip_mc_list *imc=dev->ip_mc_list;
-				while(imc!=NULL)
-				{
-					if(imc->multiaddr==iph->daddr)
-					{
-						ip_loopback(dev,skb);
-						break;
-					}
-					imc=imc->next;
-				}
+				if(ip_mc_find(dev,iph->daddr)!=NULL)
+					ip_loopback(dev,skb);
 			}
 		}
 		/* Multicasts with ttl 0 must not go beyond the host */
@@ -2124,7 +2402,7 @@ int ip_mc_procinfo(char *buffer, char **start, off_t offset, int length)
                                 len+=sprintf(buffer+len,
 					"\t\t\t%08lX %5d %d:%08lX\n",
                                         im->multiaddr, im->users,
-					im->tm_running, im->timer.expires);
+					im->tm_running, im->tm_when);
                                 pos=begin+len;
                                 if(pos<offset)
                                 {
@@ -2523,6 +2801,11 @@ void ip_init(void)
 
 	/* So we flush routes when a device is downed */	
 	register_netdevice_notifier(&ip_rt_notifier);
+
+	ipq_cachep = kmem_cache_create("ipq", sizeof(struct ipq), 0, NULL);
+	ipfrag_cachep = kmem_cache_create("ipfrag", sizeof(struct ipfrag), 0, NULL);
+	if (!ipq_cachep || !ipfrag_cachep)
+		panic("cannot create IP fragment caches");
 /*	ip_raw_init();
 	ip_packet_init();
 	ip_tcp_init();
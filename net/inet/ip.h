@@ -22,6 +22,7 @@
 
 #include <linux/ip.h>
 #include <linux/config.h>
+#include <linux/netdevice.h>	/* MAX_HEADER */
 
 #ifndef _SNMP_H
 #include "snmp.h"
@@ -70,6 +71,21 @@ struct ipq	 {
   struct device *dev;		/* Device - for icmp replies */
 };
 
+/*
+ * Output path cached for one destination: the device, the finished
+ * hardware header and an IP header template.  Connected datagram
+ * sockets and the forwarding flow cache keep these.  It is only good
+ * while rc_stamp still matches rt_stamp.
+ */
+struct ip_route_cache {
+  unsigned long	rc_stamp;	/* rt_stamp when this was filled	*/
+  struct device	*rc_dev;	/* output device, NULL if unroutable	*/
+  unsigned long	rc_raddr;	/* first hop				*/
+  int		rc_hh_len;	/* hardware header length, -1 unresolved */
+  unsigned char	rc_hh[MAX_HEADER];	/* finished hardware header	*/
+  struct iphdr	rc_iph;		/* header template, saddr/daddr/protocol */
+};
+
 
 extern int		backoff(int n);
 
@@ -83,6 +99,10 @@ extern int		ip_build_header(struct sk_buff *skb,
 					struct device **dev, int type,
 					struct options *opt, int len,
 					int tos,int ttl);
+extern int		ip_rc_fill(struct ip_route_cache *rc,
+					unsigned long saddr,
+					unsigned long daddr, int type);
+extern int		ip_rc_resolve(struct ip_route_cache *rc);
 extern unsigned short	ip_compute_csum(unsigned char * buff, int len);
 extern int		ip_rcv(struct sk_buff *skb, struct device *dev,
 			       struct packet_type *pt);
@@ -97,6 +117,16 @@ extern void		ip_init(void);
 
 extern struct ip_mib	ip_statistics;
 
+/* Forwarding fast path counters, the "IpFwd:" lines of /proc/net/snmp */
+struct ip_fwd_stats {
+  unsigned long	FwdInPlace;	/* sent on in the buffer they arrived in */
+  unsigned long	FwdCopied;	/* copied into a new buffer		*/
+  unsigned long	FwdFlowHits;	/* found in the flow cache		*/
+  unsigned long	FwdFlowMisses;	/* needed the full lookups		*/
+};
+
+extern struct ip_fwd_stats	ip_fwd_statistics;
+
 /*
  *	This is a version of ip_compute_csum() optimized for IP headers, which
  *	always checksum on 4 octet boundaries.
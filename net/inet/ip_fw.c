@@ -150,10 +150,15 @@ extern inline int port_match(unsigned short *portptr,int nports,unsigned short p
  *	purposes (searches all entries and handles fragments different).
  *	If opt is set to 2, it doesn't count a matching packet, which
  *	is used when calling this for checking purposes (IP_FW_CHK_*).
+ *
+ *	If rule is given it is set to the deciding entry (NULL for the
+ *	policy), and *flow is cleared if a datagram of the same addresses
+ *	arriving on the same interface could get a different verdict, ie
+ *	the decision looked at protocol, ports or a fragment offset.
  */
 
-
-int ip_fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain, int policy, int opt)
+static int fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain,
+	int policy, int opt, struct ip_fw **rule, int *flow)
 {
 	struct ip_fw *f;
 	struct tcphdr		*tcp=(struct tcphdr *)((unsigned long *)ip+ip->ihl);
@@ -187,10 +192,19 @@ int ip_fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain, int pol
 	 *	of system.
 	 */
 
+	if (flow)
+		*flow = 1;
+	if (rule)
+		*rule = NULL;
+
 	frag1 = ((ntohs(ip->frag_off) & IP_OFFSET) == 0);
 	if (!frag1 && (opt != 1) && (ip->protocol == IPPROTO_TCP ||
 			ip->protocol == IPPROTO_UDP))
+	{
+		if (flow)
+			*flow = 0;
 		return(1);
+	}
 
 	src = ip->saddr;
 	dst = ip->daddr;
@@ -300,6 +314,9 @@ int ip_fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain, int pol
 		 *	Ok the chain addresses match.
 		 */
 
+		if (flow && (f->fw_flg & (IP_FW_F_KIND|IP_FW_F_PRN)))
+			*flow = 0;
+
 		f_prt=f->fw_flg&IP_FW_F_KIND;
 		if (f_prt!=IP_FW_F_ALL) 
 		{
@@ -390,6 +407,8 @@ int ip_fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain, int pol
 	 * of firewall.
 	 */
 
+	if (rule)
+		*rule = f;
 	if(f!=NULL)	/* A match was found */
 		f_flag=f->fw_flg;
 	else
@@ -401,6 +420,21 @@ int ip_fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain, int pol
 	return 0;
 }
 
+int ip_fw_chk(struct iphdr *ip, struct device *rif, struct ip_fw *chain, int policy, int opt)
+{
+	return fw_chk(ip, rif, chain, policy, opt, NULL, NULL);
+}
+
+/*
+ *	ip_fw_chk() for the forwarding flow cache, see fw_chk() above.
+ */
+
+int ip_fw_chk_flow(struct iphdr *ip, struct device *rif, struct ip_fw *chain,
+	int policy, struct ip_fw **rule, int *flow)
+{
+	return fw_chk(ip, rif, chain, policy, 0, rule, flow);
+}
+
 // 清除每个节点中记录包和字节数量的字段
 static void zero_fw_chain(struct ip_fw *chainptr)
 {
@@ -429,6 +463,7 @@ static void free_fw_chain(struct ip_fw *volatile* chainptr)
 		// 是否头结点的内存
 		kfree_s(ftmp,sizeof(*ftmp));
 	}
+	rt_stamp++;		/* Flow caches may point at these entries */
 	restore_flags(flags);
 }
 
@@ -604,6 +639,7 @@ skip_check:
 					*chainptr=ftmp;
 					ftmp->fw_next=chtmp;
 				}
+				rt_stamp++;
 				restore_flags(flags);
 				return 0;
 			}
@@ -615,6 +651,7 @@ skip_check:
 		chtmp_prev->fw_next=ftmp;
 	else
         	*chainptr=ftmp;
+	rt_stamp++;
 	restore_flags(flags);
 	return(0);
 }
@@ -686,6 +723,8 @@ static int del_from_chain(struct ip_fw *volatile*chainptr, struct ip_fw *frwl)
 			ftmp = ftmp->fw_next;
 		 }
 	}
+	if (was_found)
+		rt_stamp++;
 	restore_flags(flags);
 	if (was_found)
 		return 0;
@@ -838,6 +877,7 @@ int ip_fw_ctl(int stage, void *m, int len)
 			ip_fw_blk_policy=*tmp_policy_ptr;
 		else
 			ip_fw_fwd_policy=*tmp_policy_ptr;
+		rt_stamp++;
 		return 0;
 	}
 
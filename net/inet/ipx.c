@@ -384,8 +384,9 @@ ipxitf_demux_socket(ipx_interface *intrfc, struct sk_buff *skb, int copy)
 	 * demuxed to sock1 and/or sock2.  If we are unable to make enough
 	 * copies, we do as much as is possible.
 	 */
+	/* The caller goes on to rewrite the original, so it can't be shared */
 	if (copy) {
-		skb1 = skb_clone(skb, GFP_ATOMIC);
+		skb1 = skb_copy(skb, GFP_ATOMIC);
 		if (skb1 != NULL) {
 			skb1->h.raw = (unsigned char *)&(skb1->data[ipx_offset]);
 			skb1->arp = skb1->free = 1;
@@ -1885,6 +1886,7 @@ static struct proto_ops ipx_proto_ops = {
 	ipx_setsockopt,
 	ipx_getsockopt,
 	ipx_fcntl,
+	NULL,		/* mmap */
 };
 
 /* Called by ddi.c on kernel start up */
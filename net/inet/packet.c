@@ -43,6 +43,7 @@
 #include <linux/in.h>
 #include <linux/inet.h>
 #include <linux/netdevice.h>
+#include <linux/if_packet.h>
 #include "ip.h"
 #include "protocol.h"
 #include <linux/skbuff.h>
@@ -52,6 +53,24 @@
 #include <asm/system.h>
 #include <asm/segment.h>
 
+/*
+ *	The receive ring. Frame slots never straddle a page, so the ring
+ *	is a set of single pages the user maps back to back.
+ */
+
+#define PACKET_RING_MAX_PAGES	128
+
+struct packet_ring
+{
+	unsigned long *pages;		/* page addresses */
+	int pg_nr;
+	unsigned int frame_size;
+	unsigned int frame_nr;
+	unsigned int frames_per_page;
+	unsigned int head;		/* next slot the kernel fills */
+	int losing;			/* drops since the last frame stored */
+};
+
 /*
  *	We really ought to have a single public _inline_ min function!
  */
@@ -65,30 +84,15 @@ static unsigned long min(unsigned long a, unsigned long b)
 
 
 /*
- *	This should be the easiest of all, all we do is copy it into a buffer. 
+ *	Queue a frame of LEN bytes, MAC header included, on the socket.
  */
-// mac头接收到数据包时调用该函数 
-int packet_rcv(struct sk_buff *skb, struct device *dev,  struct packet_type *pt)
+
+static int packet_queue(struct sock *sk, struct sk_buff *skb, struct device *dev, unsigned long len)
 {
-	struct sock *sk;
 	unsigned long flags;
-	
-	/*
-	 *	When we registered the protocol we saved the socket in the data
-	 *	field for just this event.
-	 */
-	// 见packet_init函数
-	sk = (struct sock *) pt->data;	
 
-	/*
-	 *	The SOCK_PACKET socket receives _all_ frames, and as such 
-	 *	therefore needs to put the header back onto the buffer.
-	 *	(it was removed by inet_bh()).
-	 */
-	 
 	skb->dev = dev;
-	// 加上mac头的长度
-	skb->len += dev->hard_header_len;
+	skb->len = len;
 
 	/*
 	 *	Charge the memory to the socket. This is done specifically
@@ -105,12 +109,14 @@ int packet_rcv(struct sk_buff *skb, struct device *dev,  struct packet_type *pt)
 /*	        printk("packet_rcv: drop, %d+%d>%d\n", sk->rmem_alloc, skb->mem_len, sk->rcvbuf); */
 		skb->sk = NULL;
 		kfree_skb(skb, FREE_READ);
+		sk->pk_stats.tp_drops++;
 		return(0);
 	}
 
 	save_flags(flags);
 	cli();
 
+	sk->pk_stats.tp_packets++;
 	skb->sk = sk;
 	// 读缓冲区变小
 	sk->rmem_alloc += skb->mem_len;	
@@ -133,6 +139,143 @@ int packet_rcv(struct sk_buff *skb, struct device *dev,  struct packet_type *pt)
 	return(0);
 }
 
+/*
+ *	This should be the easiest of all, all we do is copy it into a buffer. 
+ */
+// mac头接收到数据包时调用该函数 
+int packet_rcv(struct sk_buff *skb, struct device *dev,  struct packet_type *pt)
+{
+	/*
+	 *	When we registered the protocol we saved the socket in the data
+	 *	field for just this event.
+	 *
+	 *	The SOCK_PACKET socket receives _all_ frames, and as such 
+	 *	therefore needs to put the header back onto the buffer.
+	 *	(it was removed by inet_bh()).
+	 */
+	// 见packet_init函数，加上mac头的长度
+	return packet_queue((struct sock *) pt->data, skb, dev, skb->len + dev->hard_header_len);
+}
+
+
+/*
+ *	Ring receive. We only look at the frame: the header and as much
+ *	of it as fits go into the next free slot, and the caller keeps
+ *	the buffer. No clone, no queueing, no syscall per frame.
+ */
+
+static struct tpacket_hdr *packet_ring_frame(struct packet_ring *ring, unsigned int n)
+{
+	return (struct tpacket_hdr *)(ring->pages[n / ring->frames_per_page] +
+		(n % ring->frames_per_page) * ring->frame_size);
+}
+
+static int packet_ring_rcv(struct sock *sk, struct sk_buff *skb, struct device *dev, unsigned int snaplen)
+{
+	struct packet_ring *ring = sk->pk_ring;
+	struct tpacket_hdr *h;
+	unsigned long flags;
+	unsigned long status;
+
+	/*
+	 *	Claim a slot. The user hands slots back in ring order, so
+	 *	if the next one is still theirs the ring is full.
+	 */
+	 
+	save_flags(flags);
+	cli();
+	h = packet_ring_frame(ring, ring->head);
+	if (h->tp_status != TP_STATUS_KERNEL)
+	{
+		sk->pk_stats.tp_drops++;
+		ring->losing = 1;
+		restore_flags(flags);
+		return(0);
+	}
+	if (++ring->head == ring->frame_nr)
+		ring->head = 0;
+	sk->pk_stats.tp_packets++;
+	status = TP_STATUS_USER;
+	if (ring->losing)
+		status |= TP_STATUS_LOSING;
+	ring->losing = 0;
+	restore_flags(flags);
+
+	snaplen = min(snaplen, ring->frame_size - TPACKET_HDRLEN);
+	memcpy((char *) h + TPACKET_HDRLEN, skb->data, snaplen);
+
+	h->tp_len = skb->len + dev->hard_header_len;
+	h->tp_snaplen = snaplen;
+	h->tp_mac = TPACKET_HDRLEN;
+	h->tp_family = dev->type;
+	memcpy(h->tp_dev, dev->name, sizeof(h->tp_dev));
+	if (skb->stamp.tv_sec)
+	{
+		h->tp_sec = skb->stamp.tv_sec;
+		h->tp_usec = skb->stamp.tv_usec;
+	}
+	else
+	{
+		h->tp_sec = xtime.tv_sec;
+		h->tp_usec = xtime.tv_usec;
+	}
+	h->tp_status = status;
+
+	if(!sk->dead)
+		sk->data_ready(sk,snaplen);
+	return(0);
+}
+
+
+/*
+ *	Every frame for the socket comes here first, still shared with the
+ *	other receivers. The filter decides if we want it and how much of
+ *	it; only then do we pay for a copy, or for a slot in the ring.
+ */
+
+static int packet_tap(struct sk_buff *skb, struct device *dev, struct packet_type *pt)
+{
+	struct sock *sk = (struct sock *) pt->data;
+	struct sk_buff *skb2;
+	unsigned int len, snaplen;
+
+	/*
+	 *	The frame still starts with the MAC header, skb->len does
+	 *	not count it (see net_bh()).
+	 */
+	 
+	len = skb->len + dev->hard_header_len;
+	snaplen = len;
+	if (sk->filter)
+	{
+		snaplen = sk_run_filter(skb->data, len, sk->filter->insns, sk->filter->len);
+		if (snaplen == 0)
+		{
+			sk->pk_stats.tp_filtered++;
+			return(0);
+		}
+		if (snaplen > len)
+			snaplen = len;
+	}
+
+	if (sk->pk_ring)
+		return packet_ring_rcv(sk, skb, dev, snaplen);
+
+	/* Don't copy what packet_queue() would only throw away */
+	if (sk->rmem_alloc + skb->mem_len >= sk->rcvbuf)
+	{
+		sk->pk_stats.tp_drops++;
+		return(0);
+	}
+	skb2 = skb_clone(skb, GFP_ATOMIC);
+	if (skb2 == NULL)
+	{
+		sk->pk_stats.tp_drops++;
+		return(0);
+	}
+	return packet_queue(sk, skb2, dev, snaplen);
+}
+
 
 /*
  *	Output a raw packet to a device layer. This bypasses all the other
@@ -231,6 +374,188 @@ static int packet_write(struct sock *sk, unsigned char *buff,
 	return(packet_sendto(sk, buff, len, noblock, flags, NULL, 0));
 }
 
+/*
+ *	Release a receive ring. Pages the user still has mapped stay
+ *	around until they are unmapped, the page counts see to that.
+ */
+
+static void packet_free_ring(struct packet_ring *ring)
+{
+	int i;
+
+	for (i = 0; i < ring->pg_nr; i++)
+		free_page(ring->pages[i]);
+	kfree_s(ring->pages, ring->pg_nr * sizeof(unsigned long));
+	kfree_s(ring, sizeof(*ring));
+}
+
+/*
+ *	Set up (or with tp_frame_nr == 0 tear down) the receive ring. While
+ *	a ring exists frames go to it instead of the receive queue.
+ */
+
+static int packet_set_ring(struct sock *sk, struct tpacket_req *req)
+{
+	struct packet_ring *ring, *old;
+	unsigned long flags;
+	int i;
+
+	ring = NULL;
+	if (req->tp_frame_nr)
+	{
+		if (req->tp_frame_size < TPACKET_HDRLEN || req->tp_frame_size > PAGE_SIZE ||
+		    PAGE_SIZE % req->tp_frame_size || (req->tp_frame_size & 15))
+			return(-EINVAL);
+		ring = (struct packet_ring *) kmalloc(sizeof(*ring), GFP_KERNEL);
+		if (ring == NULL)
+			return(-ENOMEM);
+		memset(ring, 0, sizeof(*ring));
+		ring->frame_size = req->tp_frame_size;
+		ring->frame_nr = req->tp_frame_nr;
+		ring->frames_per_page = PAGE_SIZE / ring->frame_size;
+		ring->pg_nr = (ring->frame_nr + ring->frames_per_page - 1) / ring->frames_per_page;
+		if (ring->pg_nr > PACKET_RING_MAX_PAGES)
+		{
+			kfree_s(ring, sizeof(*ring));
+			return(-EINVAL);
+		}
+		ring->pages = (unsigned long *) kmalloc(ring->pg_nr * sizeof(unsigned long), GFP_KERNEL);
+		if (ring->pages == NULL)
+		{
+			kfree_s(ring, sizeof(*ring));
+			return(-ENOMEM);
+		}
+		for (i = 0; i < ring->pg_nr; i++)
+		{
+			/* get_free_page() clears the page: every slot starts TP_STATUS_KERNEL */
+			ring->pages[i] = get_free_page(GFP_KERNEL);
+			if (ring->pages[i] == 0)
+			{
+				ring->pg_nr = i;
+				packet_free_ring(ring);
+				return(-ENOMEM);
+			}
+		}
+	}
+
+	save_flags(flags);
+	cli();
+	old = sk->pk_ring;
+	sk->pk_ring = ring;
+	restore_flags(flags);
+
+	if (old)
+		packet_free_ring(old);
+	return(0);
+}
+
+static int packet_setsockopt(struct sock *sk, int level, int optname,
+	char *optval, int optlen)
+{
+	struct tpacket_req req;
+	int err;
+
+	if (level != SOL_PACKET)
+		return(-EOPNOTSUPP);
+	if (optval == NULL)
+		return(-EINVAL);
+
+	switch(optname)
+	{
+		case PACKET_RX_RING:
+			if (optlen < sizeof(req))
+				return(-EINVAL);
+			err = verify_area(VERIFY_READ, optval, sizeof(req));
+			if (err)
+				return(err);
+			memcpy_fromfs(&req, optval, sizeof(req));
+			return(packet_set_ring(sk, &req));
+		default:
+			return(-ENOPROTOOPT);
+	}
+}
+
+static int packet_getsockopt(struct sock *sk, int level, int optname,
+	char *optval, int *optlen)
+{
+	struct tpacket_stats st;
+	unsigned long flags;
+	int err;
+
+	if (level != SOL_PACKET)
+		return(-EOPNOTSUPP);
+
+	switch(optname)
+	{
+		case PACKET_STATISTICS:
+			/* Reading the counters resets them */
+			save_flags(flags);
+			cli();
+			st = sk->pk_stats;
+			memset(&sk->pk_stats, 0, sizeof(st));
+			restore_flags(flags);
+			break;
+		default:
+			return(-ENOPROTOOPT);
+	}
+
+	err = verify_area(VERIFY_WRITE, optlen, sizeof(int));
+	if (err)
+		return(err);
+	put_fs_long(sizeof(st), (unsigned long *)optlen);
+	err = verify_area(VERIFY_WRITE, optval, sizeof(st));
+	if (err)
+		return(err);
+	memcpy_tofs(optval, &st, sizeof(st));
+	return(0);
+}
+
+/*
+ *	Map the receive ring. It has to be a shared mapping or the user
+ *	would write the slot status words into private copies.
+ */
+
+static int packet_mmap(struct sock *sk, struct vm_area_struct *vma)
+{
+	struct packet_ring *ring = sk->pk_ring;
+	unsigned long start;
+	int i;
+
+	if (ring == NULL)
+		return(-EINVAL);
+	if (vma->vm_offset != 0 || !(vma->vm_flags & VM_SHARED))
+		return(-EINVAL);
+	if (vma->vm_end - vma->vm_start > ring->pg_nr * PAGE_SIZE)
+		return(-EINVAL);
+
+	for (i = 0, start = vma->vm_start; start < vma->vm_end; i++, start += PAGE_SIZE)
+	{
+		if (remap_page_range(start, ring->pages[i], PAGE_SIZE, vma->vm_page_prot))
+			return(-EAGAIN);
+	}
+	return(0);
+}
+
+/*
+ *	With a ring, we are readable when the slot the kernel filled last
+ *	has not been handed back yet.
+ */
+
+static int packet_select(struct sock *sk, int sel_type, select_table *wait)
+{
+	struct packet_ring *ring = sk->pk_ring;
+	unsigned int last;
+
+	if (ring == NULL || sel_type != SEL_IN)
+		return(datagram_select(sk, sel_type, wait));
+
+	select_wait(sk->sleep, wait);
+	last = ring->head ? ring->head - 1 : ring->frame_nr - 1;
+	if (packet_ring_frame(ring, last)->tp_status != TP_STATUS_KERNEL || sk->err)
+		return(1);
+	return(0);
+}
+
 /*
  *	Close a SOCK_PACKET socket. This is fairly simple. We immediately go
  *	to 'closed' state and remove our protocol entry in the device list.
@@ -244,6 +569,13 @@ static void packet_close(struct sock *sk, int timeout)
 	sk->state = TCP_CLOSE;
 	// 从链表中删除该socket
 	dev_remove_pack((struct packet_type *)sk->pair);
+	if (sk->pk_ring)
+	{
+		packet_free_ring(sk->pk_ring);
+		sk->pk_ring = NULL;
+	}
+	if (sk->filter)
+		sk_detach_filter(sk);
 	// 销毁packet_type结构
 	kfree_s((void *)sk->pair, sizeof(struct packet_type));
 	sk->pair = NULL;
@@ -271,6 +603,7 @@ static int packet_init(struct sock *sk)
 	p->type = sk->num;
 	p->data = (void *)sk;
 	p->dev = NULL;
+	p->tap = packet_tap;
 	dev_add_pack(p);
    
 	/*
@@ -403,12 +736,13 @@ struct proto packet_prot =
 	NULL,
 	NULL,
 	NULL, 
-	datagram_select,
+	packet_select,
 	NULL,
 	packet_init,
 	NULL,
-	NULL,			/* No set/get socket options */
-	NULL,
+	packet_setsockopt,
+	packet_getsockopt,
+	packet_mmap,
 	128,
 	0,
 	{NULL,},
@@ -201,8 +201,8 @@ int snmp_get_info(char *buffer, char **start, off_t offset, int length)
 		    ip_statistics.IpFragCreates);
 		    		
 	len += sprintf (buffer + len,
-		"Icmp: InMsgs InErrors InDestUnreachs InTimeExcds InParmProbs InSrcQuenchs InRedirects InEchos InEchoReps InTimestamps InTimestampReps InAddrMasks InAddrMaskReps OutMsgs OutErrors OutDestUnreachs OutTimeExcds OutParmProbs OutSrcQuenchs OutRedirects OutEchos OutEchoReps OutTimestamps OutTimestampReps OutAddrMasks OutAddrMaskReps\n"
-		"Icmp: %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
+		"Icmp: InMsgs InErrors InDestUnreachs InTimeExcds InParmProbs InSrcQuenchs InRedirects InEchos InEchoReps InTimestamps InTimestampReps InAddrMasks InAddrMaskReps OutMsgs OutErrors OutDestUnreachs OutTimeExcds OutParmProbs OutSrcQuenchs OutRedirects OutEchos OutEchoReps OutTimestamps OutTimestampReps OutAddrMasks OutAddrMaskReps OutErrorsLimited OutRepliesLimited\n"
+		"Icmp: %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
 		    icmp_statistics.IcmpInMsgs, icmp_statistics.IcmpInErrors,
 		    icmp_statistics.IcmpInDestUnreachs, icmp_statistics.IcmpInTimeExcds,
 		    icmp_statistics.IcmpInParmProbs, icmp_statistics.IcmpInSrcQuenchs,
@@ -215,7 +215,9 @@ int snmp_get_info(char *buffer, char **start, off_t offset, int length)
 		    icmp_statistics.IcmpOutSrcQuenchs, icmp_statistics.IcmpOutRedirects,
 		    icmp_statistics.IcmpOutEchos, icmp_statistics.IcmpOutEchoReps,
 		    icmp_statistics.IcmpOutTimestamps, icmp_statistics.IcmpOutTimestampReps,
-		    icmp_statistics.IcmpOutAddrMasks, icmp_statistics.IcmpOutAddrMaskReps);
+		    icmp_statistics.IcmpOutAddrMasks, icmp_statistics.IcmpOutAddrMaskReps,
+		    icmp_statistics.IcmpOutErrorsLimited,
+		    icmp_statistics.IcmpOutRepliesLimited);
 	
 	len += sprintf (buffer + len,
 		"Tcp: RtoAlgorithm RtoMin RtoMax MaxConn ActiveOpens PassiveOpens AttemptFails EstabResets CurrEstab InSegs OutSegs RetransSegs\n"
@@ -231,6 +233,12 @@ int snmp_get_info(char *buffer, char **start, off_t offset, int length)
 		"Udp: InDatagrams NoPorts InErrors OutDatagrams\nUdp: %lu %lu %lu %lu\n",
 		    udp_statistics.UdpInDatagrams, udp_statistics.UdpNoPorts,
 		    udp_statistics.UdpInErrors, udp_statistics.UdpOutDatagrams);	    
+#ifdef CONFIG_IP_FORWARD
+	len += sprintf (buffer + len,
+		"IpFwd: InPlace Copied FlowHits FlowMisses\nIpFwd: %lu %lu %lu %lu\n",
+		    ip_fwd_statistics.FwdInPlace, ip_fwd_statistics.FwdCopied,
+		    ip_fwd_statistics.FwdFlowHits, ip_fwd_statistics.FwdFlowMisses);
+#endif
 /*	
 	  len += sprintf( buffer + len,
 	  	"TCP fast path RX:  H2: %ul H1: %ul L: %ul\n",
@@ -57,7 +57,7 @@ static struct inet_protocol tcp_protocol = {
 
 static struct inet_protocol udp_protocol = {
   udp_rcv,		/* UDP handler		*/
-  NULL,			/* Will be UDP fraglist handler */
+  udp_rcv,		/* UDP fraglist handler	*/
   udp_err,		/* UDP error control	*/
   &tcp_protocol,	/* next			*/
   IPPROTO_UDP,		/* protocol ID		*/
@@ -24,6 +24,7 @@
  *		Alan Cox	: 	MSS actually. Also added the window
  *					clamper.
  *		Sam Lantinga	:	Fixed route matching in rt_del()
+ *					Path MTU discovery (RFC 1191).
  *
  *		This program is free software; you can redistribute it and/or
  *		modify it under the terms of the GNU General Public License
@@ -64,6 +65,51 @@ static struct rtable *rt_base = NULL;
 // 回环路由链表
 static struct rtable *rt_loopback = NULL;
 
+/*
+ *	Bumped whenever a route comes or goes (and by ARP when a binding
+ *	changes, and by the firewall when a chain is edited), so anything
+ *	caching a lookup can tell it went stale.
+ */
+
+unsigned long rt_stamp = 0;
+
+static void rt_pmtu_expire(unsigned long);
+
+/*
+ *	Runs while any route holds a learnt path MTU, to forget it again
+ *	once it is IP_PMTU_TIMEOUT old. That is what makes senders probe
+ *	upwards: the next big frame goes out with DF at the full size.
+ */
+
+static struct timer_list rt_pmtu_timer =
+	{ NULL, NULL, 60*HZ, 0L, &rt_pmtu_expire };
+static int rt_pmtu_timer_on = 0;
+
+/*
+ *	Drop the host routes ip_rt_pmtu() cloned. They carry the gateway
+ *	and device of the route they were cloned from, and sort in front of
+ *	everything else, so they have to go whenever the table changes.
+ *	Interrupts must be off.
+ */
+
+static void rt_pmtu_purge(void)
+{
+	struct rtable *r, **rp;
+
+	rp = &rt_base;
+	while ((r = *rp) != NULL)
+	{
+		if (!(r->rt_flags & RTF_PMTU))
+		{
+			rp = &r->rt_next;
+			continue;
+		}
+		*rp = r->rt_next;
+		kfree_s(r, sizeof(struct rtable));
+		rt_stamp++;
+	}
+}
+
 /*
  *	Remove a routing table entry.
  */
@@ -102,7 +148,9 @@ static void rt_del(unsigned long dst, char *devname)
 		if (rt_loopback == r)
 			rt_loopback = NULL;
 		kfree_s(r, sizeof(struct rtable));
+		rt_stamp++;
 	} 
+	rt_pmtu_purge();
 	restore_flags(flags);
 }
 
@@ -130,7 +178,9 @@ void ip_rt_flush(struct device *dev)
 		if (rt_loopback == r)
 			rt_loopback = NULL;
 		kfree_s(r, sizeof(struct rtable));
+		rt_stamp++;
 	} 
+	rt_pmtu_purge();
 	restore_flags(flags);
 }
 
@@ -289,6 +339,7 @@ void ip_rt_add(short flags, unsigned long dst, unsigned long mask,
 	rt->rt_mask = mask;
 	rt->rt_mss = dev->mtu - HEADER_SIZE;
 	rt->rt_window = 0;	/* Default is no clamping */
+	rt->rt_pmtu = dev->mtu;
 
 	/* Are the MSS/Window valid ? */
 
@@ -326,6 +377,7 @@ void ip_rt_add(short flags, unsigned long dst, unsigned long mask,
 			rt_loopback = NULL;
 		kfree_s(r, sizeof(struct rtable));
 	}
+	rt_pmtu_purge();
 	
 	/*
 	 *	Add the new route 
@@ -347,6 +399,8 @@ void ip_rt_add(short flags, unsigned long dst, unsigned long mask,
 	// 如果是回环地址且还没有回环地址则更新rt_loopback链表，所以只有一个回环地址
 	if ((rt->rt_dev->flags & IFF_LOOPBACK) && !rt_loopback)
 		rt_loopback = rt;
+
+	rt_stamp++;
 		
 	/*
 	 *	Restore the interrupts and return
@@ -408,7 +462,7 @@ static int rt_new(struct rtentry *r)
 	 *	Make local copies of the important bits
 	 */
 	 
-	flags = r->rt_flags;
+	flags = r->rt_flags & ~RTF_PMTU;
 	daddr = ((struct sockaddr_in *) &r->rt_dst)->sin_addr.s_addr;
 	mask = ((struct sockaddr_in *) &r->rt_genmask)->sin_addr.s_addr;
 	gw = ((struct sockaddr_in *) &r->rt_gateway)->sin_addr.s_addr;
@@ -517,7 +571,7 @@ int rt_get_info(char *buffer, char **start, off_t offset, int length)
 	int size;
 
 	len += sprintf(buffer,
-		 "Iface\tDestination\tGateway \tFlags\tRefCnt\tUse\tMetric\tMask\t\tMTU\tWindow\n");
+		 "Iface\tDestination\tGateway \tFlags\tRefCnt\tUse\tMetric\tMask\t\tMTU\tWindow\tPMTU\n");
 	pos=len;
   
 	/*
@@ -526,10 +580,10 @@ int rt_get_info(char *buffer, char **start, off_t offset, int length)
 	 
 	for (r = rt_base; r != NULL; r = r->rt_next) 
 	{
-        	size = sprintf(buffer+len, "%s\t%08lX\t%08lX\t%02X\t%d\t%lu\t%d\t%08lX\t%d\t%lu\n",
+        	size = sprintf(buffer+len, "%s\t%08lX\t%08lX\t%02X\t%d\t%lu\t%d\t%08lX\t%d\t%lu\t%d\n",
 			r->rt_dev->name, r->rt_dst, r->rt_gateway,
-			r->rt_flags, r->rt_refcnt, r->rt_use, r->rt_metric,
-			r->rt_mask, (int)r->rt_mss, r->rt_window);
+			r->rt_flags & ~RTF_PMTU, r->rt_refcnt, r->rt_use, r->rt_metric,
+			r->rt_mask, (int)r->rt_mss, r->rt_window, (int)r->rt_pmtu);
 		len+=size;
 		pos+=size;
 		if(pos<offset)
@@ -548,6 +602,103 @@ int rt_get_info(char *buffer, char **start, off_t offset, int length)
   	return len;
 }
 
+/*
+ *	A router told us (ICMP fragmentation needed) that frames bigger
+ *	than mtu do not get through to daddr. Keep that in a host route,
+ *	cloning the route to the network if need be, for IP_PMTU_TIMEOUT.
+ */
+
+void ip_rt_pmtu(unsigned long daddr, unsigned short mtu)
+{
+	struct rtable *rt, *r, **rp;
+	unsigned long flags;
+
+	if (mtu < IP_PMTU_MIN)
+		mtu = IP_PMTU_MIN;
+	save_flags(flags);
+	cli();
+	rt = ip_rt_route(daddr, NULL, NULL);
+	if (rt == NULL || mtu >= rt->rt_pmtu || (rt->rt_dev->flags & IFF_LOOPBACK))
+	{
+		restore_flags(flags);
+		return;
+	}
+	if (!(rt->rt_flags & RTF_HOST))
+	{
+		r = (struct rtable *) kmalloc(sizeof(struct rtable), GFP_ATOMIC);
+		if (r == NULL)
+		{
+			restore_flags(flags);
+			return;
+		}
+		*r = *rt;
+		r->rt_dst = daddr;
+		r->rt_mask = 0xffffffff;
+		r->rt_flags = rt->rt_flags | RTF_HOST | RTF_DYNAMIC | RTF_PMTU;
+		r->rt_refcnt = 0;
+		r->rt_use = 0;
+		
+		/* In front of the first route that is not a host route */
+		for (rp = &rt_base; *rp != NULL && (*rp)->rt_mask == 0xffffffff; rp = &(*rp)->rt_next)
+			;
+		r->rt_next = *rp;
+		*rp = r;
+		rt = r;
+	}
+	rt->rt_pmtu = mtu;
+	rt->rt_pmtu_expires = jiffies + IP_PMTU_TIMEOUT;
+	rt_stamp++;
+	if (!rt_pmtu_timer_on)
+	{
+		rt_pmtu_timer_on = 1;
+		rt_pmtu_timer.expires = 60*HZ;
+		add_timer(&rt_pmtu_timer);
+	}
+	restore_flags(flags);
+}
+
+static void rt_pmtu_expire(unsigned long dummy)
+{
+	struct rtable *r, **rp;
+	unsigned long flags;
+	int left = 0;
+
+	save_flags(flags);
+	cli();
+	rp = &rt_base;
+	while ((r = *rp) != NULL)
+	{
+		if (r->rt_pmtu_expires == 0)
+		{
+			rp = &r->rt_next;
+			continue;
+		}
+		if ((long)(jiffies - r->rt_pmtu_expires) < 0)
+		{
+			left++;
+			rp = &r->rt_next;
+			continue;
+		}
+		rt_stamp++;
+		if (r->rt_flags & RTF_PMTU)
+		{
+			*rp = r->rt_next;
+			kfree_s(r, sizeof(struct rtable));
+			continue;
+		}
+		r->rt_pmtu = r->rt_dev->mtu;
+		r->rt_pmtu_expires = 0;
+		rp = &r->rt_next;
+	}
+	rt_pmtu_timer_on = left;
+	if (left)
+	{
+		rt_pmtu_timer.expires = 60*HZ;
+		add_timer(&rt_pmtu_timer);
+	}
+	restore_flags(flags);
+}
+
 /*
  *	This is hackish, but results in better code. Use "-S" to see why.
  */
@@ -12,6 +12,7 @@
  * Fixes:
  *		Alan Cox	:	Reformatted. Added ip_rt_local()
  *		Alan Cox	:	Support for TCP parameters.
+ *					Path MTU.
  *
  *		This program is free software; you can redistribute it and/or
  *		modify it under the terms of the GNU General Public License
@@ -37,7 +38,7 @@ struct rtable
 	// 网关
 	unsigned long		rt_gateway;
 	// 各种标记位
-	unsigned char		rt_flags;
+	unsigned short		rt_flags;
 	// 代价
 	unsigned char		rt_metric;
 	// 使用计数
@@ -49,9 +50,22 @@ struct rtable
 	unsigned long		rt_window;
 	// 绑定的接口
 	struct device		*rt_dev;
+	unsigned short		rt_pmtu;	/* Path MTU: dev->mtu unless we learnt less */
+	unsigned long		rt_pmtu_expires;	/* When to forget that (0 = never) */
 };
 
+/*
+ *	Kernel internal: a host route cloned from the route to a network
+ *	to hold a path MTU for one destination. It goes when that expires.
+ */
+
+#define RTF_PMTU		0x8000
+
+#define IP_PMTU_TIMEOUT		(10*60*HZ)	/* RFC 1191: no less than 10 minutes */
+#define IP_PMTU_MIN		68
+
 
+extern unsigned long	rt_stamp;
 extern void		ip_rt_flush(struct device *dev);
 extern void		ip_rt_add(short flags, unsigned long addr, unsigned long mask,
 			       unsigned long gw, struct device *dev, unsigned short mss, unsigned long window);
@@ -59,5 +73,6 @@ extern struct rtable	*ip_rt_route(unsigned long daddr, struct options *opt, unsi
 extern struct rtable 	*ip_rt_local(unsigned long daddr, struct options *opt, unsigned long *src_addr);
 extern int		rt_get_info(char * buffer, char **start, off_t offset, int length);
 extern int		ip_rt_ioctl(unsigned int cmd, void *arg);
+extern void		ip_rt_pmtu(unsigned long daddr, unsigned short mtu);
 
 #endif	/* _ROUTE_H */
@@ -27,6 +27,7 @@
 #include <asm/segment.h>
 #include <asm/system.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
 #include <linux/interrupt.h>
 #include <linux/in.h>
 #include <linux/inet.h>
@@ -51,6 +52,25 @@ volatile unsigned long net_locked = 0;
 volatile unsigned long net_allocs = 0;
 volatile unsigned long net_fails  = 0;
 volatile unsigned long net_free_locked = 0;
+volatile unsigned long net_clones = 0;		/* Clones sharing data now */
+volatile unsigned long net_shared = 0;		/* Bytes those clones did not copy */
+volatile unsigned long net_clone_allocs = 0;
+volatile unsigned long net_clone_saved = 0;	/* Bytes not copied, ever */
+
+/*
+ *	Clones are a bare sk_buff header, so they come from their own cache
+ *	rather than the general kmalloc() sizes.
+ */
+
+static kmem_cache_t *skbuff_head_cache;
+
+void skb_init(void)
+{
+	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
+		sizeof(struct sk_buff), SLAB_HWCACHE_ALIGN, NULL);
+	if (!skbuff_head_cache)
+		panic("cannot create skbuff cache");
+}
 
 void show_net_buffers(void)
 {
@@ -60,6 +80,10 @@ void show_net_buffers(void)
 	printk("Total network buffer allocations   : %lu\n",net_allocs);
 	printk("Total failed network buffer allocs : %lu\n",net_fails);
 	printk("Total free while locked events     : %lu\n",net_free_locked);
+	printk("Network buffers sharing data       : %lu\n",net_clones);
+	printk("Memory saved by sharing data       : %lu\n",net_shared);
+	printk("Total network buffer clones        : %lu\n",net_clone_allocs);
+	printk("Total memory saved by clones       : %lu\n",net_clone_saved);
 }
 
 #if CONFIG_SKB_CHECK
@@ -325,6 +349,42 @@ void skb_unlink(struct sk_buff *skb)
 
 #endif
 
+/*
+ *	Free the fragment buffers hung off the head of a chain. Each one
+ *	was charged to the socket on its own, so each goes back the same
+ *	way.
+ */
+
+static void skb_free_chain(struct sk_buff *skb, int rw)
+{
+	struct sk_buff *frag, *next;
+
+	frag = skb->fraglist;
+	skb->fraglist = NULL;
+	while (frag != NULL)
+	{
+		next = frag->fraglist;
+		frag->fraglist = NULL;
+		kfree_skb(frag, rw);
+		frag = next;
+	}
+}
+
+/*
+ *	Memory held by a buffer and any fragments chained to it, for
+ *	charging against socket buffer limits.
+ */
+
+unsigned long skb_chain_memory(struct sk_buff *skb)
+{
+	unsigned long size = skb->mem_len;
+	struct sk_buff *frag;
+
+	for (frag = skb->fraglist; frag != NULL; frag = frag->fraglist)
+		size += frag->mem_len;
+	return size;
+}
+
 /*
  *	Free an sk_buff. This still knows about things it should
  *	not need to like protocols and sockets.
@@ -347,6 +407,8 @@ void kfree_skb(struct sk_buff *skb, int rw)
 		net_free_locked++;
 		return;
   	}
+	if (skb->fraglist)
+		skb_free_chain(skb, rw);
   	if (skb->free == 2)
 		printk("Warning: kfree_skb passed an skb that nobody set the free flag on! (from %p)\n",
 			__builtin_return_address(0));
@@ -421,9 +483,13 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 	skb->truesize = size;
 	skb->mem_len = size;
 	skb->mem_addr = skb;
+	skb->data = (unsigned char *)(skb+1);
+	skb->data_skb = skb;
+	skb->datarefs = 1;
 #ifdef CONFIG_SLAVE_BALANCING
 	skb->in_dev_queue = 0;
 #endif
+	skb->fraglen = 0;
 	skb->fraglist = NULL;
 	skb->prev = skb->next = NULL;
 	skb->link3 = NULL;
@@ -444,12 +510,30 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 }
 
 /*
- *	Free an skbuff by memory
+ *	Drop a reference to the data held in a buffer's block. The block
+ *	(that sk_buff and the data after it) goes with the last user.
+ *	Called with interrupts off.
+ */
+
+static void skb_data_put(struct sk_buff *skb)
+{
+	if (--skb->datarefs == 0)
+	{
+		net_memory -= skb->truesize;
+		kfree_s((void *)skb,skb->truesize);
+	}
+}
+
+/*
+ *	Free an skbuff by memory. A clone gives back its own header and its
+ *	hold on the data. Freeing a buffer whose data is still in use by
+ *	clones leaves the block to the last of them.
  */
 
 void kfree_skbmem(struct sk_buff *skb,unsigned size)
 {
 	unsigned long flags;
+	struct sk_buff *owner = skb->data_skb;
 #ifdef CONFIG_SLAVE_BALANCING
 	save_flags(flags);
 	cli();
@@ -459,59 +543,48 @@ void kfree_skbmem(struct sk_buff *skb,unsigned size)
 #endif
 #ifdef CONFIG_SKB_CHECK
 	IS_SKB(skb);
-	if(size!=skb->truesize)
+	if(owner==skb && size!=skb->truesize)
 		printk("kfree_skbmem: size mismatch.\n");
 
-	if(skb->magic_debug_cookie == SK_GOOD_SKB)
+	if(skb->magic_debug_cookie != SK_GOOD_SKB)
 	{
-		save_flags(flags);
-		cli();
-		IS_SKB(skb);
-		skb->magic_debug_cookie = SK_FREED_SKB;
-		kfree_s((void *)skb,size);
-		net_skbcount--;
-		net_memory -= size;
-		restore_flags(flags);
-	}
-	else
 		printk("kfree_skbmem: bad magic cookie\n");
-#else
+		return;
+	}
+	skb->magic_debug_cookie = SK_FREED_SKB;
+#endif
 	save_flags(flags);
 	cli();
-	kfree_s((void *)skb,size);
 	net_skbcount--;
-	net_memory -= size;
+	if (owner != skb)
+	{
+		net_clones--;
+		net_shared -= owner->truesize - sizeof(struct sk_buff);
+		net_memory -= skb->truesize;
+		kmem_cache_free(skbuff_head_cache, skb);
+	}
+	skb_data_put(owner);
 	restore_flags(flags);
-#endif
 }
 
 /*
- *	Duplicate an sk_buff. The new one is not owned by a socket or locked
- *	and will be freed on deletion.
+ *	Copy the bookkeeping of an sk_buff to a duplicate whose data sits
+ *	'offset' bytes further on.
  */
 
-struct sk_buff *skb_clone(struct sk_buff *skb, int priority)
+static void skb_copy_header(struct sk_buff *n, struct sk_buff *skb, unsigned long offset)
 {
-	struct sk_buff *n;
-	unsigned long offset;
-	// sk_buff的总大小减去sk_buff的结构体的大小
-	n=alloc_skb(skb->mem_len-sizeof(struct sk_buff),priority);
-	if(n==NULL)
-		return NULL;
-
-	offset=((char *)n)-((char *)skb);
-	// 把data部分复制过来
-	memcpy(n->data,skb->data,skb->mem_len-sizeof(struct sk_buff));
 	n->len=skb->len;
 	n->link3=NULL;
 	n->sk=NULL;
 	n->when=skb->when;
+	n->stamp=skb->stamp;
 	n->dev=skb->dev;
 	// 指向原sk_buff的部分
 	n->h.raw=skb->h.raw+offset;
 	n->ip_hdr=(struct iphdr *)(((char *)skb->ip_hdr)+offset);
-	n->fraglen=skb->fraglen;
-	n->fraglist=skb->fraglist;
+	n->fraglen=0;
+	n->fraglist=NULL;
 	n->saddr=skb->saddr;
 	n->daddr=skb->daddr;
 	n->raddr=skb->raddr;
@@ -523,6 +596,146 @@ struct sk_buff *skb_clone(struct sk_buff *skb, int priority)
 	n->lock=0;
 	n->users=0;
 	n->pkt_type=skb->pkt_type;
+}
+
+/*
+ *	Build a flat copy of a fragment chain: the MAC header and the head's
+ *	own bytes, followed by each fragment in turn.
+ */
+
+static struct sk_buff *skb_copy_chain(struct sk_buff *skb, int priority)
+{
+	struct sk_buff *n;
+	struct sk_buff *frag;
+	unsigned char *ptr;
+	unsigned long own, size;
+
+	own = ((unsigned char *)skb->ip_hdr) - skb->data + skb->fraglen;
+	size = own;
+	for (frag = skb->fraglist; frag != NULL; frag = frag->fraglist)
+		size += frag->fraglen;
+
+	n=alloc_skb(size,priority);
+	if(n==NULL)
+		return NULL;
+
+	memcpy(n->data,skb->data,own);
+	ptr=n->data+own;
+	for (frag = skb->fraglist; frag != NULL; frag = frag->fraglist)
+	{
+		memcpy(ptr,frag->h.raw,frag->fraglen);
+		ptr+=frag->fraglen;
+	}
+	skb_copy_header(n,skb,n->data-skb->data);
+	return n;
+}
+
+/*
+ *	Make a private copy of an sk_buff, data and all. The new one is not
+ *	owned by a socket or locked and will be freed on deletion.
+ */
+
+struct sk_buff *skb_copy(struct sk_buff *skb, int priority)
+{
+	struct sk_buff *n;
+	unsigned long size;
+
+	if(skb->fraglist)
+		return skb_copy_chain(skb,priority);
+	// sk_buff的总大小减去sk_buff的结构体的大小
+	size=skb->data_skb->truesize-sizeof(struct sk_buff);
+	n=alloc_skb(size,priority);
+	if(n==NULL)
+		return NULL;
+
+	// 把data部分复制过来
+	memcpy(n->data,skb->data,size);
+	skb_copy_header(n,skb,n->data-skb->data);
+	return n;
+}
+
+/*
+ *	Duplicate an sk_buff. The new one is not owned by a socket or locked
+ *	and will be freed on deletion. It shares the data of the original,
+ *	so whoever wants to write to either must skb_unshare() it first. A
+ *	chain comes back as a flat copy.
+ */
+
+struct sk_buff *skb_clone(struct sk_buff *skb, int priority)
+{
+	struct sk_buff *n;
+	struct sk_buff *owner;
+	unsigned long flags;
+
+	if(skb->fraglist)
+		return skb_copy_chain(skb,priority);
+
+	n=(struct sk_buff *)kmem_cache_alloc(skbuff_head_cache,priority);
+	if(n==NULL)
+	{
+		net_fails++;
+		return NULL;
+	}
+	owner=skb->data_skb;
+	skb_copy_header(n,skb,0);
+	n->data=skb->data;
+	n->data_skb=owner;
+	n->datarefs=0;
+	n->truesize=sizeof(struct sk_buff);
+	n->mem_len=skb->mem_len;	/* Charge sockets for the data we pin */
+	n->mem_addr=n;
+	n->prev=n->next=NULL;
+	n->localroute=0;
+#ifdef CONFIG_SLAVE_BALANCING
+	n->in_dev_queue=0;
+#endif
+#if CONFIG_SKB_CHECK
+	n->magic_debug_cookie=SK_GOOD_SKB;
+#endif
+	save_flags(flags);
+	cli();
+	owner->datarefs++;
+	net_allocs++;
+	net_skbcount++;
+	net_memory+=n->truesize;
+	net_clones++;
+	net_clone_allocs++;
+	net_shared+=owner->truesize-sizeof(struct sk_buff);
+	net_clone_saved+=owner->truesize-sizeof(struct sk_buff);
+	restore_flags(flags);
+	return n;
+}
+
+/*
+ *	Get a buffer whose data nobody else can see, copying it if it is
+ *	shared. The original is freed. Returns NULL if there is no memory.
+ */
+
+struct sk_buff *skb_unshare(struct sk_buff *skb, int priority, int rw)
+{
+	struct sk_buff *n;
+
+	if(!skb_shared(skb))
+		return skb;
+	n=skb_copy(skb,priority);
+	kfree_skb(skb,rw);
+	return n;
+}
+
+/*
+ *	Turn a fragment chain into a single flat buffer for code that
+ *	cannot walk one. The chain is freed. Returns NULL, with the chain
+ *	freed, if there is no memory.
+ */
+
+struct sk_buff *skb_linearize(struct sk_buff *skb, int priority)
+{
+	struct sk_buff *n;
+
+	if(skb->fraglist==NULL)
+		return skb;
+	n=skb_copy_chain(skb,priority);
+	kfree_skb(skb,FREE_READ);
 	return n;
 }
 
@@ -77,6 +77,8 @@ struct icmp_mib
  	unsigned long	IcmpOutTimestampReps;
  	unsigned long	IcmpOutAddrMasks;
  	unsigned long	IcmpOutAddrMaskReps;
+ 	unsigned long	IcmpOutErrorsLimited;	/* Not sent: rate limited */
+ 	unsigned long	IcmpOutRepliesLimited;
 };
  
 struct tcp_mib
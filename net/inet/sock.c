@@ -121,6 +121,12 @@ int sock_setsockopt(struct sock *sk, int level, int optname,
 	int err;
 	struct linger ling;
 
+	/* These take a structure (or nothing), not an int */
+	if (optname == SO_ATTACH_FILTER)
+		return sk_attach_filter(sk, optval, optlen);
+	if (optname == SO_DETACH_FILTER)
+		return sk_detach_filter(sk);
+
   	if (optval == NULL) 
   		return(-EINVAL);
 
@@ -511,14 +517,24 @@ struct sk_buff *sock_alloc_send_skb(struct sock *sk, unsigned long size, int nob
 int sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 {
 	unsigned long flags;
+	unsigned long size;
+	struct sk_buff *frag;
+
+	/*
+	 *	A reassembled datagram holds its fragments' buffers as well.
+	 *	Each is charged here and uncharged as it is freed.
+	 */
+	size=skb_chain_memory(skb);
 	// 接收缓冲区已满
-	if(sk->rmem_alloc + skb->mem_len >= sk->rcvbuf)
+	if(sk->rmem_alloc + size >= sk->rcvbuf)
 		return -ENOMEM;
 	save_flags(flags);
 	cli();
 	// 更新接收缓冲区大小
-	sk->rmem_alloc+=skb->mem_len;
+	sk->rmem_alloc+=size;
 	skb->sk=sk;
+	for(frag=skb->fraglist;frag!=NULL;frag=frag->fraglist)
+		frag->sk=sk;
 	restore_flags(flags);
 	// 挂载到socket的接收队列
 	skb_queue_tail(&sk->receive_queue,skb);
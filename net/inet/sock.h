@@ -34,8 +34,11 @@
 #include <linux/ip.h>		/* struct options */
 #include <linux/tcp.h>		/* struct tcphdr */
 #include <linux/config.h>
+#include <linux/slab.h>
 
 #include <linux/skbuff.h>	/* struct sk_buff */
+#include <linux/filter.h>	/* struct sk_filter */
+#include <linux/if_packet.h>	/* struct tpacket_stats */
 #include "protocol.h"		/* struct inet_protocol */
 #ifdef CONFIG_AX25
 #include "ax25.h"
@@ -115,6 +118,8 @@ struct sock {
   unsigned short		mtu;       /* mss negotiated in the syn's */
   volatile unsigned short	mss;       /* current eff. mss - can change */
   volatile unsigned short	user_mss;  /* mss requested by user in ioctl */
+  unsigned short		pmtu_clamp; /* mtu before path MTU cut it, 0 if not cut */
+  unsigned long			pmtu_stamp; /* when it was cut or last probed */
   volatile unsigned short	max_window;
   unsigned long 		window_clamp;
   unsigned short		num;
@@ -174,13 +179,21 @@ struct sock {
   struct timer_list		retransmit_timer;	/* TCP retransmit timer */
   struct timer_list		ack_timer;		/* TCP delayed ack timer */
   int				ip_xmit_timeout;	/* Why the timeout is running */
+  struct ip_route_cache		*ip_rc;		/* Connected UDP output path */
 #ifdef CONFIG_IP_MULTICAST  
   int				ip_mc_ttl;			/* Multicasting TTL */
   int				ip_mc_loop;			/* Loopback (not implemented yet) */
   char				ip_mc_name[MAX_ADDR_LEN];	/* Multicast device name */
   struct ip_mc_socklist		*ip_mc_list;			/* Group array */
+  unsigned char			ip_mc_bound;			/* UDP: on its port chain */
+  unsigned char			ip_mc_wild;			/* UDP: counted in udp_mc_wild */
 #endif  
 
+/* SOCK_PACKET 'private area' */
+  struct packet_ring		*pk_ring;	/* mmap()ed receive ring */
+  struct sk_filter		*filter;	/* SO_ATTACH_FILTER program */
+  struct tpacket_stats		pk_stats;	/* PACKET_STATISTICS */
+
   /* This part is used for the timeout functions (timer.c). */
   int				timeout;	/* What are we waiting for? */
   struct timer_list		timer;		/* This is the TIME_WAIT/receive timer when we are doing IP */
@@ -197,6 +210,8 @@ struct socket			*socket;
   
 };
 
+struct vm_area_struct;
+
 struct proto {
   struct sk_buff *	(*wmalloc)(struct sock *sk,
 				    unsigned long size, int force,
@@ -251,6 +266,7 @@ struct proto {
   				 char *optval, int optlen);
   int			(*getsockopt)(struct sock *sk, int level, int optname,
   				char *optval, int *option);  	 
+  int			(*mmap)(struct sock *sk, struct vm_area_struct *vma);
   unsigned short	max_header;
   unsigned long		retransmits;
   struct sock *		sock_array[SOCK_ARRAY_SIZE];
@@ -273,6 +289,7 @@ struct proto {
 #define SEND_SHUTDOWN	2
 
 
+extern kmem_cache_t		*sk_cachep;
 extern void			destroy_sock(struct sock *sk);
 extern unsigned short		get_new_socknum(struct proto *, unsigned short);
 extern void			put_sock(unsigned short, struct sock *); 
@@ -283,6 +300,8 @@ extern struct sock		*get_sock(struct proto *, unsigned short,
 extern struct sock		*get_sock_mcast(struct sock *, unsigned short,
 					  unsigned long, unsigned short,
 					  unsigned long);
+extern int			sock_mcast_match(struct sock *, unsigned long,
+					  unsigned short, unsigned long);
 extern struct sock		*get_sock_raw(struct sock *, unsigned short,
 					  unsigned long, unsigned long);
 
@@ -304,6 +323,9 @@ extern int			sock_setsockopt(struct sock *sk,int level,int op,char *optval,int o
 extern int			sock_getsockopt(struct sock *sk,int level,int op,char *optval,int *optlen);
 extern struct sk_buff 		*sock_alloc_send_skb(struct sock *skb, unsigned long size, int noblock, int *errcode);
 extern int			sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb);
+extern int			sk_attach_filter(struct sock *sk, char *optval, int optlen);
+extern int			sk_detach_filter(struct sock *sk);
+extern void			sk_free_filter(struct sk_filter *fp);
 
 /* declarations from timer.c */
 extern struct sock *timer_base;
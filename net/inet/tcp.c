@@ -452,6 +452,9 @@ void tcp_do_retransmit(struct sock *sk, int all)
 		 */
 		// 重新取一个id
 		iph->id = htons(ip_id_count++);
+		/* Built before the path MTU came down: let it fragment */
+		if (size - 4*th->doff > sk->mtu)
+			iph->frag_off &= ~htons(IP_DF);
 		// 计算校验和
 		ip_send_check(iph);
 
@@ -795,6 +798,33 @@ void tcp_err(int err, unsigned char *header, unsigned long daddr,
 	  	return;
 	}
 
+	if (err == ((ICMP_DEST_UNREACH << 8) | ICMP_FRAG_NEEDED))
+	{
+		/*
+		 *	Our segments are too big for the path. ICMP has put
+		 *	the path MTU in the routing table; send smaller ones.
+		 *	What is already queued goes out without DF.
+		 */
+		struct rtable *rt = ip_rt_route(daddr, NULL, NULL);
+		int mtu;
+		
+		if (rt == NULL)
+			return;
+		mtu = rt->rt_pmtu - HEADER_SIZE;
+		if (mtu < 32)
+			mtu = 32;
+		if (mtu < sk->mtu)
+		{
+			if (!sk->pmtu_clamp)
+				sk->pmtu_clamp = sk->mtu;
+			sk->pmtu_stamp = jiffies;
+			sk->mtu = mtu;
+			if (sk->mss > mtu)
+				sk->mss = mtu;
+		}
+		return;
+	}
+
 	if ((err & 0xff00) == (ICMP_SOURCE_QUENCH << 8)) 
 	{
 		/*
@@ -1494,6 +1524,35 @@ extern __inline int tcp_build_header(struct tcphdr *th, struct sock *sk, int pus
  *	and starts the transmit system.
  */
 
+/*
+ *	Path MTU discovery cut our segment size a while ago: see whether
+ *	the path takes bigger ones again. The routing table forgets a learnt
+ *	path MTU after IP_PMTU_TIMEOUT, and if it is still too small a router
+ *	says so and we come down again.
+ */
+
+static void tcp_pmtu_probe(struct sock *sk)
+{
+	struct rtable *rt;
+	int mtu;
+
+	sk->pmtu_stamp = jiffies;
+	rt = ip_rt_route(sk->daddr, NULL, NULL);
+	if (rt == NULL)
+		return;
+	mtu = min(rt->rt_pmtu - HEADER_SIZE, sk->pmtu_clamp);
+	if (mtu <= sk->mtu)
+		return;
+	sk->mtu = mtu;
+	if (mtu >= sk->pmtu_clamp)
+		sk->pmtu_clamp = 0;
+#ifdef CONFIG_INET_PCTCP
+	sk->mss = min(sk->max_window >> 1, sk->mtu);
+#else
+	sk->mss = min(sk->max_window, sk->mtu);
+#endif
+}
+
 static int tcp_write(struct sock *sk, unsigned char *from,
 	  int len, int nonblock, unsigned flags)
 {
@@ -1508,6 +1567,8 @@ static int tcp_write(struct sock *sk, unsigned char *from,
 
 	sk->inuse=1;
 	prot = sk->prot;
+	if (sk->pmtu_clamp && jiffies - sk->pmtu_stamp > TCP_PMTU_PROBE)
+		tcp_pmtu_probe(sk);
 	while(len > 0) 
 	{
 		if (sk->err) 
@@ -1599,8 +1660,9 @@ static int tcp_write(struct sock *sk, unsigned char *from,
 
 	/*
 	 * The following code can result in copy <= if sk->mss is ever
-	 * decreased.  It shouldn't be.  sk->mss is min(sk->mtu, sk->max_window).
-	 * sk->mtu is constant once SYN processing is finished.  I.e. we
+	 * decreased, which path MTU discovery does.  sk->mss is min(sk->mtu,
+	 * sk->max_window).  sk->mtu is set by the SYNs and after that only
+	 * moved by path MTU discovery.  I.e. we
 	 * had better not get here until we've seen his SYN and at least one
 	 * valid ack.  (The SYN sets sk->mtu and the ack sets sk->max_window.)
 	 * But ESTABLISHED should guarantee that.  sk->max_window is by definition
@@ -1628,12 +1690,9 @@ static int tcp_write(struct sock *sk, unsigned char *from,
 			{	
 				// mss-数据长度等于还可以传多少长度的数据
 				copy = min(sk->mss - (skb->len - hdrlen), len);
-				/* FIXME: this is really a bug. */
+				/* Path MTU discovery can shrink sk->mss under us */
 				if (copy <= 0) 
-				{
-			  		printk("TCP: **bug**: \"copy\" <= 0!!\n");
-			  		copy = 0;
-				}
+					copy = 0;
 	  			// 把用户的数据赋值copy长度个字节到数据包的数据部分
 				memcpy_fromfs(skb->data + skb->len, from, copy);
 				// 更新skb的data字段使用了多少字节
@@ -2855,7 +2914,7 @@ static void tcp_conn_request(struct sock *sk, struct sk_buff *skb,
 	 * off of the queue, this will take care of it.
 	 */
 	// 分配一个新的sock结构用于连接连接
-	newsk = (struct sock *) kmalloc(sizeof(struct sock), GFP_ATOMIC);
+	newsk = (struct sock *) kmem_cache_alloc(sk_cachep, GFP_ATOMIC);
 	if (newsk == NULL) 
 	{
 		/* just ignore the syn.  It will get retransmitted. */
@@ -2874,6 +2933,7 @@ static void tcp_conn_request(struct sock *sk, struct sk_buff *skb,
 	newsk->rto = TCP_TIMEOUT_INIT;
 	newsk->mdev = 0;
 	newsk->max_window = 0;
+	newsk->pmtu_clamp = 0;
 	newsk->cong_window = 1;
 	newsk->cong_count = 0;
 	newsk->ssthresh = 0;
@@ -2971,6 +3031,8 @@ static void tcp_conn_request(struct sock *sk, struct sk_buff *skb,
 		newsk->mtu = sk->user_mss;
 	else if(rt!=NULL && (rt->rt_flags&RTF_MSS))
 		newsk->mtu = rt->rt_mss - HEADER_SIZE;
+	else if(rt!=NULL)
+		newsk->mtu = rt->rt_pmtu - HEADER_SIZE;	/* Path MTU discovery says if it is too big */
 	else 
 	{
 #ifdef CONFIG_INET_SNARL	/* Sub Nets Are Local */
@@ -2988,6 +3050,10 @@ static void tcp_conn_request(struct sock *sk, struct sk_buff *skb,
 	 */
 
 	newsk->mtu = min(newsk->mtu, dev->mtu - HEADER_SIZE);
+	if(rt!=NULL)
+		newsk->mtu = min(newsk->mtu, rt->rt_pmtu - HEADER_SIZE);
+	if(newsk->mtu < 32)
+		newsk->mtu = 32;	/* Sanity limit */
 
 	/*
 	 *	This will min with what arrived in the packet 
@@ -4396,10 +4462,13 @@ static struct sock *tcp_accept(struct sock *sk, int flags)
 
 		release_sock(sk);
 		//阻塞进程，如果后续建立了连接，则进程被唤醒的时候，就会跳出while循环
-		interruptible_sleep_on(sk->sleep);
+		/* only one acceptor is woken per connection */
+		interruptible_sleep_on_exclusive(sk->sleep);
 		if (current->signal & ~current->blocked) 
 		{
 			sti();
+			/* the connection we were woken for is someone else's */
+			wake_up_interruptible(sk->sleep);
 			sk->err = ERESTARTSYS;
 			return(NULL);
 		}
@@ -4539,6 +4608,8 @@ static int tcp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 		sk->mtu = sk->user_mss;
 	else if(rt!=NULL && (rt->rt_flags&RTF_MTU))
 		sk->mtu = rt->rt_mss;
+	else if(rt!=NULL)
+		sk->mtu = rt->rt_pmtu - HEADER_SIZE;	/* Path MTU discovery says if it is too big */
 	else 
 	{
 #ifdef CONFIG_INET_SNARL
@@ -4554,10 +4625,12 @@ static int tcp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 	 *	but not bigger than device MTU 
 	 */
 
+	sk->mtu = min(sk->mtu, dev->mtu - HEADER_SIZE);
+	if(rt!=NULL)
+		sk->mtu = min(sk->mtu, rt->rt_pmtu - HEADER_SIZE);
+
 	if(sk->mtu <32)
 		sk->mtu = 32;	/* Sanity limit */
-		
-	sk->mtu = min(sk->mtu, dev->mtu - HEADER_SIZE);
 	
 	/*
 	 *	Put in the TCP options to say MTU. 
@@ -4757,6 +4830,15 @@ int tcp_rcv(struct sk_buff *skb, struct device *dev, struct options *opt,
 			 */
 			return(0);
 		}
+
+		/*
+		 *	The header is converted in place below. If a packet
+		 *	tap holds the same data, take a copy of our own.
+		 */
+		skb = skb_unshare(skb, GFP_ATOMIC, FREE_READ);
+		if (skb == NULL)
+			return(0);
+		th = skb->h.th;
 		th->seq = ntohl(th->seq);
 
 		/* See if we know about the socket. */
@@ -5311,6 +5393,7 @@ struct proto tcp_prot = {
 	tcp_shutdown,
 	tcp_setsockopt,
 	tcp_getsockopt,
+	NULL,
 	128,
 	0,
 	{NULL,},
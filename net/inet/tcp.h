@@ -56,6 +56,7 @@
 #define TCP_WRITE_TIME	3000	/* initial time to wait for an ACK,
 			         * after last transmit			*/
 #define TCP_TIMEOUT_INIT (3*HZ)	/* RFC 1122 initial timeout value	*/
+#define TCP_PMTU_PROBE	(60*HZ)	/* how often to look for a bigger path MTU */
 #define TCP_SYN_RETRIES	5	/* number of times to retry opening a
 				 * connection 				*/
 #define TCP_PROBEWAIT_LEN 100	/* time to wait between probes when
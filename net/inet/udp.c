@@ -224,6 +224,61 @@ static unsigned short udp_check(struct udphdr *uh, int len, unsigned long saddr,
 	return((~sum) & 0xffff);
 }
 
+/*
+ *	Add a block to a ones complement sum, 16 bits at a time in memory
+ *	order. Only the last block of a datagram can have an odd length.
+ */
+
+static unsigned long udp_csum_block(unsigned char *buff, int len, unsigned long sum)
+{
+	while (len > 1)
+	{
+		sum += *(unsigned short *)buff;
+		buff += 2;
+		len -= 2;
+	}
+	if (len)
+		sum += *buff;
+	return sum;
+}
+
+/*
+ *	Checksum a datagram that arrived as a fragment chain. Every piece
+ *	but the last is a multiple of 8 bytes, so the blocks stay aligned on
+ *	16 bit boundaries.
+ */
+
+static unsigned short udp_check_chain(struct sk_buff *skb, int len, unsigned long saddr, unsigned long daddr)
+{
+	struct sk_buff *frag;
+	unsigned char *end;
+	unsigned long sum;
+	int n;
+
+	sum = (daddr & 0xffff) + (daddr >> 16) + (saddr & 0xffff) + (saddr >> 16);
+	sum += htons(len) + htons(IPPROTO_UDP);
+
+	end = ((unsigned char *)skb->ip_hdr) + skb->fraglen;
+	n = end - skb->h.raw;
+	if (n > len)
+		n = len;
+	sum = udp_csum_block(skb->h.raw, n, sum);
+	len -= n;
+
+	for (frag = skb->fraglist; frag != NULL && len > 0; frag = frag->fraglist)
+	{
+		n = frag->fraglen;
+		if (n > len)
+			n = len;
+		sum = udp_csum_block(frag->h.raw, n, sum);
+		len -= n;
+	}
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return((~sum) & 0xffff);
+}
+
 /*
  *	Generate UDP checksums. These may be disabled, eg for fast NFS over ethernet
  *	We default them enabled.. if you turn them off you either know what you are
@@ -248,12 +303,36 @@ static void udp_send_check(struct udphdr *uh, unsigned long saddr,
 }
 
 
+/*
+ *	Hand back the cached output path of a connected socket if it is
+ *	still good, refreshing it once the routes or ARP have moved on.
+ */
+
+static struct ip_route_cache *udp_cached_route(struct sock *sk)
+{
+	struct ip_route_cache *rc = sk->ip_rc;
+
+	if (rc == NULL || sk->localroute)
+		return NULL;
+	if (rc->rc_stamp != rt_stamp)
+	{
+		if (ip_rc_fill(rc, sk->saddr, sk->daddr, IPPROTO_UDP) < 0)
+			return NULL;
+	}
+	if (!ip_rc_resolve(rc))
+		return NULL;
+	return rc;
+}
+
+
 static int udp_send(struct sock *sk, struct sockaddr_in *sin,
 	 unsigned char *from, int len, int rt)
 {
 	struct sk_buff *skb;
 	struct device *dev;
 	struct udphdr *uh;
+	struct iphdr *iph;
+	struct ip_route_cache *rc;
 	unsigned char *buff;
 	unsigned long saddr;
 	int size, tmp;
@@ -288,9 +367,36 @@ static int udp_send(struct sock *sk, struct sockaddr_in *sin,
 	if (MULTICAST(sin->sin_addr.s_addr))
 		ttl = sk->ip_mc_ttl;
 #endif
-	// 构建ip和mac头
-	tmp = sk->prot->build_header(skb, saddr, sin->sin_addr.s_addr,
-			&dev, IPPROTO_UDP, sk->opt, skb->mem_len,sk->ip_tos,ttl);
+	/*
+	 *	A connected socket sending to its peer can reuse the route,
+	 *	hardware header and IP header it worked out at connect time.
+	 */
+
+	rc = NULL;
+	if (sk->state == TCP_ESTABLISHED && !(rt&MSG_DONTROUTE) &&
+	    sin->sin_addr.s_addr == sk->daddr && sin->sin_port == sk->dummy_th.dest)
+		rc = udp_cached_route(sk);
+
+	if (rc != NULL)
+	{
+		dev = rc->rc_dev;
+		memcpy(buff, rc->rc_hh, rc->rc_hh_len);
+		skb->arp = 1;
+		skb->dev = dev;
+		iph = (struct iphdr *)(buff + rc->rc_hh_len);
+		memcpy(iph, &rc->rc_iph, sizeof(struct iphdr));
+		iph->tos = sk->ip_tos;
+		iph->ttl = ttl;
+		skb->ip_hdr = iph;
+		skb->saddr = iph->saddr;
+		tmp = rc->rc_hh_len + sizeof(struct iphdr);
+	}
+	else
+	{
+		// 构建ip和mac头
+		tmp = sk->prot->build_header(skb, saddr, sin->sin_addr.s_addr,
+				&dev, IPPROTO_UDP, sk->opt, skb->mem_len,sk->ip_tos,ttl);
+	}
 
 	skb->sk=sk;	/* So memory is freed correctly */
 	
@@ -554,6 +660,26 @@ int udp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 	sk->daddr = usin->sin_addr.s_addr;
 	sk->dummy_th.dest = usin->sin_port;
 	sk->state = TCP_ESTABLISHED;
+
+	/*
+	 *	Remember the output path so udp_send() need not look it up
+	 *	again. Multicast sends pick their device per socket option,
+	 *	so they always take the slow path.
+	 */
+#ifdef CONFIG_IP_MULTICAST
+	if (MULTICAST(sk->daddr))
+	{
+		if (sk->ip_rc != NULL)
+			kfree_s(sk->ip_rc, sizeof(struct ip_route_cache));
+		sk->ip_rc = NULL;
+		return(0);
+	}
+#endif
+	if (sk->ip_rc == NULL)
+		sk->ip_rc = (struct ip_route_cache *)
+			kmalloc(sizeof(struct ip_route_cache), GFP_KERNEL);
+	if (sk->ip_rc != NULL)
+		ip_rc_fill(sk->ip_rc, sa, sk->daddr, IPPROTO_UDP);
 	return(0);
 }
 
@@ -562,6 +688,11 @@ static void udp_close(struct sock *sk, int timeout)
 {
 	sk->inuse = 1;
 	sk->state = TCP_CLOSE;
+	if (sk->ip_rc != NULL)
+	{
+		kfree_s(sk->ip_rc, sizeof(struct ip_route_cache));
+		sk->ip_rc = NULL;
+	}
 	if (sk->dead) 
 		destroy_sock(sk);
 	else
@@ -569,8 +700,75 @@ static void udp_close(struct sock *sk, int timeout)
 }
 
 
+#ifdef CONFIG_IP_MULTICAST
+
 /*
- *	All we need to do is get the socket, and then do a checksum. 
+ *	Find the next UDP socket on port num that joined group laddr on
+ *	this device and will take a datagram from raddr:rnum.
+ */
+
+static struct ip_mc_member *udp_mc_next(struct ip_mc_member *m, struct device *dev,
+	unsigned short num, unsigned long raddr, unsigned short rnum, unsigned long laddr)
+{
+	unsigned short hnum = ntohs(num);
+
+	for (; m != NULL; m = m->next)
+	{
+		if (m->multiaddr != laddr || m->interface != dev)
+			continue;
+		if (m->sk->prot != &udp_prot || m->sk->num != hnum)
+			continue;
+		if (sock_mcast_match(m->sk, raddr, rnum, laddr))
+			return m;
+	}
+	return NULL;
+}
+
+/*
+ *	Bound UDP sockets that have joined no group take every multicast
+ *	sent to their port, like a plain INADDR_ANY listener. They are
+ *	counted per port chain, so that delivery only walks the chain when
+ *	there is such a socket on it; group members are found through the
+ *	member index. udp_mc_update() is called whenever a socket goes on
+ *	or off its chain or joins or leaves a group.
+ */
+
+static int udp_mc_wild[SOCK_ARRAY_SIZE];
+
+void udp_mc_update(struct sock *sk)
+{
+	unsigned long flags;
+	int wild, i;
+
+	if (sk->prot != &udp_prot)
+		return;
+	wild = sk->ip_mc_bound;
+	if (wild && sk->ip_mc_list != NULL)
+	{
+		for (i = 0; i < IP_MAX_MEMBERSHIPS; i++)
+		{
+			if (sk->ip_mc_list->multidev[i] != NULL)
+			{
+				wild = 0;
+				break;
+			}
+		}
+	}
+	if (wild == sk->ip_mc_wild)
+		return;
+	save_flags(flags);
+	cli();
+	udp_mc_wild[sk->num & (SOCK_ARRAY_SIZE - 1)] += wild ? 1 : -1;
+	sk->ip_mc_wild = wild;
+	restore_flags(flags);
+}
+
+#endif
+
+/*
+ *	All we need to do is get the socket, and then do a checksum. This is
+ *	also the fragment handler: a reassembled datagram may come in as a
+ *	chain of buffers, which the checksum and skb_copy_datagram() walk.
  */
  
 int udp_rcv(struct sk_buff *skb, struct device *dev, struct options *opt,
@@ -606,7 +804,8 @@ int udp_rcv(struct sk_buff *skb, struct device *dev, struct options *opt,
 		return(0);
 	}
 	// 检查检验和
-	if (uh->check && udp_check(uh, len, saddr, daddr)) 
+	if (uh->check && (skb->fraglist ? udp_check_chain(skb, len, saddr, daddr) :
+			udp_check(uh, len, saddr, daddr)))
 	{
 		/* <mea@utu.fi> wants to know, who sent it, to
 		   go and stomp on the garbage sender... */
@@ -628,26 +827,50 @@ int udp_rcv(struct sk_buff *skb, struct device *dev, struct options *opt,
 		/*
 		 *	Multicasts and broadcasts go to each listener.
 		 */
-		struct sock *sknext=NULL;
-		sk=get_sock_mcast(udp_prot.sock_array[ntohs(uh->dest)&(SOCK_ARRAY_SIZE-1)], uh->dest,
-				saddr, uh->source, daddr);
-		if(sk)
-		{		
-			do
+		struct sock *prev=NULL;
+		struct sk_buff *skb1;
+		struct ip_mc_member *m=NULL;
+
+		/*
+		 *	A multicast goes to the sockets on this port that joined
+		 *	the group here, found through the group index, and to
+		 *	the sockets on the port that joined nothing. The port
+		 *	chain is only walked for the latter, and only when it
+		 *	holds any. A broadcast goes to everyone on the port.
+		 *	Each listener is handed a clone except the last one,
+		 *	which gets the original.
+		 */
+
+		int hash=ntohs(uh->dest)&(SOCK_ARRAY_SIZE-1);
+
+		if(addr_type==IS_MULTICAST)
+		{
+			m=udp_mc_next(ip_mc_members[ip_mc_member_hash(daddr)], dev,
+				uh->dest, saddr, uh->source, daddr);
+			for(; m!=NULL; m=udp_mc_next(m->next, dev, uh->dest, saddr, uh->source, daddr))
 			{
-				struct sk_buff *skb1;
-
-				sknext=get_sock_mcast(sk->next, uh->dest, saddr, uh->source, daddr);
-				if(sknext)
-					skb1=skb_clone(skb,GFP_ATOMIC);
-				else
-					skb1=skb;
-				if(skb1)
-					udp_deliver(sk, uh, skb1, dev,saddr,daddr,len);
-				sk=sknext;
+				if(prev && (skb1=skb_clone(skb,GFP_ATOMIC))!=NULL)
+					udp_deliver(prev, uh, skb1, dev,saddr,daddr,len);
+				prev=m->sk;
 			}
-			while(sknext!=NULL);
+			sk=NULL;
+			if(udp_mc_wild[hash])
+				sk=udp_prot.sock_array[hash];
 		}
+		else
+			sk=udp_prot.sock_array[hash];
+
+		sk=get_sock_mcast(sk, uh->dest, saddr, uh->source, daddr);
+		for(; sk!=NULL; sk=get_sock_mcast(sk->next, uh->dest, saddr, uh->source, daddr))
+		{
+			if(addr_type==IS_MULTICAST && !sk->ip_mc_wild)
+				continue;
+			if(prev && (skb1=skb_clone(skb,GFP_ATOMIC))!=NULL)
+				udp_deliver(prev, uh, skb1, dev,saddr,daddr,len);
+			prev=sk;
+		}
+		if(prev)
+			udp_deliver(prev, uh, skb, dev,saddr,daddr,len);
 		else
 			kfree_skb(skb, FREE_READ);
 		return 0;
@@ -737,6 +960,7 @@ struct proto udp_prot = {
 	NULL,
 	ip_setsockopt,
 	ip_getsockopt,
+	NULL,
 	128,
 	0,
 	{NULL,},
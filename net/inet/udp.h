@@ -45,6 +45,9 @@ extern int	udp_rcv(struct sk_buff *skb, struct device *dev,
 			unsigned short len, unsigned long saddr, int redo,
 			struct inet_protocol *protocol);
 extern int	udp_ioctl(struct sock *sk, int cmd, unsigned long arg);
+#ifdef CONFIG_IP_MULTICAST
+extern void	udp_mc_update(struct sock *sk);
+#endif
 
 
 #endif	/* _UDP_H */
@@ -56,6 +56,7 @@
 #include <linux/kernel.h>
 #include <linux/major.h>
 #include <linux/stat.h>
+#include <linux/malloc.h>
 #include <linux/socket.h>
 #include <linux/fcntl.h>
 #include <linux/net.h>
@@ -78,6 +79,8 @@ static int sock_select(struct inode *inode, struct file *file, int which, select
 static int sock_ioctl(struct inode *inode, struct file *file,
 		      unsigned int cmd, unsigned long arg);
 static int sock_fasync(struct inode *inode, struct file *filp, int on);
+static int sock_mmap(struct inode *inode, struct file *file,
+		     struct vm_area_struct *vma);
 		   
 
 
@@ -93,7 +96,7 @@ static struct file_operations socket_file_ops = {
 	sock_readdir,
 	sock_select,
 	sock_ioctl,
-	NULL,			/* mmap */
+	sock_mmap,
 	NULL,			/* no special open code... */
 	sock_close,
 	NULL,			/* no fsync */
@@ -152,6 +155,75 @@ static int move_addr_to_user(void *kaddr, int klen, void *uaddr, int *ulen)
  	return 0;
 }
 
+/*
+ *	Copy the iovec array of a user msghdr into iov and check that every
+ *	block may be accessed. The msghdr is left pointing at the kernel
+ *	copy. Returns the total length or an error.
+ */
+
+int verify_iovec(struct msghdr *msg, struct iovec *iov, int type)
+{
+	int err, i, len=0;
+
+	if(msg->msg_iovlen<0 || msg->msg_iovlen>UIO_MAXIOV)
+		return -EINVAL;
+	if(msg->msg_iovlen)
+	{
+		err=verify_area(VERIFY_READ,msg->msg_iov,msg->msg_iovlen*sizeof(struct iovec));
+		if(err)
+			return err;
+		memcpy_fromfs(iov,msg->msg_iov,msg->msg_iovlen*sizeof(struct iovec));
+	}
+	for(i=0;i<msg->msg_iovlen;i++)
+	{
+		if(iov[i].iov_len<0 || iov[i].iov_len>0x7fffffff-len)
+			return -EINVAL;
+		err=verify_area(type,iov[i].iov_base,iov[i].iov_len);
+		if(err)
+			return err;
+		len+=iov[i].iov_len;
+	}
+	msg->msg_iov=iov;
+	return len;
+}
+
+/*
+ *	Move len bytes between the kernel and a checked iovec, using the
+ *	blocks up as we go. The iovec must hold at least len bytes.
+ */
+
+void memcpy_fromiovec(unsigned char *kdata, struct iovec *iov, int len)
+{
+	int copy;
+
+	while(len>0)
+	{
+		copy=iov->iov_len<len ? iov->iov_len : len;
+		memcpy_fromfs(kdata,iov->iov_base,copy);
+		iov->iov_base=(char *)iov->iov_base+copy;
+		iov->iov_len-=copy;
+		kdata+=copy;
+		len-=copy;
+		iov++;
+	}
+}
+
+void memcpy_toiovec(struct iovec *iov, unsigned char *kdata, int len)
+{
+	int copy;
+
+	while(len>0)
+	{
+		copy=iov->iov_len<len ? iov->iov_len : len;
+		memcpy_tofs(iov->iov_base,kdata,copy);
+		iov->iov_base=(char *)iov->iov_base+copy;
+		iov->iov_len-=copy;
+		kdata+=copy;
+		len-=copy;
+		iov++;
+	}
+}
+
 /*
  *	Obtains the first available file descriptor and sets it up for use. 
  */
@@ -422,6 +494,28 @@ static int sock_select(struct inode *inode, struct file *file, int sel_type, sel
 }
 
 
+/*
+ *	Map socket memory into user space. Only some protocols have
+ *	anything to map (eg the SOCK_PACKET receive ring).
+ */
+
+static int sock_mmap(struct inode *inode, struct file *file,
+		     struct vm_area_struct *vma)
+{
+	struct socket *sock;
+
+	if (!(sock = socki_lookup(inode))) 
+	{
+		printk("NET: sock_mmap: can't find socket for inode!\n");
+		return(-EBADF);
+	}
+
+	if (sock->ops && sock->ops->mmap)
+		return(sock->ops->mmap(sock, vma));
+	return(-ENODEV);
+}
+
+
 void sock_close(struct inode *inode, struct file *filp)
 {
 	struct socket *sock;
@@ -1087,6 +1181,350 @@ static int sock_recvfrom(int fd, void * buff, int len, unsigned flags,
 	return len;
 }
 
+/*
+ *	A family without sendmsg/recvmsg moves the data through its sendto
+ *	or recvfrom. A single block goes straight down; a longer vector is
+ *	gathered into (or scattered from) a kernel buffer, as a datagram
+ *	has to be passed in one call.
+ */
+
+static int sock_sendto_iovec(struct socket *sock, struct msghdr *msg, int len,
+	int nonblock, unsigned flags)
+{
+	unsigned long fs;
+	unsigned char *buf;
+	int err;
+
+	if(msg->msg_iovlen<=1 || len==0)
+		return(sock->ops->sendto(sock, msg->msg_iovlen?msg->msg_iov->iov_base:NULL,
+			len, nonblock, flags, msg->msg_name, msg->msg_namelen));
+	buf=kmalloc(len,GFP_KERNEL);
+	if(buf==NULL)
+		return -ENOBUFS;
+	memcpy_fromiovec(buf,msg->msg_iov,len);
+	fs=get_fs();
+	set_fs(get_ds());
+	err=sock->ops->sendto(sock, buf, len, nonblock, flags,
+		msg->msg_name, msg->msg_namelen);
+	set_fs(fs);
+	kfree_s(buf,len);
+	return err;
+}
+
+static int sock_recvfrom_iovec(struct socket *sock, struct msghdr *msg, int size,
+	int nonblock, unsigned flags)
+{
+	unsigned long fs;
+	unsigned char *buf;
+	int len;
+
+	if(msg->msg_iovlen<=1 || size==0)
+		return(sock->ops->recvfrom(sock, msg->msg_iovlen?msg->msg_iov->iov_base:NULL,
+			size, nonblock, flags, msg->msg_name, &msg->msg_namelen));
+	buf=kmalloc(size,GFP_KERNEL);
+	if(buf==NULL)
+		return -ENOBUFS;
+	fs=get_fs();
+	set_fs(get_ds());
+	len=sock->ops->recvfrom(sock, buf, size, nonblock, flags,
+		msg->msg_name, &msg->msg_namelen);
+	set_fs(fs);
+	if(len>0)
+		memcpy_toiovec(msg->msg_iov,buf,len);
+	kfree_s(buf,size);
+	return len;
+}
+
+/*
+ *	Send a message with ancillary data. The iovec, the address and the
+ *	control data are copied into the kernel here, the payload stays in
+ *	user space. A family without sendmsg can only send plain data.
+ *
+ *	sock_kern_sendmsg() takes a kernel copy of the header and scratch
+ *	space from the caller, so sendmmsg can set that up once for the
+ *	whole vector.
+ */
+
+#define MAX_SOCK_CONTROL	256	/* a cmsghdr and 16 descriptors fit comfortably */
+#define MMSG_BATCH		8	/* headers copied in per user access	*/
+
+static int sock_kern_sendmsg(struct socket *sock, struct msghdr *msg,
+	struct iovec *iov, char *address, char *control,
+	int nonblock, unsigned flags)
+{
+	int err, len;
+
+	if(msg->msg_controllen<0)
+		return -EINVAL;
+	len=verify_iovec(msg,iov,VERIFY_READ);
+	if(len<0)
+		return len;
+	if(msg->msg_name!=NULL)
+	{
+		if((err=move_addr_to_kernel(msg->msg_name,msg->msg_namelen,address))<0)
+			return err;
+		msg->msg_name=address;
+	}
+	if(msg->msg_control==NULL)
+		msg->msg_controllen=0;
+	if(msg->msg_controllen)
+	{
+		if(msg->msg_controllen>MAX_SOCK_CONTROL)
+			return -ENOBUFS;
+		err=verify_area(VERIFY_READ,msg->msg_control,msg->msg_controllen);
+		if(err)
+			return err;
+		memcpy_fromfs(control,msg->msg_control,msg->msg_controllen);
+		msg->msg_control=control;
+	}
+
+	if(sock->ops->sendmsg==NULL)
+	{
+		if(msg->msg_controllen)
+			return -EOPNOTSUPP;
+		return(sock_sendto_iovec(sock, msg, len, nonblock, flags));
+	}
+	return(sock->ops->sendmsg(sock, msg, len, nonblock, flags));
+}
+
+static int sock_sendmsg(int fd, struct msghdr *umsg, unsigned flags)
+{
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov[UIO_MAXIOV];
+	char address[MAX_SOCK_ADDR];
+	char control[MAX_SOCK_CONTROL];
+	int err;
+
+	if (fd < 0 || fd >= NR_OPEN || ((file = current->files->fd[fd]) == NULL))
+		return(-EBADF);
+	if (!(sock = sockfd_lookup(fd, NULL)))
+		return(-ENOTSOCK);
+
+	err=verify_area(VERIFY_READ,umsg,sizeof(*umsg));
+	if(err)
+		return err;
+	memcpy_fromfs(&msg,umsg,sizeof(msg));
+	return(sock_kern_sendmsg(sock, &msg, iov, address, control,
+		(file->f_flags & O_NONBLOCK), flags));
+}
+
+/*
+ *	Receive a message with ancillary data. The protocol fills kernel
+ *	copies of the address and control buffers and sets msg_flags; we
+ *	pass them back out through umsg. Every user buffer is checked before
+ *	the receive: by the time the protocol returns it may have taken the
+ *	datagram and installed passed descriptors, so nothing after it is
+ *	allowed to fail.
+ */
+
+static int sock_kern_recvmsg(struct socket *sock, struct msghdr *msg,
+	struct msghdr *umsg, struct iovec *iov, char *address, char *control,
+	int nonblock, unsigned flags)
+{
+	void *uname, *ucontrol;
+	int err, len, size, namelen;
+
+	if(msg->msg_controllen<0)
+		return -EINVAL;
+	size=verify_iovec(msg,iov,VERIFY_WRITE);
+	if(size<0)
+		return size;
+	uname=msg->msg_name;
+	namelen=msg->msg_namelen;
+	if(uname!=NULL)
+	{
+		if(namelen<0)
+			return -EINVAL;
+		if(namelen>MAX_SOCK_ADDR)
+			namelen=MAX_SOCK_ADDR;
+		err=verify_area(VERIFY_WRITE,uname,namelen);
+		if(err)
+			return err;
+	}
+	ucontrol=msg->msg_control;
+	if(ucontrol==NULL)
+		msg->msg_controllen=0;
+	if(msg->msg_controllen>MAX_SOCK_CONTROL)
+		msg->msg_controllen=MAX_SOCK_CONTROL;
+	if(msg->msg_controllen)
+	{
+		err=verify_area(VERIFY_WRITE,ucontrol,msg->msg_controllen);
+		if(err)
+			return err;
+	}
+	msg->msg_name=address;
+	msg->msg_namelen=0;
+	msg->msg_control=control;
+	msg->msg_flags=0;
+
+	if(sock->ops->recvmsg==NULL)
+	{
+		len=sock_recvfrom_iovec(sock, msg, size, nonblock, flags);
+		msg->msg_controllen=0;
+	}
+	else
+		len=sock->ops->recvmsg(sock, msg, size, nonblock, flags);
+	if(len<0)
+		return len;
+
+	if(uname!=NULL)
+	{
+		if(namelen>msg->msg_namelen)
+			namelen=msg->msg_namelen;
+		if(namelen)
+			memcpy_tofs(uname,address,namelen);
+		put_fs_long(namelen,(unsigned long *)&umsg->msg_namelen);
+	}
+	if(msg->msg_controllen)
+		memcpy_tofs(ucontrol,control,msg->msg_controllen);
+	put_fs_long(msg->msg_controllen,(unsigned long *)&umsg->msg_controllen);
+	put_fs_long(msg->msg_flags,(unsigned long *)&umsg->msg_flags);
+	return len;
+}
+
+static int sock_recvmsg(int fd, struct msghdr *umsg, unsigned flags)
+{
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov[UIO_MAXIOV];
+	char address[MAX_SOCK_ADDR];
+	char control[MAX_SOCK_CONTROL];
+	int err;
+
+	if (fd < 0 || fd >= NR_OPEN || ((file = current->files->fd[fd]) == NULL))
+		return(-EBADF);
+	if (!(sock = sockfd_lookup(fd, NULL)))
+		return(-ENOTSOCK);
+
+	err=verify_area(VERIFY_WRITE,umsg,sizeof(*umsg));
+	if(err)
+		return err;
+	memcpy_fromfs(&msg,umsg,sizeof(msg));
+	return(sock_kern_recvmsg(sock, &msg, umsg, iov, address, control,
+		(file->f_flags & O_NONBLOCK), flags));
+}
+
+/*
+ *	Send a vector of datagrams in one call. The descriptor is looked up
+ *	and the vector checked once, the headers are pulled in MMSG_BATCH at
+ *	a time and each is handed straight to the protocol using one set of
+ *	scratch buffers. We stop at the first error; if anything was sent
+ *	the count is returned, else the error.
+ */
+
+static int sock_sendmmsg(int fd, struct mmsghdr *vec, int vlen, unsigned flags)
+{
+	struct socket *sock;
+	struct file *file;
+	struct mmsghdr batch[MMSG_BATCH];
+	struct iovec iov[UIO_MAXIOV];
+	char address[MAX_SOCK_ADDR];
+	char control[MAX_SOCK_CONTROL];
+	int err, len, i, j, n, done, nonblock;
+
+	if (fd < 0 || fd >= NR_OPEN || ((file = current->files->fd[fd]) == NULL))
+		return(-EBADF);
+	if (!(sock = sockfd_lookup(fd, NULL)))
+		return(-ENOTSOCK);
+
+	if(vlen<=0)
+		return -EINVAL;
+	if(vlen>MMSG_MAX)
+		vlen=MMSG_MAX;
+	err=verify_area(VERIFY_WRITE,vec,vlen*sizeof(*vec));
+	if(err)
+		return err;
+
+	nonblock=(file->f_flags & O_NONBLOCK);
+	done=0;
+	for(i=0;i<vlen;i+=n)
+	{
+		n=vlen-i;
+		if(n>MMSG_BATCH)
+			n=MMSG_BATCH;
+		memcpy_fromfs(batch,&vec[i],n*sizeof(*vec));
+		for(j=0;j<n;j++)
+		{
+			len=sock_kern_sendmsg(sock, &batch[j].msg_hdr, iov,
+				address, control, nonblock, flags);
+			if(len<0)
+			{
+				err=len;
+				goto out;
+			}
+			put_fs_long(len,(unsigned long *)&vec[i+j].msg_len);
+			done++;
+		}
+	}
+out:
+	if(done)
+		return done;
+	return err;
+}
+
+/*
+ *	Receive up to a vector of datagrams in one call. Only the first one
+ *	may block, after that we take what is already queued and return. As
+ *	for sendmmsg the headers come in MMSG_BATCH at a time and the scratch
+ *	buffers are shared. The number of datagrams received is returned and
+ *	each entry is filled in as recvmsg would.
+ */
+
+static int sock_recvmmsg(int fd, struct mmsghdr *vec, int vlen, unsigned flags)
+{
+	struct socket *sock;
+	struct file *file;
+	struct mmsghdr batch[MMSG_BATCH];
+	struct iovec iov[UIO_MAXIOV];
+	char address[MAX_SOCK_ADDR];
+	char control[MAX_SOCK_CONTROL];
+	int err, len, i, j, n, done, noblock;
+
+	if (fd < 0 || fd >= NR_OPEN || ((file = current->files->fd[fd]) == NULL))
+		return(-EBADF);
+	if (!(sock = sockfd_lookup(fd, NULL)))
+		return(-ENOTSOCK);
+
+	if(vlen<=0)
+		return -EINVAL;
+	if(vlen>MMSG_MAX)
+		vlen=MMSG_MAX;
+	err=verify_area(VERIFY_WRITE,vec,vlen*sizeof(*vec));
+	if(err)
+		return err;
+
+	noblock=(file->f_flags & O_NONBLOCK);
+	done=0;
+	for(i=0;i<vlen;i+=n)
+	{
+		n=vlen-i;
+		if(n>MMSG_BATCH)
+			n=MMSG_BATCH;
+		memcpy_fromfs(batch,&vec[i],n*sizeof(*vec));
+		for(j=0;j<n;j++)
+		{
+			len=sock_kern_recvmsg(sock, &batch[j].msg_hdr,
+				&vec[i+j].msg_hdr, iov, address, control,
+				noblock, flags);
+			if(len<0)
+			{
+				err=len;
+				goto out;
+			}
+			put_fs_long(len,(unsigned long *)&vec[i+j].msg_len);
+			done++;
+			noblock=1;
+		}
+	}
+out:
+	if(done)
+		return done;
+	return err;
+}
+
 /*
  *	Set a socket option. Because we don't know the option lengths we have
  *	to pass the user mode parameter for the protocols to sort out.
@@ -1290,6 +1728,36 @@ asmlinkage int sys_socketcall(int call, unsigned long *args)
 				get_fs_long(args+2),
 				(char *)get_fs_long(args+3),
 				(int *)get_fs_long(args+4)));
+		case SYS_SENDMMSG:
+			er=verify_area(VERIFY_READ, args, 4*sizeof(unsigned long));
+			if(er)
+				return er;
+			return(sock_sendmmsg(get_fs_long(args+0),
+				(struct mmsghdr *)get_fs_long(args+1),
+				get_fs_long(args+2),
+				get_fs_long(args+3)));
+		case SYS_RECVMMSG:
+			er=verify_area(VERIFY_READ, args, 4*sizeof(unsigned long));
+			if(er)
+				return er;
+			return(sock_recvmmsg(get_fs_long(args+0),
+				(struct mmsghdr *)get_fs_long(args+1),
+				get_fs_long(args+2),
+				get_fs_long(args+3)));
+		case SYS_SENDMSG:
+			er=verify_area(VERIFY_READ, args, 3*sizeof(unsigned long));
+			if(er)
+				return er;
+			return(sock_sendmsg(get_fs_long(args+0),
+				(struct msghdr *)get_fs_long(args+1),
+				get_fs_long(args+2)));
+		case SYS_RECVMSG:
+			er=verify_area(VERIFY_READ, args, 3*sizeof(unsigned long));
+			if(er)
+				return er;
+			return(sock_recvmsg(get_fs_long(args+0),
+				(struct msghdr *)get_fs_long(args+1),
+				get_fs_long(args+2)));
 		default:
 			return(-EINVAL);
 	}
@@ -94,6 +94,17 @@ static int unix_proto_setsockopt(struct socket *sock, int level, int optname,
 				  char *optval, int optlen);
 static int unix_proto_getsockopt(struct socket *sock, int level, int optname,
 				  char *optval, int *optlen);
+static int unix_proto_sendmsg(struct socket *sock, struct msghdr *msg,
+			      int len, int nonblock, unsigned flags);
+static int unix_proto_recvmsg(struct socket *sock, struct msghdr *msg,
+			      int size, int nonblock, unsigned flags);
+
+static int unix_dgram_send(struct socket *sock, struct unix_proto_data *pupd,
+			   struct msghdr *msg, int len, int nonblock);
+static int unix_dgram_recv(struct socket *sock, struct msghdr *msg, int size,
+			   int nonblock);
+static int unix_find_other(struct sockaddr *uaddr, int sockaddr_len, int type,
+			   struct unix_proto_data **res);
 
 
 static inline int min(int a, int b)
@@ -130,48 +141,187 @@ static void unix_unlock(struct unix_proto_data *upd)
 }
 
 /*
- *	We don't have to do anything. 
+ *	We don't have to do anything, except refuse to listen on a
+ *	datagram socket.
  */
  
 static int unix_proto_listen(struct socket *sock, int backlog)
 {
+	if (sock->type == SOCK_DGRAM)
+		return(-EOPNOTSUPP);
 	return(0);
 }
 
 /*
- *	Until the new NET3 Unix code is done we have no options.
+ *	Until the new NET3 Unix code is done the only option is SO_SNDBUF,
+ *	the amount a stream writer may have queued at its peer.
  */
 
 static int unix_proto_setsockopt(struct socket *sock, int level, int optname,
 		      char *optval, int optlen)
 {
-	return(-EOPNOTSUPP);
+	struct unix_proto_data *upd = UN_DATA(sock);
+	int val, err;
+
+	if (level != SOL_SOCKET || optname != SO_SNDBUF)
+		return(-EOPNOTSUPP);
+	if (optval == NULL)
+		return(-EINVAL);
+	err=verify_area(VERIFY_READ, optval, sizeof(int));
+	if(err)
+		return err;
+	val = get_fs_long((unsigned long *)optval);
+	if (val > UN_BUF_MAX)
+		val = UN_BUF_MAX;
+	if (val < UN_BUF_MIN)
+		val = UN_BUF_MIN;
+	upd->sndbuf = val;
+	return(0);
 }
 
 
 static int unix_proto_getsockopt(struct socket *sock, int level, int optname,
 		      char *optval, int *optlen)
 {
-	return(-EOPNOTSUPP);
+	struct unix_proto_data *upd = UN_DATA(sock);
+	int err;
+
+	if (level != SOL_SOCKET || optname != SO_SNDBUF)
+		return(-EOPNOTSUPP);
+	err=verify_area(VERIFY_WRITE, optlen, sizeof(int));
+	if(err)
+		return err;
+	put_fs_long(sizeof(int),(unsigned long *) optlen);
+	err=verify_area(VERIFY_WRITE, optval, sizeof(int));
+	if(err)
+		return err;
+	put_fs_long(upd->sndbuf,(unsigned long *)optval);
+	return(0);
 }
 
 
 /*
- *	SendTo() doesn't matter as we also have no Datagram support!
+ *	SendTo() names the target of a datagram. A stream socket can only
+ *	send to its peer, so any address given is ignored as BSD does.
  */
 
 static int unix_proto_sendto(struct socket *sock, void *buff, int len, int nonblock, 
 		  unsigned flags,  struct sockaddr *addr, int addr_len)
 {
-	return(-EOPNOTSUPP);
+	struct msghdr msg;
+	struct iovec iov;
+
+	if (flags != 0)
+		return(-EINVAL);
+	iov.iov_base = buff;
+	iov.iov_len = len;
+	msg.msg_name = addr;
+	msg.msg_namelen = addr_len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	return(unix_proto_sendmsg(sock, &msg, len, nonblock, flags));
 }     
 
 static int unix_proto_recvfrom(struct socket *sock, void *buff, int len, int nonblock, 
 		    unsigned flags, struct sockaddr *addr, int *addr_len)
 {
-	return(-EOPNOTSUPP);
+	struct msghdr msg;
+	struct iovec iov;
+	int err;
+
+	if (flags != 0)
+		return(-EINVAL);
+	iov.iov_base = buff;
+	iov.iov_len = len;
+	msg.msg_name = addr;
+	msg.msg_namelen = 0;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_flags = 0;
+	err = unix_proto_recvmsg(sock, &msg, len, nonblock, flags);
+	*addr_len = msg.msg_namelen;
+	return(err);
 }     
 
+/*
+ *	sendmsg/recvmsg. The iovec, address and control buffers have
+ *	already been copied into the kernel by the socket layer, the data
+ *	has not. A stream moves the blocks one at a time, stopping at the
+ *	first short transfer. Descriptors can only be passed with datagrams.
+ */
+
+static int unix_proto_sendmsg(struct socket *sock, struct msghdr *msg,
+		int len, int nonblock, unsigned flags)
+{
+	struct unix_proto_data *pupd;
+	struct iovec *iov;
+	int err, done;
+
+	if (flags != 0)
+		return(-EINVAL);
+	if (sock->type != SOCK_DGRAM)
+	{
+		if (msg->msg_controllen)
+			return(-EOPNOTSUPP);
+		done = 0;
+		for (iov = msg->msg_iov; iov < msg->msg_iov + msg->msg_iovlen; iov++)
+		{
+			err = unix_proto_write(sock, (char *) iov->iov_base,
+					       iov->iov_len, nonblock);
+			if (err < 0)
+				return(done ? done : err);
+			done += err;
+			if (err < iov->iov_len)
+				break;
+		}
+		return(done);
+	}
+	if (msg->msg_name != NULL)
+	{
+		err = unix_find_other(msg->msg_name, msg->msg_namelen,
+				      SOCK_DGRAM, &pupd);
+		if (err < 0)
+			return(err);
+	}
+	else if ((pupd = UN_DATA(sock)->peerupd) == NULL)
+		return(-ENOTCONN);
+	return(unix_dgram_send(sock, pupd, msg, len, nonblock));
+}
+
+
+static int unix_proto_recvmsg(struct socket *sock, struct msghdr *msg,
+		int size, int nonblock, unsigned flags)
+{
+	struct iovec *iov;
+	int err, done;
+
+	if (flags != 0)
+		return(-EINVAL);
+	msg->msg_namelen = 0;
+	if (sock->type != SOCK_DGRAM)
+	{
+		msg->msg_controllen = 0;
+		done = 0;
+		for (iov = msg->msg_iov; iov < msg->msg_iov + msg->msg_iovlen; iov++)
+		{
+			err = unix_proto_read(sock, (char *) iov->iov_base,
+					      iov->iov_len, nonblock);
+			if (err < 0)
+				return(done ? done : err);
+			done += err;
+			if (err < iov->iov_len)
+				break;
+			nonblock = 1;
+		}
+		return(done);
+	}
+	return(unix_dgram_recv(sock, msg, size, nonblock));
+}
+
 /*
  *	You can't shutdown a unix domain socket.
  */
@@ -208,21 +358,57 @@ static int unix_proto_recv(struct socket *sock, void *buff, int len, int nonbloc
 }
 
 /*
- *	Given an address and an inode go find a unix control structure
+ *	Bound sockets, hashed on the inode of their name. A socket is
+ *	entered by bind and removed when it is released.
+ */
+
+static struct unix_proto_data *unix_hash[UN_HASH_SIZE];
+
+static void unix_hash_insert(struct unix_proto_data *upd)
+{
+	struct unix_proto_data **head = &unix_hash[UN_HASH(upd->inode)];
+
+	upd->hash_next = *head;
+	*head = upd;
+}
+
+
+static void unix_hash_remove(struct unix_proto_data *upd)
+{
+	struct unix_proto_data **pp = &unix_hash[UN_HASH(upd->inode)];
+
+	while (*pp != NULL)
+	{
+		if (*pp == upd)
+		{
+			*pp = upd->hash_next;
+			break;
+		}
+		pp = &(*pp)->hash_next;
+	}
+	upd->hash_next = NULL;
+}
+
+/*
+ *	Given an address and an inode go find a unix control structure.
+ *	A stream socket must be listening; datagram sockets take messages
+ *	whatever their state.
  */
  
 static struct unix_proto_data *
 unix_data_lookup(struct sockaddr_un *sockun, int sockaddr_len,
-		 struct inode *inode)
+		 struct inode *inode, int type)
 {
 	 struct unix_proto_data *upd;
 
-	 for(upd = unix_datas; upd <= last_unix_data; ++upd) 
+	 for(upd = unix_hash[UN_HASH(inode)]; upd; upd = upd->hash_next) 
 	 {
 		if (upd->refcnt > 0 && upd->socket &&
-			upd->socket->state == SS_UNCONNECTED &&
+			upd->inode == inode &&
 			upd->sockaddr_un.sun_family == sockun->sun_family &&
-			upd->inode == inode) 
+			upd->socket->type == type &&
+			(type == SOCK_DGRAM ||
+			 upd->socket->state == SS_UNCONNECTED))
 			
 			return(upd);
 	}
@@ -230,10 +416,61 @@ unix_data_lookup(struct sockaddr_un *sockun, int sockaddr_len,
 }
 
 /*
- *	We allocate a page of data for the socket. This is woefully inadequate and helps cause vast
- *	amounts of excess task switching and blocking when transferring stuff like bitmaps via X.
- *	It doesn't help this problem that the Linux scheduler is desperately in need of a major 
- *	rewrite. Somewhere near 16K would be better maybe 32.
+ * Try to open the name in the filesystem - this is how we
+ * identify ourselves and our server. Note that we don't
+ * hold onto the inode that long, just enough to find our
+ * server. When we're connected, we mooch off the server.
+ */
+
+static int unix_find_other(struct sockaddr *uaddr, int sockaddr_len, int type,
+			   struct unix_proto_data **res)
+{
+	char fname[sizeof(((struct sockaddr_un *)0)->sun_path) + 1];
+	struct sockaddr_un sockun;
+	struct inode *inode;
+	unsigned long old_fs;
+	int i;
+
+	if (sockaddr_len <= UN_PATH_OFFSET ||
+		sockaddr_len > sizeof(struct sockaddr_un)) 
+	{
+		return(-EINVAL);
+	}
+
+	memcpy(&sockun, uaddr, sockaddr_len);
+	sockun.sun_path[sockaddr_len-UN_PATH_OFFSET] = '\0';
+	if (sockun.sun_family != AF_UNIX) 
+	{
+		return(-EINVAL);
+	}
+
+	memcpy(fname, sockun.sun_path, sockaddr_len-UN_PATH_OFFSET);
+	fname[sockaddr_len-UN_PATH_OFFSET] = '\0';
+	old_fs = get_fs();
+	set_fs(get_ds());
+	// 根据传入的路径打开该文件，把inode存在inode变量里
+	i = open_namei(fname, 2, S_IFSOCK, &inode, NULL);
+	set_fs(old_fs);
+	if (i < 0) 
+	{
+		return(i);
+	}
+	// 从unix_proto_data表中找到服务端对应的unix_proto_data结构  
+	*res = unix_data_lookup(&sockun, sockaddr_len, inode, type);
+	iput(inode);
+	// 没有则说明服务端不存在
+	if (*res == NULL) 
+	{
+		return(-EINVAL);
+	}
+	return(0);
+}
+
+/*
+ *	Data is queued in pages allocated as it arrives, up to the writer's
+ *	sndbuf (16K unless SO_SNDBUF says otherwise). A single page was
+ *	woefully inadequate and caused vast amounts of excess task switching
+ *	when transferring stuff like bitmaps via X.
  */
 // 分配一个没有被使用的unix_proto_data结构
 static struct unix_proto_data *
@@ -251,9 +488,14 @@ unix_data_alloc(void)
 			upd->socket = NULL;
 			upd->sockaddr_len = 0;
 			upd->sockaddr_un.sun_family = 0;
-			upd->buf = NULL;
-			upd->bp_head = upd->bp_tail = 0;
+			upd->buf_first = upd->buf_last = NULL;
+			upd->buf_spare = NULL;
+			upd->buf_count = 0;
+			upd->sndbuf = UN_BUF_DEFAULT;
+			upd->msg_first = upd->msg_last = NULL;
+			upd->peer_wait = NULL;
 			upd->inode = NULL;
+			upd->hash_next = NULL;
 			upd->peerupd = NULL;
 			return(upd);
 		}
@@ -279,6 +521,8 @@ static inline void unix_data_ref(struct unix_proto_data *upd)
 }
 
 
+static void unix_msg_free(struct unix_msg *m);
+
 static void unix_data_deref(struct unix_proto_data *upd)
 {
 	if (!upd) 
@@ -288,11 +532,27 @@ static void unix_data_deref(struct unix_proto_data *upd)
 	//引用数为1说明没人使用了，则释放该结构对应的内存
 	if (upd->refcnt == 1) 
 	{
-		if (upd->buf) 
+		struct unix_buf *b;
+		struct unix_msg *m;
+
+		while ((m = upd->msg_first) != NULL)
 		{
-			free_page((unsigned long)upd->buf);
-			upd->buf = NULL;
-			upd->bp_head = upd->bp_tail = 0;
+			upd->msg_first = m->next;
+			unix_msg_free(m);
+		}
+		upd->msg_last = NULL;
+
+		while ((b = upd->buf_first) != NULL)
+		{
+			upd->buf_first = b->next;
+			free_page((unsigned long)b);
+		}
+		upd->buf_last = NULL;
+		upd->buf_count = 0;
+		if (upd->buf_spare)
+		{
+			free_page((unsigned long)upd->buf_spare);
+			upd->buf_spare = NULL;
 		}
 	}
 	--upd->refcnt;
@@ -300,8 +560,380 @@ static void unix_data_deref(struct unix_proto_data *upd)
 
 
 /*
- *	Upon a create, we allocate an empty protocol data,
- *	and grab a page to buffer writes.
+ *	Page management for the data queue. All changes to the list are made
+ *	holding the owner's lock.
+ */
+
+static struct unix_buf *unix_buf_get(struct unix_proto_data *upd)
+{
+	struct unix_buf *b;
+
+	if ((b = upd->buf_spare) != NULL)
+		upd->buf_spare = NULL;
+	else if ((b = (struct unix_buf *) get_free_page(GFP_USER)) == NULL)
+		return(NULL);
+	b->next = NULL;
+	b->head = b->tail = 0;
+	return(b);
+}
+
+
+static void unix_buf_put(struct unix_proto_data *upd, struct unix_buf *b)
+{
+	if (upd->buf_spare == NULL)
+		upd->buf_spare = b;
+	else
+		free_page((unsigned long)b);
+}
+
+
+static void unix_buf_link(struct unix_proto_data *upd, struct unix_buf *b)
+{
+	b->next = NULL;
+	if (upd->buf_last)
+		upd->buf_last->next = b;
+	else
+		upd->buf_first = b;
+	upd->buf_last = b;
+}
+
+
+/*
+ *	The reader has emptied the first page. The last page stays queued
+ *	for the writer to go on filling.
+ */
+
+static void unix_buf_drained(struct unix_proto_data *upd, struct unix_buf *b)
+{
+	if (b->next == NULL)
+	{
+		b->head = b->tail = 0;
+		return;
+	}
+	upd->buf_first = b->next;
+	unix_buf_put(upd, b);
+}
+
+
+/*
+ *	Queue data for a reader. A run of whole pages is filled without
+ *	holding the reader's lock, so a page fault on the writer's side does
+ *	not stall the reader, and each page is then handed over as it is.
+ *	The rest goes on the end of the last page. Returns the number of
+ *	bytes queued or -ENOMEM.
+ */
+
+static int unix_buf_write(struct unix_proto_data *upd, char *ubuf, int size)
+{
+	struct unix_buf *b;
+	int done = 0, cando;
+
+	while (size >= UN_PAGE_SIZE)
+	{
+		if ((b = unix_buf_get(upd)) == NULL)
+			return(done ? done : -ENOMEM);
+		memcpy_fromfs(UN_PAGE_DATA(b), ubuf, UN_PAGE_SIZE);
+		b->head = UN_PAGE_SIZE;
+		unix_lock(upd);
+		unix_buf_link(upd, b);
+		upd->buf_count += UN_PAGE_SIZE;
+		unix_unlock(upd);
+		ubuf += UN_PAGE_SIZE;
+		size -= UN_PAGE_SIZE;
+		done += UN_PAGE_SIZE;
+	}
+
+	if (size == 0)
+		return(done);
+
+	unix_lock(upd);
+	while (size > 0)
+	{
+		b = upd->buf_last;
+		if (b == NULL || b->head == UN_PAGE_SIZE)
+		{
+			if ((b = unix_buf_get(upd)) == NULL)
+				break;
+			unix_buf_link(upd, b);
+		}
+		cando = min(size, UN_PAGE_SIZE - b->head);
+		memcpy_fromfs(UN_PAGE_DATA(b) + b->head, ubuf, cando);
+		b->head += cando;
+		upd->buf_count += cando;
+		ubuf += cando;
+		size -= cando;
+		done += cando;
+	}
+	unix_unlock(upd);
+	return(done ? done : -ENOMEM);
+}
+
+
+/*
+ *	Datagrams. Each one is a single kmalloc()ed unix_msg queued whole at
+ *	the receiver, and counts against the sender's sndbuf in buf_count
+ *	as stream data does. Nothing on the queue is touched from interrupts
+ *	and we never sleep while linking or unlinking, so no lock is needed:
+ *	the data is copied in before the message is queued and copied out
+ *	after it is taken off.
+ */
+
+/*
+ *	Drop the reference a datagram holds on a passed file. This can
+ *	happen in any process's context, so unlike close_fp() it leaves the
+ *	POSIX locks of the current process alone.
+ */
+
+static void unix_fput(struct file *filp)
+{
+	struct inode *inode = filp->f_inode;
+
+	if (filp->f_count > 1)
+	{
+		filp->f_count--;
+		return;
+	}
+	if (filp->f_op && filp->f_op->release)
+		filp->f_op->release(inode, filp);
+	filp->f_count--;
+	filp->f_inode = NULL;
+	if (filp->f_mode & 2)
+		put_write_access(inode);
+	iput(inode);
+}
+
+static void unix_msg_free(struct unix_msg *m)
+{
+	int i;
+
+	for (i = 0; i < m->nfds; i++)
+		if (m->fds[i] != NULL)
+			unix_fput(m->fds[i]);
+	kfree_s(m, sizeof(struct unix_msg) + m->len);
+}
+
+
+/*
+ *	Take a reference to each file named in an SCM_RIGHTS message. The
+ *	files are held by the datagram until it is read or thrown away.
+ *	AF_UNIX sockets can't be passed: one sent over itself, or around a
+ *	loop of sockets, and then closed would hold itself in flight for
+ *	good, and there is no collector to find such loops.
+ */
+
+static int unix_get_fds(struct msghdr *msg, struct unix_msg *m)
+{
+	struct cmsghdr *cm = (struct cmsghdr *) msg->msg_control;
+	struct file *file;
+	int *fdp;
+	int i, n, fd;
+
+	if (msg->msg_controllen == 0)
+		return(0);
+	if (msg->msg_controllen < sizeof(struct cmsghdr) ||
+		cm->cmsg_len < sizeof(struct cmsghdr) ||
+		cm->cmsg_len > msg->msg_controllen ||
+		cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+	{
+		return(-EINVAL);
+	}
+	n = (cm->cmsg_len - sizeof(struct cmsghdr)) / sizeof(int);
+	if (n > UN_MAX_FDS)
+		return(-ETOOMANYREFS);
+	fdp = (int *)(cm + 1);
+	for (i = 0; i < n; i++)
+	{
+		fd = fdp[i];
+		if (fd < 0 || fd >= NR_OPEN ||
+			(file = current->files->fd[fd]) == NULL)
+		{
+			return(-EBADF);
+		}
+		if (file->f_inode != NULL && file->f_inode->i_sock &&
+			file->f_inode->u.socket_i.ops->family == AF_UNIX)
+		{
+			return(-EINVAL);
+		}
+		file->f_count++;
+		m->fds[i] = file;
+		m->nfds = i + 1;
+	}
+	return(0);
+}
+
+
+/*
+ *	Give the receiver the descriptors that came with a datagram, as
+ *	many as its control buffer has room for. The rest are closed when
+ *	the message is freed and the caller is told with MSG_CTRUNC.
+ */
+
+static void unix_put_fds(struct unix_msg *m, struct msghdr *msg)
+{
+	struct cmsghdr *cm;
+	int *fdp;
+	int i, fd, room, n = 0;
+
+	room = 0;
+	if (msg->msg_controllen >= sizeof(struct cmsghdr))
+		room = (msg->msg_controllen - sizeof(struct cmsghdr)) / sizeof(int);
+	cm = (struct cmsghdr *) msg->msg_control;
+	fdp = (int *)(cm + 1);
+	for (i = 0; i < m->nfds; i++)
+	{
+		if (n < room)
+		{
+			for (fd = 0; fd < NR_OPEN; fd++)
+				if (current->files->fd[fd] == NULL)
+					break;
+			if (fd < NR_OPEN)
+			{
+				current->files->fd[fd] = m->fds[i];
+				FD_CLR(fd, &current->files->close_on_exec);
+				m->fds[i] = NULL;
+				fdp[n++] = fd;
+				continue;
+			}
+		}
+		msg->msg_flags |= MSG_CTRUNC;
+	}
+	if (n == 0)
+	{
+		msg->msg_controllen = 0;
+		return;
+	}
+	cm->cmsg_len = sizeof(struct cmsghdr) + n * sizeof(int);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	msg->msg_controllen = cm->cmsg_len;
+}
+
+
+/*
+ *	Queue one datagram at pupd. We hold a reference to the target while
+ *	we may sleep for space, so it can't be reused under us; if it is
+ *	closed meanwhile the datagram is refused.
+ */
+
+static int unix_dgram_send(struct socket *sock, struct unix_proto_data *pupd,
+		struct msghdr *msg, int len, int nonblock)
+{
+	struct unix_proto_data *upd = UN_DATA(sock);
+	struct unix_msg *m;
+	int err;
+
+	if (len < 0)
+		return(-EINVAL);
+	if (len > UN_DGRAM_MAX || len > upd->sndbuf)
+		return(-EMSGSIZE);
+	m = (struct unix_msg *) kmalloc(sizeof(struct unix_msg) + len, GFP_KERNEL);
+	if (m == NULL)
+		return(-ENOBUFS);
+	m->next = NULL;
+	m->len = len;
+	m->nfds = 0;
+	m->addr_len = upd->sockaddr_len;
+	if (m->addr_len)
+		memcpy(&m->addr, &upd->sockaddr_un, m->addr_len);
+	memcpy_fromiovec(UN_MSG_DATA(m), msg->msg_iov, len);
+	if ((err = unix_get_fds(msg, m)) < 0)
+	{
+		unix_msg_free(m);
+		return(err);
+	}
+
+	unix_data_ref(pupd);
+	for (;;)
+	{
+		if (pupd->socket == NULL)
+		{
+			err = -ECONNREFUSED;
+			goto fail;
+		}
+		if (UN_BUF_SPACE(pupd, upd) >= len)
+			break;
+		if (nonblock)
+		{
+			sock->flags |= SO_NOSPACE;
+			err = -EAGAIN;
+			goto fail;
+		}
+		interruptible_sleep_on(&pupd->peer_wait);
+		if (current->signal & ~current->blocked)
+		{
+			err = -ERESTARTSYS;
+			goto fail;
+		}
+	}
+
+	if (pupd->msg_last)
+		pupd->msg_last->next = m;
+	else
+		pupd->msg_first = m;
+	pupd->msg_last = m;
+	pupd->buf_count += len;
+	wake_up_interruptible(pupd->socket->wait);
+	sock_wake_async(pupd->socket, 1);
+	unix_data_deref(pupd);
+	return(len);
+
+fail:
+	unix_data_deref(pupd);
+	unix_msg_free(m);
+	return(err);
+}
+
+
+/*
+ *	Take the next datagram. What doesn't fit in the buffer is lost and
+ *	MSG_TRUNC is set. A connected pair whose other end has gone reads
+ *	end of file, as a stream would.
+ */
+
+static int unix_dgram_recv(struct socket *sock, struct msghdr *msg, int size,
+		int nonblock)
+{
+	struct unix_proto_data *upd = UN_DATA(sock);
+	struct unix_msg *m;
+	int copy;
+
+	while ((m = upd->msg_first) == NULL)
+	{
+		if (sock->state == SS_DISCONNECTING)
+			return(0);
+		if (nonblock)
+			return(-EAGAIN);
+		sock->flags |= SO_WAITDATA;
+		interruptible_sleep_on(sock->wait);
+		sock->flags &= ~SO_WAITDATA;
+		if (current->signal & ~current->blocked)
+		{
+			return(-ERESTARTSYS);
+		}
+	}
+	if ((upd->msg_first = m->next) == NULL)
+		upd->msg_last = NULL;
+	upd->buf_count -= m->len;
+	wake_up_interruptible(&upd->peer_wait);
+
+	copy = min(size, m->len);
+	memcpy_toiovec(msg->msg_iov, UN_MSG_DATA(m), copy);
+	if (copy < m->len)
+		msg->msg_flags |= MSG_TRUNC;
+	if (msg->msg_name != NULL && m->addr_len)
+	{
+		memcpy(msg->msg_name, &m->addr, m->addr_len);
+		msg->msg_namelen = m->addr_len;
+	}
+	unix_put_fds(m, msg);
+	unix_msg_free(m);
+	return(copy);
+}
+
+
+/*
+ *	Upon a create, we allocate an empty protocol data. Buffer pages
+ *	come later, with the data.
  */
  
 static int unix_proto_create(struct socket *sock, int protocol)
@@ -322,13 +954,6 @@ static int unix_proto_create(struct socket *sock, int protocol)
 		printk("UNIX: create: can't allocate buffer\n");
 		return(-ENOMEM);
 	}
-	// 给unix_proto_data的buf字段分配一个页大小的内存
-	if (!(upd->buf = (char*) get_free_page(GFP_USER))) 
-	{
-		printk("UNIX: create: can't get page!\n");
-		unix_data_deref(upd);
-		return(-ENOMEM);
-	}
 	upd->protocol = protocol;
 	// 关联unix_proto_data对应的socket结构
 	upd->socket = sock;
@@ -360,6 +985,7 @@ static int unix_proto_dup(struct socket *newsock, struct socket *oldsock)
 static int unix_proto_release(struct socket *sock, struct socket *peer)
 {
 	struct unix_proto_data *upd = UN_DATA(sock);
+	struct unix_msg *m;
 
 	if (!upd) 
 		return(0);
@@ -372,12 +998,26 @@ static int unix_proto_release(struct socket *sock, struct socket *peer)
 
 	if (upd->inode) 
 	{
+		unix_hash_remove(upd);
 		iput(upd->inode);
 		upd->inode = NULL;
 	}
 
 	UN_DATA(sock) = NULL;
 	upd->socket = NULL;
+	wake_up_interruptible(&upd->peer_wait);
+
+	/*
+	 *	Nobody will read the datagrams now, so let go of them and of
+	 *	any files they carry even if a sender still holds us.
+	 */
+	while ((m = upd->msg_first) != NULL)
+	{
+		upd->msg_first = m->next;
+		upd->buf_count -= m->len;
+		unix_msg_free(m);
+	}
+	upd->msg_last = NULL;
 
 	if (upd->peerupd)
 		unix_data_deref(upd->peerupd);
@@ -444,6 +1084,7 @@ static int unix_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
 		return(i);
 	}
 	upd->sockaddr_len = sockaddr_len;	/* now it's legal */
+	unix_hash_insert(upd);
 	
 	return(0);
 }
@@ -458,17 +1099,24 @@ static int unix_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
 static int unix_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
 		   int sockaddr_len, int flags)
 {
-	char fname[sizeof(((struct sockaddr_un *)0)->sun_path) + 1];
-	struct sockaddr_un sockun;
-	struct unix_proto_data *serv_upd;
-	struct inode *inode;
-	unsigned long old_fs;
+	struct unix_proto_data *serv_upd, *upd = UN_DATA(sock);
 	int i;
 
-	if (sockaddr_len <= UN_PATH_OFFSET ||
-		sockaddr_len > sizeof(struct sockaddr_un)) 
+	/*
+	 *	A datagram socket just remembers (and holds) its default
+	 *	target. It may be connected again at any time.
+	 */
+
+	if (sock->type == SOCK_DGRAM)
 	{
-		return(-EINVAL);
+		if ((i = unix_find_other(uservaddr, sockaddr_len, SOCK_DGRAM, &serv_upd)) < 0)
+			return(i);
+		unix_data_ref(serv_upd);
+		if (upd->peerupd)
+			unix_data_deref(upd->peerupd);
+		upd->peerupd = serv_upd;
+		sock->state = SS_CONNECTED;
+		return(0);
 	}
 
 	if (sock->state == SS_CONNECTING) 
@@ -476,39 +1124,8 @@ static int unix_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
 	if (sock->state == SS_CONNECTED)
 		return(-EISCONN);
 
-	memcpy(&sockun, uservaddr, sockaddr_len);
-	sockun.sun_path[sockaddr_len-UN_PATH_OFFSET] = '\0';
-	if (sockun.sun_family != AF_UNIX) 
-	{
-		return(-EINVAL);
-	}
-
-/*
- * Try to open the name in the filesystem - this is how we
- * identify ourselves and our server. Note that we don't
- * hold onto the inode that long, just enough to find our
- * server. When we're connected, we mooch off the server.
- */
-
-	memcpy(fname, sockun.sun_path, sockaddr_len-UN_PATH_OFFSET);
-	fname[sockaddr_len-UN_PATH_OFFSET] = '\0';
-	old_fs = get_fs();
-	set_fs(get_ds());
-	// 根据传入的路径打开该文件，把inode存在inode变量里
-	i = open_namei(fname, 2, S_IFSOCK, &inode, NULL);
-	set_fs(old_fs);
-	if (i < 0) 
-	{
+	if ((i = unix_find_other(uservaddr, sockaddr_len, sock->type, &serv_upd)) < 0)
 		return(i);
-	}
-	// 从unix_proto_data表中找到服务端对应的unix_proto_data结构  
-	serv_upd = unix_data_lookup(&sockun, sockaddr_len, inode);
-	iput(inode);
-	// 没有则说明服务端不存在
-	if (!serv_upd) 
-	{
-		return(-EINVAL);
-	}
 	// 把客户端追加到服务端的连接队列，阻塞自己，等待服务器处理后唤醒
 	if ((i = sock_awaitconn(sock, serv_upd->socket, flags)) < 0) 
 	{
@@ -551,6 +1168,9 @@ static int unix_proto_accept(struct socket *sock, struct socket *newsock, int fl
 {
 	struct socket *clientsock;
 
+	if (sock->type == SOCK_DGRAM)
+		return(-EOPNOTSUPP);
+
 /*
  * If there aren't any sockets awaiting connection,
  * then wait for one, unless nonblocking.
@@ -615,7 +1235,10 @@ static int unix_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
 			return(-EINVAL);
 		}
 		// 获取对端的unix_proto_data结构
-		upd = UN_DATA(sock->conn);
+		if (sock->type == SOCK_DGRAM)
+			upd = UN_DATA(sock)->peerupd;
+		else
+			upd = UN_DATA(sock->conn);
 	}
 	else
 		upd = UN_DATA(sock);
@@ -634,14 +1257,18 @@ static int unix_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
 static int unix_proto_read(struct socket *sock, char *ubuf, int size, int nonblock)
 {
 	struct unix_proto_data *upd;
-	int todo, avail;
+	struct unix_buf *b;
+	int todo, cando, before;
 
+	if (sock->type == SOCK_DGRAM)
+		return(unix_proto_recvfrom(sock, ubuf, size, nonblock, 0,
+					   NULL, &todo));
 	if ((todo = size) <= 0) 
 		return(0);
 
 	upd = UN_DATA(sock);
 	// 看buf中有多少数据可读
-	while(!(avail = UN_BUF_AVAIL(upd))) 
+	while(!UN_BUF_AVAIL(upd)) 
 	{
 		if (sock->state != SS_CONNECTED) 
 		{
@@ -662,58 +1289,84 @@ static int unix_proto_read(struct socket *sock, char *ubuf, int size, int nonblo
 	}
 
 /*
- *	Copy from the read buffer into the user's buffer,
- *	watching for wraparound. Then we wake up the writer.
+ *	Copy from the queued pages into the user's buffer, giving back
+ *	each page as it empties. Then we wake up the writer.
  */
     // 加锁
 	unix_lock(upd);
+	before = UN_BUF_AVAIL(upd);
 	do 
 	{
-		int part, cando;
-
-		if (avail <= 0) 
-		{
-			printk("UNIX: read: AVAIL IS NEGATIVE!!!\n");
-			send_sig(SIGKILL, current, 1);
-			return(-EPIPE);
-		}
-		// 要读的比可读的多，则要读的为可读的数量
-		if ((cando = todo) > avail) 
-			cando = avail;
-		// 有一部分数据在队尾，一部分在队头，则先读队尾的,bp_tail表示可写空间的最后一个字节加1，即可读的第一个字节
-		if (cando >(part = BUF_SIZE - upd->bp_tail)) 
-			cando = part;
-		memcpy_tofs(ubuf, upd->buf + upd->bp_tail, cando);
-		// 更新bp_tail，可写空间增加
-		upd->bp_tail =(upd->bp_tail + cando) &(BUF_SIZE-1);
+		b = upd->buf_first;
+		if ((cando = todo) > b->head - b->tail)
+			cando = b->head - b->tail;
+		memcpy_tofs(ubuf, UN_PAGE_DATA(b) + b->tail, cando);
+		b->tail += cando;
+		upd->buf_count -= cando;
 		// 更新用户的buf指针
 		ubuf += cando;
 		// 还需要读的字节数
 		todo -= cando;
-		if (sock->state == SS_CONNECTED)
+		if (b->tail == b->head)
+			unix_buf_drained(upd, b);
+	} 
+	while(todo && UN_BUF_AVAIL(upd));// 还有数据并且还没读完则继续
+	unix_unlock(upd);
+
+	/*
+	 *	A blocked writer waits for half its buffer to be free (see
+	 *	below), so only wake it when we cross that line or empty the
+	 *	queue, not for every read.
+	 */
+
+	if (sock->state == SS_CONNECTED)
+	{
+		int half = UN_DATA(sock->conn)->sndbuf / 2;
+
+		if (UN_BUF_AVAIL(upd) == 0 ||
+			(before > half && UN_BUF_AVAIL(upd) <= half))
 		{
 			wake_up_interruptible(sock->conn->wait);
 			sock_wake_async(sock->conn, 2);
 		}
-		avail = UN_BUF_AVAIL(upd);
-	} 
-	while(todo && avail);// 还有数据并且还没读完则继续
-	unix_unlock(upd);
+	}
 	return(size - todo);// 要读的减去读了的
 }
 
 
+/*
+ *	Wake a reader once there is data queued for it.
+ */
+
+static void unix_wake_reader(struct socket *sock)
+{
+	if (sock->state == SS_CONNECTED)
+	{
+		wake_up_interruptible(sock->conn->wait);
+		sock_wake_async(sock->conn, 1);
+	}
+}
+
+
 /*
  *	We write to our peer's buf. When we connected we ref'd this
  *	peer so we are safe that the buffer remains, even after the
  *	peer has disconnected, which we check other ways.
+ *
+ *	A blocking write goes on until all the data is queued. It sleeps
+ *	for space only when less than half the buffer (or what is left of
+ *	the write, if smaller) is free, and wakes the reader when it is
+ *	about to sleep or is done, so large transfers move in big batches
+ *	rather than a few bytes per context switch.
  */
  
 static int unix_proto_write(struct socket *sock, char *ubuf, int size, int nonblock)
 {
-	struct unix_proto_data *pupd;
-	int todo, space;
+	struct unix_proto_data *upd, *pupd;
+	int todo, space, cando;
 
+	if (sock->type == SOCK_DGRAM)
+		return(unix_proto_sendto(sock, ubuf, size, nonblock, 0, NULL, 0));
 	if ((todo = size) <= 0)
 		return(0);
 	if (sock->state != SS_CONNECTED) 
@@ -725,80 +1378,66 @@ static int unix_proto_write(struct socket *sock, char *ubuf, int size, int nonbl
 		}
 		return(-EINVAL);
 	}
+	upd = UN_DATA(sock);
 	// 获取对端的unix_proto_data字段
-	pupd = UN_DATA(sock)->peerupd;	/* safer than sock->conn */
-	// 还有多少空间可写
-	while(!(space = UN_BUF_SPACE(pupd))) 
-	{
-		sock->flags |= SO_NOSPACE;
-		if (nonblock) 
-			return(-EAGAIN);
-		sock->flags &= ~SO_NOSPACE;
-		interruptible_sleep_on(sock->wait);
-		if (current->signal & ~current->blocked) 
-		{
-			return(-ERESTARTSYS);
-		}
-		if (sock->state == SS_DISCONNECTING) 
-		{
-			send_sig(SIGPIPE, current, 1);
-			return(-EPIPE);
-		}
-	}
-
-/*
- *	Copy from the user's buffer to the write buffer,
- *	watching for wraparound. Then we wake up the reader.
- */
-   
-	unix_lock(pupd);
+	pupd = upd->peerupd;	/* safer than sock->conn */
 
-	do 
+	while (todo > 0)
 	{
-		int part, cando;
-
-		if (space <= 0) 
+		// 还有多少空间可写
+		while ((space = UN_BUF_SPACE(pupd, upd)) < min(todo, upd->sndbuf / 2))
 		{
-			printk("UNIX: write: SPACE IS NEGATIVE!!!\n");
-			send_sig(SIGKILL, current, 1);
-			return(-EPIPE);
+			if (nonblock)
+			{
+				if (space > 0)
+					break;
+				sock->flags |= SO_NOSPACE;
+				if (todo != size)
+					break;
+				return(-EAGAIN);
+			}
+			unix_wake_reader(sock);
+			interruptible_sleep_on(sock->wait);
+			if (current->signal & ~current->blocked) 
+			{
+				return((todo != size) ? size - todo : -ERESTARTSYS);
+			}
+			if (sock->state == SS_DISCONNECTING) 
+			{
+				send_sig(SIGPIPE, current, 1);
+				return(-EPIPE);
+			}
 		}
+		if (space <= 0)
+			break;
 
 		/*
-		 *	We may become disconnected inside this loop, so watch
+		 *	We may become disconnected while blocked, so watch
 		 *	for it (peerupd is safe until we close).
 		 */
 		 
 		if (sock->state == SS_DISCONNECTING) 
 		{
 			send_sig(SIGPIPE, current, 1);
-			unix_unlock(pupd);
 			return(-EPIPE);
 		}
 		// 需要写的比能写的多
 		if ((cando = todo) > space) 
 			cando = space;
-		// 可写空间一部分在队头一部分在队尾，则先写队尾的，再写队头的
-		if (cando >(part = BUF_SIZE - pupd->bp_head))
-			cando = part;
-	
-		memcpy_fromfs(pupd->buf + pupd->bp_head, ubuf, cando);
-		// 更新可写地址，可写空间减少，处理回环情况
-		pupd->bp_head =(pupd->bp_head + cando) &(BUF_SIZE-1);
+		cando = unix_buf_write(pupd, ubuf, cando);
+		if (cando < 0)
+		{
+			if (todo == size)
+				return(cando);
+			break;
+		}
 		// 更新用户的buf指针
 		ubuf += cando;
 		// 还需要写多少个字
 		todo -= cando;
-		if (sock->state == SS_CONNECTED)
-		{
-			wake_up_interruptible(sock->conn->wait);
-			sock_wake_async(sock->conn, 1);
-		}
-		space = UN_BUF_SPACE(pupd);
 	}
-	while(todo && space);
 
-	unix_unlock(pupd);
+	unix_wake_reader(sock);
 	return(size - todo);
 }
 
@@ -826,6 +1465,33 @@ static int unix_proto_select(struct socket *sock, int sel_type, select_table * w
 		return(0);
 	}
 
+	/*
+	 *	Datagram sockets: readable with a message queued, writable
+	 *	while the default target has room (senders wait on the
+	 *	target's peer_wait for that).
+	 */
+	if (sock->type == SOCK_DGRAM)
+	{
+		upd = UN_DATA(sock);
+		if (sel_type == SEL_IN)
+		{
+			if (upd->msg_first || sock->state == SS_DISCONNECTING)
+				return(1);
+			select_wait(sock->wait, wait);
+			return(0);
+		}
+		if (sel_type == SEL_OUT)
+		{
+			peerupd = upd->peerupd;
+			if (peerupd == NULL || peerupd->socket == NULL ||
+				UN_BUF_SPACE(peerupd, upd) > 0)
+				return(1);
+			select_wait(&peerupd->peer_wait, wait);
+			return(0);
+		}
+		return(0);
+	}
+
 	if (sel_type == SEL_IN) 
 	{
 		upd = UN_DATA(sock);
@@ -846,7 +1512,7 @@ static int unix_proto_select(struct socket *sock, int sel_type, select_table * w
 			return(1);
 		}
 		peerupd = UN_DATA(sock->conn);
-		if (UN_BUF_SPACE(peerupd) > 0) 
+		if (UN_BUF_SPACE(peerupd, UN_DATA(sock)) > 0) 
 			return(1);
 		select_wait(sock->wait,wait);
 		return(0);
@@ -871,6 +1537,8 @@ static int unix_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long
 
 	upd = UN_DATA(sock);
 	peerupd = (sock->state == SS_CONNECTED) ? UN_DATA(sock->conn) : NULL;
+	if (sock->type == SOCK_DGRAM)
+		peerupd = upd->peerupd;
 
 	switch(cmd) 
 	{
@@ -880,7 +1548,10 @@ static int unix_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long
 			er=verify_area(VERIFY_WRITE,(void *)arg, sizeof(unsigned long));
 			if(er)
 				return er;
-			if (UN_BUF_AVAIL(upd) || peerupd)
+			if (sock->type == SOCK_DGRAM)	/* size of the next datagram */
+				put_fs_long(upd->msg_first ? upd->msg_first->len : 0,
+					(unsigned long *)arg);
+			else if (UN_BUF_AVAIL(upd) || peerupd)
 				put_fs_long(UN_BUF_AVAIL(upd),(unsigned long *)arg);
 			else
 				put_fs_long(0,(unsigned long *)arg);
@@ -892,7 +1563,7 @@ static int unix_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long
 			if(er)
 				return er;
 			if (peerupd) 
-				put_fs_long(UN_BUF_SPACE(peerupd),(unsigned long *)arg);
+				put_fs_long(UN_BUF_SPACE(peerupd, upd),(unsigned long *)arg);
 			else
 				put_fs_long(0,(unsigned long *)arg);
 			break;
@@ -925,7 +1596,10 @@ static struct proto_ops unix_proto_ops = {
 	unix_proto_shutdown,
 	unix_proto_setsockopt,
 	unix_proto_getsockopt,
-	NULL				/* unix_proto_fcntl	*/
+	NULL,				/* unix_proto_fcntl	*/
+	NULL,				/* unix_proto_mmap	*/
+	unix_proto_sendmsg,
+	unix_proto_recvmsg
 };
 
 /*
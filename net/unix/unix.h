@@ -28,6 +28,36 @@
 #ifdef _LINUX_UN_H
 
 
+/*
+ * Stream data queued at a socket is kept in a list of pages, each with
+ * this header at the front. Unread data is [tail, head) of the page.
+ */
+struct unix_buf {
+	struct unix_buf	*next;
+	int		head, tail;
+};
+
+#define UN_PAGE_DATA(BUF)	((char *)((BUF) + 1))
+#define UN_PAGE_SIZE		((int)(PAGE_SIZE - sizeof(struct unix_buf)))
+
+/*
+ * A queued datagram: this header, then the data. The sender's name and
+ * any descriptors it passed travel with it.
+ */
+#define UN_MAX_FDS		16
+
+struct unix_msg {
+	struct unix_msg	*next;
+	int		len;
+	short		addr_len;	/* 0 if the sender was unbound	*/
+	struct sockaddr_un	addr;
+	int		nfds;
+	struct file	*fds[UN_MAX_FDS];
+};
+
+#define UN_MSG_DATA(MSG)	((unsigned char *)((MSG) + 1))
+#define UN_DGRAM_MAX		(16*PAGE_SIZE)
+
 struct unix_proto_data {
 	int		refcnt;		/* cnt of reference 0=free	*/
 					/* -1=not initialised	-bgm	*/
@@ -35,9 +65,14 @@ struct unix_proto_data {
 	int		protocol;
 	struct sockaddr_un	sockaddr_un;
 	short		sockaddr_len;	/* >0 if name bound		*/
-	char		*buf;
-	int		bp_head, bp_tail; // 可写空间的头尾指针
+	struct unix_buf	*buf_first, *buf_last;	/* Data queued for us, oldest first */
+	struct unix_buf	*buf_spare;	/* A drained page kept for reuse */
+	int		buf_count;	/* Bytes queued */
+	int		sndbuf;		/* Most we may queue at our peer */
+	struct unix_msg	*msg_first, *msg_last;	/* Datagrams queued for us */
+	struct wait_queue *peer_wait;	/* Senders waiting for queue space */
 	struct inode	*inode;
+	struct unix_proto_data	*hash_next;	/* Bound sockets, by inode */
 	struct unix_proto_data	*peerupd;
 	struct wait_queue *wait;	/* Lock across page faults (FvK) */
 	int		lock_flag;
@@ -54,14 +89,21 @@ extern struct unix_proto_data unix_datas[NSOCKETS_UNIX];
 							->sun_path)
 
 /*
- * Buffer size must be power of 2. buffer mgmt inspired by pipe code.
- * note that buffer contents can wraparound, and we can write one byte less
- * than full size to discern full vs empty.
+ * A writer may have up to its sndbuf bytes queued at the reader. Pages
+ * are only allocated as the data arrives, so an idle socket holds none.
+ */
+#define UN_BUF_DEFAULT		(4*PAGE_SIZE)
+#define UN_BUF_MIN		PAGE_SIZE
+#define UN_BUF_MAX		(64*PAGE_SIZE)
+#define UN_BUF_AVAIL(UPD)	((UPD)->buf_count)
+#define UN_BUF_SPACE(UPD,WUPD)	((WUPD)->sndbuf - (UPD)->buf_count)
+
+/*
+ * Bound sockets are hashed on the inode of their name, so connect and
+ * sendto find the target without walking every socket.
  */
-#define BUF_SIZE		PAGE_SIZE
-#define UN_BUF_AVAIL(UPD)	(((UPD)->bp_head - (UPD)->bp_tail) & \
-								(BUF_SIZE-1))
-#define UN_BUF_SPACE(UPD)	((BUF_SIZE-1) - UN_BUF_AVAIL(UPD))
+#define UN_HASH_SIZE		64
+#define UN_HASH(INODE)		(((INODE)->i_dev ^ (INODE)->i_ino) & (UN_HASH_SIZE - 1))
 
 #endif	/* _LINUX_UN_H */
 